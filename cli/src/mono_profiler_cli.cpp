@@ -0,0 +1,390 @@
+#include "mono_profiler_client.h"
+#include "report_writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+	Command-line profiler client for machines without a display, e.g. nightly test runs: it records a session to a
+	database, and prints the same aggregations the UI shows as CSV or JSON, so that scripts can compare runs. Exit code
+	is 0 on success, 1 on errors, and 2 if a checked limit was exceeded.
+*/
+
+namespace
+{
+	const char* usage =
+		"Usage: owlcat_mono_profiler_cli <command> [options]\n"
+		"\n"
+		"Commands:\n"
+		"  record --address <addr> [--port <port>] --db <file> [--duration <seconds>]\n"
+		"      Connects to a profiler server and records events until the server disconnects, the duration\n"
+		"      expires or the process is interrupted\n"
+		"  import --trace <file> --db <file>\n"
+		"      Converts a trace recorded by server without a client into a database\n"
+		"  frames --db <file> [--from <frame>] [--to <frame>] [--format csv|json]\n"
+		"      Prints numbers of allocations and frees and allocated memory size for each frame\n"
+		"  live --db <file> [--from <frame>] [--to <frame>] [--by type|callstack|type-callstack] [--top <n>]\n"
+		"       [--max-size <bytes>] [--format csv|json]\n"
+		"      Prints objects allocated and not freed in the timeframe, grouped and sorted by size. With --max-size,\n"
+		"      exits with code 2 if they take more memory\n"
+		"\n"
+		"Port defaults to 8888, frames default to all recorded frames, format defaults to csv.\n";
+
+	constexpr int exit_ok = 0;
+	constexpr int exit_error = 1;
+	constexpr int exit_limit_exceeded = 2;
+
+	// Same as in the UI
+	constexpr uint64_t default_port = 8888;
+
+	std::atomic<bool> g_interrupted{ false };
+
+	void on_interrupt(int)
+	{
+		g_interrupted = true;
+	}
+
+	/*
+		Options of a command, given as "--name value" pairs
+	*/
+	class options
+	{
+		std::map<std::string, std::string> m_values;
+
+	public:
+		bool parse(int argc, char** argv, int first)
+		{
+			for (int i = first; i < argc; i += 2)
+			{
+				std::string name = argv[i];
+				if (name.size() < 3 || name.compare(0, 2, "--") != 0 || i + 1 >= argc)
+				{
+					fprintf(stderr, "Bad option: %s\n", argv[i]);
+					return false;
+				}
+				m_values[name.substr(2)] = argv[i + 1];
+			}
+			return true;
+		}
+
+		bool has(const std::string& name) const
+		{
+			return m_values.find(name) != m_values.end();
+		}
+
+		bool get(const std::string& name, std::string& value) const
+		{
+			auto iter = m_values.find(name);
+			if (iter == m_values.end())
+			{
+				fprintf(stderr, "Missing option: --%s\n", name.c_str());
+				return false;
+			}
+			value = iter->second;
+			return true;
+		}
+
+		bool get(const std::string& name, uint64_t& value) const
+		{
+			std::string text;
+			if (!get(name, text))
+				return false;
+
+			char* end = nullptr;
+			value = strtoull(text.c_str(), &end, 10);
+			if (text.empty() || *end != 0)
+			{
+				fprintf(stderr, "Bad value of --%s: %s\n", name.c_str(), text.c_str());
+				return false;
+			}
+			return true;
+		}
+
+		// Returns the value if the option is present, and default_value otherwise
+		bool get_optional(const std::string& name, uint64_t& value, uint64_t default_value) const
+		{
+			value = default_value;
+			return !has(name) || get(name, value);
+		}
+
+		bool get_format(owlcat::report_writer::format& format) const
+		{
+			format = owlcat::report_writer::format::csv;
+			if (!has("format"))
+				return true;
+
+			std::string text;
+			get("format", text);
+			if (text == "csv")
+				return true;
+			if (text == "json")
+			{
+				format = owlcat::report_writer::format::json;
+				return true;
+			}
+			fprintf(stderr, "Unknown format: %s\n", text.c_str());
+			return false;
+		}
+	};
+
+	bool open_db(owlcat::mono_profiler_client& client, const options& opts)
+	{
+		std::string db;
+		if (!opts.get("db", db))
+			return false;
+
+		if (!client.open_data(db))
+		{
+			fprintf(stderr, "Failed to open database %s\n", db.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// Reads --from and --to, defaulting to the recorded frames. Returns false if options are bad or the timeframe is empty
+	bool get_timeframe(owlcat::mono_profiler_client& client, const options& opts, uint64_t& from, uint64_t& to)
+	{
+		uint64_t min_frame = 0;
+		uint64_t max_frame = 0;
+		client.get_data()->get_frame_boundaries(min_frame, max_frame);
+
+		if (!opts.get_optional("from", from, min_frame) || !opts.get_optional("to", to, max_frame))
+			return false;
+		if (from > to)
+		{
+			fprintf(stderr, "Empty timeframe: %llu - %llu\n", (unsigned long long)from, (unsigned long long)to);
+			return false;
+		}
+		return true;
+	}
+
+	void print_summary(owlcat::mono_profiler_client& client)
+	{
+		uint64_t min_frame = 0;
+		uint64_t max_frame = 0;
+		client.get_data()->get_frame_boundaries(min_frame, max_frame);
+		fprintf(stderr, "Frames %llu - %llu, %zu types, %zu callstacks\n", (unsigned long long)min_frame, (unsigned long long)max_frame,
+			client.get_data()->get_types_count(), client.get_data()->get_callstacks_count());
+	}
+
+	int record(owlcat::mono_profiler_client& client, const options& opts)
+	{
+		std::string address;
+		std::string db;
+		uint64_t port = 0;
+		uint64_t duration = 0;
+		if (!opts.get("address", address) || !opts.get_optional("port", port, default_port) || !opts.get("db", db) || !opts.get_optional("duration", duration, 0))
+			return exit_error;
+
+		if (!client.start(address, (int)port, db))
+		{
+			fprintf(stderr, "Failed to connect to %s:%llu\n", address.c_str(), (unsigned long long)port);
+			return exit_error;
+		}
+
+		// Stop and Ctrl+C end the recording, and the database still gets everything received so far
+		std::signal(SIGINT, on_interrupt);
+		std::signal(SIGTERM, on_interrupt);
+
+		// Client processes messages on its own thread, so this one only has to notice when the session is over.
+		// After the server disconnects, messages already received are processed before the client is stopped
+		auto start_time = std::chrono::steady_clock::now();
+		while (!g_interrupted)
+		{
+			if (!client.is_connected() && !client.is_connecting() && client.get_network_messages_count() == 0)
+				break;
+			if (duration != 0 && std::chrono::steady_clock::now() - start_time >= std::chrono::seconds(duration))
+				break;
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+
+		client.stop();
+		print_summary(client);
+		client.close_db();
+		return exit_ok;
+	}
+
+	int import(owlcat::mono_profiler_client& client, const options& opts)
+	{
+		std::string trace;
+		std::string db;
+		if (!opts.get("trace", trace) || !opts.get("db", db))
+			return exit_error;
+
+		if (!client.import_trace(trace, db))
+		{
+			fprintf(stderr, "Failed to import %s\n", trace.c_str());
+			return exit_error;
+		}
+
+		print_summary(client);
+		client.close_db();
+		return exit_ok;
+	}
+
+	int frames(owlcat::mono_profiler_client& client, const options& opts)
+	{
+		owlcat::report_writer::format format;
+		uint64_t from = 0;
+		uint64_t to = 0;
+		if (!opts.get_format(format) || !open_db(client, opts) || !get_timeframe(client, opts, from, to))
+			return exit_error;
+
+		std::vector<uint64_t> alloc_counts;
+		std::vector<uint64_t> free_counts;
+		std::vector<uint64_t> size_points;
+		uint64_t max_allocs = 0;
+		uint64_t max_frees = 0;
+		int64_t max_size = 0;
+		client.get_data()->get_frame_stats(alloc_counts, free_counts, max_allocs, max_frees, size_points, max_size, from, to);
+
+		// Stats start at the first requested frame, with frames without events filled in
+		owlcat::report_writer writer(stdout, format, { "frame", "allocs", "frees", "size" });
+		for (size_t i = 0; i < alloc_counts.size(); ++i)
+			writer.write_row({ from + i, alloc_counts[i], free_counts[i], size_points[i] });
+
+		return exit_ok;
+	}
+
+	int live(owlcat::mono_profiler_client& client, const options& opts)
+	{
+		owlcat::report_writer::format format;
+		uint64_t from = 0;
+		uint64_t to = 0;
+		uint64_t top = 0;
+		uint64_t max_size = 0;
+		std::string by = "type";
+		if (!opts.get_format(format) || !opts.get_optional("top", top, 0) || !opts.get_optional("max-size", max_size, 0) ||
+			(opts.has("by") && !opts.get("by", by)))
+			return exit_error;
+
+		const bool by_type = by == "type" || by == "type-callstack";
+		const bool by_callstack = by == "callstack" || by == "type-callstack";
+		if (!by_type && !by_callstack)
+		{
+			fprintf(stderr, "Unknown grouping: %s\n", by.c_str());
+			return exit_error;
+		}
+
+		if (!open_db(client, opts) || !get_timeframe(client, opts, from, to))
+			return exit_error;
+
+		auto data = client.get_data();
+		std::vector<owlcat::live_object> objects;
+		data->get_live_objects(objects, (int)from, (int)to, [](size_t, size_t) { return true; });
+
+		struct group
+		{
+			uint64_t type_id;
+			uint64_t callstack_id;
+			double estimated_count = 0;
+			double estimated_size = 0;
+			uint64_t count = 0;
+			uint64_t size = 0;
+		};
+
+		// Same as the UI: weights of sampled objects are summed up, and only the sums are rounded
+		std::map<std::pair<uint64_t, uint64_t>, group> groups_map;
+		double estimated_total = 0;
+		for (auto& o : objects)
+		{
+			uint64_t type_id = by_type ? o.type_id : 0;
+			uint64_t callstack_id = by_callstack ? o.callstack_id : 0;
+			auto& g = groups_map.emplace(std::make_pair(type_id, callstack_id), group{ type_id, callstack_id }).first->second;
+			g.estimated_count += o.weight;
+			g.estimated_size += o.size * o.weight;
+			estimated_total += o.size * o.weight;
+		}
+
+		std::vector<group> groups;
+		groups.reserve(groups_map.size());
+		for (auto& g : groups_map)
+		{
+			g.second.count = (uint64_t)std::llround(g.second.estimated_count);
+			g.second.size = (uint64_t)std::llround(g.second.estimated_size);
+			groups.push_back(g.second);
+		}
+		std::sort(groups.begin(), groups.end(), [](const group& a, const group& b) { return a.size != b.size ? a.size > b.size : a.count > b.count; });
+		if (top != 0 && groups.size() > top)
+			groups.resize(top);
+
+		std::vector<std::string> columns;
+		if (by_type)
+			columns.push_back("type");
+		if (by_callstack)
+			columns.push_back("callstack");
+		columns.push_back("count");
+		columns.push_back("size");
+
+		{
+			owlcat::report_writer writer(stdout, format, columns);
+			std::vector<owlcat::report_writer::field> fields;
+			for (auto& g : groups)
+			{
+				fields.clear();
+				if (by_type)
+					fields.emplace_back(data->get_type_name(g.type_id));
+				if (by_callstack)
+					fields.emplace_back(data->get_callstack(g.callstack_id));
+				fields.emplace_back(g.count);
+				fields.emplace_back(g.size);
+				writer.write_row(fields);
+			}
+		}
+
+		const uint64_t total_size = (uint64_t)std::llround(estimated_total);
+		if (max_size != 0 && total_size > max_size)
+		{
+			fprintf(stderr, "Live objects take %llu bytes, limit is %llu\n", (unsigned long long)total_size, (unsigned long long)max_size);
+			return exit_limit_exceeded;
+		}
+		return exit_ok;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fputs(usage, stderr);
+		return exit_error;
+	}
+
+	const std::string command = argv[1];
+	if (command == "help" || command == "--help")
+	{
+		fputs(usage, stdout);
+		return exit_ok;
+	}
+
+	options opts;
+	if (!opts.parse(argc, argv, 2))
+	{
+		fputs(usage, stderr);
+		return exit_error;
+	}
+
+	owlcat::mono_profiler_client client;
+	if (command == "record")
+		return record(client, opts);
+	if (command == "import")
+		return import(client, opts);
+	if (command == "frames")
+		return frames(client, opts);
+	if (command == "live")
+		return live(client, opts);
+
+	fprintf(stderr, "Unknown command: %s\n\n", command.c_str());
+	fputs(usage, stderr);
+	return exit_error;
+}
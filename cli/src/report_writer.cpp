@@ -0,0 +1,104 @@
+#include "report_writer.h"
+
+#include <cassert>
+
+namespace owlcat
+{
+	report_writer::report_writer(FILE* file, format f, const std::vector<std::string>& columns)
+		: m_file(file)
+		, m_format(f)
+		, m_columns(columns)
+	{
+		if (m_format == format::json)
+		{
+			fputs("[", m_file);
+			return;
+		}
+
+		for (size_t i = 0; i < m_columns.size(); ++i)
+		{
+			if (i > 0)
+				fputc(',', m_file);
+			write_csv_text(m_columns[i]);
+		}
+		fputc('\n', m_file);
+	}
+
+	report_writer::~report_writer()
+	{
+		if (m_format == format::json)
+			fputs(m_first_row ? "]\n" : "\n]\n", m_file);
+		fflush(m_file);
+	}
+
+	void report_writer::write_row(const std::vector<field>& fields)
+	{
+		assert(fields.size() == m_columns.size());
+
+		if (m_format == format::csv)
+		{
+			for (size_t i = 0; i < fields.size(); ++i)
+			{
+				if (i > 0)
+					fputc(',', m_file);
+				if (fields[i].is_number)
+					fputs(fields[i].text.c_str(), m_file);
+				else
+					write_csv_text(fields[i].text);
+			}
+			fputc('\n', m_file);
+		}
+		else
+		{
+			fputs(m_first_row ? "\n\t{" : ",\n\t{", m_file);
+			for (size_t i = 0; i < fields.size(); ++i)
+			{
+				if (i > 0)
+					fputs(", ", m_file);
+				write_json_text(m_columns[i]);
+				fputs(": ", m_file);
+				if (fields[i].is_number)
+					fputs(fields[i].text.c_str(), m_file);
+				else
+					write_json_text(fields[i].text);
+			}
+			fputc('}', m_file);
+		}
+		m_first_row = false;
+	}
+
+	void report_writer::write_csv_text(const std::string& text)
+	{
+		// RFC 4180: quotes are doubled, and line breaks are allowed inside quoted fields
+		fputc('"', m_file);
+		for (char c : text)
+		{
+			if (c == '"')
+				fputc('"', m_file);
+			fputc(c, m_file);
+		}
+		fputc('"', m_file);
+	}
+
+	void report_writer::write_json_text(const std::string& text)
+	{
+		fputc('"', m_file);
+		for (char c : text)
+		{
+			switch (c)
+			{
+			case '"': fputs("\\\"", m_file); break;
+			case '\\': fputs("\\\\", m_file); break;
+			case '\n': fputs("\\n", m_file); break;
+			case '\r': fputs("\\r", m_file); break;
+			case '\t': fputs("\\t", m_file); break;
+			default:
+				if ((unsigned char)c < 0x20)
+					fprintf(m_file, "\\u%04x", (unsigned char)c);
+				else
+					fputc(c, m_file);
+			}
+		}
+		fputc('"', m_file);
+	}
+}
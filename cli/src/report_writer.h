@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace owlcat
+{
+	/*
+		Writes a report as a table with fixed columns, either as CSV with a header line, or as a JSON array of objects
+		with column names as keys. Text values are escaped, since type names and callstacks may contain anything.
+	*/
+	class report_writer
+	{
+	public:
+		enum class format
+		{
+			csv,
+			json
+		};
+
+		// A value of a single cell. Numbers are written as is, text is quoted
+		struct field
+		{
+			field(const std::string& text) : text(text), is_number(false) {}
+			field(const char* text) : text(text != nullptr ? text : ""), is_number(false) {}
+			field(uint64_t value) : text(std::to_string(value)), is_number(true) {}
+			field(int64_t value) : text(std::to_string(value)), is_number(true) {}
+
+			std::string text;
+			bool is_number;
+		};
+
+	private:
+		FILE* m_file;
+		format m_format;
+		std::vector<std::string> m_columns;
+		bool m_first_row = true;
+
+		void write_csv_text(const std::string& text);
+		void write_json_text(const std::string& text);
+
+	public:
+		report_writer(FILE* file, format f, const std::vector<std::string>& columns);
+		// Finishes JSON array
+		~report_writer();
+
+		// Writes a row, which must have a field for each column
+		void write_row(const std::vector<field>& fields);
+	};
+}
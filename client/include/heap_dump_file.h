@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "heap_dump_format.h"
+#include "mono_profiler_client.h"
+
+namespace owlcat
+{
+	/*
+		Read-only view of a heap dump file, written by the server on mono_profiler_client::dump_heap request.
+
+		The file is memory-mapped, so opening even a huge dump is instant, and only the pages that are actually
+		looked at are ever read from disk. All returned pointers point into the mapping and stay valid until
+		the file is closed.
+	*/
+	class heap_dump_file
+	{
+		class details;
+		details* m_details;
+
+	public:
+		heap_dump_file();
+		~heap_dump_file();
+
+		heap_dump_file(const heap_dump_file&) = delete;
+		heap_dump_file& operator=(const heap_dump_file&) = delete;
+
+		// Opens a dump file, closing the previous one. Returns false if the file can't be mapped, or is not a valid dump
+		bool open(const std::string& path);
+		void close();
+		bool is_open() const;
+
+		// Frame when the dump was made
+		uint64_t get_frame() const;
+
+		uint64_t get_objects_count() const;
+		// Objects are sorted by address
+		const heap_dump::object& get_object(uint64_t index) const;
+		// Returns the object at the specified address, or nullptr if there is none
+		const heap_dump::object* find_object(uint64_t addr) const;
+		// Returns addresses of objects that reference the specified one. There are object.parents_count of them.
+		// Returns nullptr if the object's range of parents doesn't fit into the file
+		const uint64_t* get_parents(const heap_dump::object& object) const;
+
+		uint64_t get_roots_count() const;
+		const heap_dump::root& get_root(uint64_t index) const;
+
+		uint64_t get_types_count() const;
+		// Returns full name of the type, or an empty string for heap_dump::unknown_type
+		const char* get_type_name(uint32_t type_index) const;
+
+		/*
+			Computes retained sizes of all types and of max_objects objects that retain the most, from dominator tree of
+			the dumped graph. Same as mono_profiler_client::get_retained_sizes, but doesn't need the profiled app to run.
+			Type indices of the result are not the same as type indices of the file.
+		*/
+		retained_sizes_t compute_retained_sizes(uint32_t max_objects) const;
+	};
+}
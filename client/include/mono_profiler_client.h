@@ -27,16 +27,104 @@ namespace owlcat
 		std::vector<parent_info> parents;
 	};
 
+	/*
+		A page of objects grouped by type, see mono_profiler_client::find_references_page
+	*/
+	struct references_page_t
+	{
+		struct group
+		{
+			// Type name, with " (Root)" or " (Deleted)" marks
+			std::string type;
+			// Number of objects of this group in all pages
+			uint64_t count = 0;
+			// Total number of parents of objects in this page. If it's 0, requesting their parents is pointless
+			uint64_t parents_count = 0;
+			// Objects of this group in the page, sorted
+			std::vector<uint64_t> addresses;
+		};
+
+		// Frame of the snapshot the answer comes from. Objects allocated and references made after it are not there
+		uint64_t frame = 0;
+		// Number of objects in all pages
+		uint64_t total_count = 0;
+		// Cursor of the next page, 0 if this page is the last one
+		uint64_t next_cursor = 0;
+		// Requested cursor belongs to a list that is no longer kept, and the page is empty. Pages must be requested again from cursor 0
+		bool restart = false;
+		// Sorted by type name. Only the first and the last group may continue in other pages
+		std::vector<group> groups;
+	};
+
+	/*
+		A chain of references that keeps an object alive, from an object referenced by a GC root to the object itself
+	*/
+	struct root_path_t
+	{
+		struct hop
+		{
+			uint64_t address;
+			std::string type;
+		};
+
+		// Kind of the root, e.g. "static" or "GC handle", or "unknown" if the server couldn't find the root slot
+		std::string root_source;
+		// Address of the root memory that references the first hop, 0 if not known
+		uint64_t root_slot = 0;
+		// The first hop is referenced by the root, the last one is the requested object
+		std::vector<hop> hops;
+	};
+
+	/*
+		Retained sizes of objects and types: how much memory would be freed if an object, or all objects of a type, were freed
+	*/
+	struct retained_sizes_t
+	{
+		struct type_info
+		{
+			// Full type name
+			std::string name;
+			uint64_t count = 0;
+			// Total size of objects of this type
+			uint64_t size = 0;
+			// Total retained size of objects of this type, without objects dominated by objects of the same type
+			uint64_t retained = 0;
+		};
+
+		struct object_info
+		{
+			uint64_t address;
+			// Index in types, or unknown_type
+			uint32_t type_index;
+			uint64_t size;
+			uint64_t retained;
+		};
+
+		static constexpr uint32_t unknown_type = 0xFFFFFFFF;
+
+		// Frame of the snapshot the answer comes from. Objects allocated and references made after it are not there
+		uint64_t frame = 0;
+		// Sorted by retained size, largest first
+		std::vector<type_info> types;
+		// Objects with the largest retained sizes, largest first
+		std::vector<object_info> objects;
+	};
+
 	struct search_result_t
 	{
 		uint64_t type_id;
 		std::vector<uint64_t> callstacks;
 	};
 
-	// Callbacks for commands
-	using find_references_callback = std::function<void(const std::vector<uint64_t> addresses, std::string error, const std::vector<object_references_t>& result)>;
+	// Callbacks for commands. Answers to reference queries come from a snapshot of the heap, and frame is the frame it was made at
+	using find_references_callback = std::function<void(const std::vector<uint64_t> addresses, std::string error, const std::vector<object_references_t>& result, uint64_t frame)>;
 	using pause_app_callback = std::function<void(bool ok)>;
 	using resume_app_callback = std::function<void(bool ok)>;
+	using references_page_callback = std::function<void(const references_page_t& page)>;
+	using root_paths_callback = std::function<void(protocol::root_paths_status status, const std::vector<root_path_t>& paths, uint64_t frame)>;
+	using retained_sizes_callback = std::function<void(const retained_sizes_t& result)>;
+	// On success, message is a path of the dump file on the profiled machine, otherwise it's an error message
+	using dump_heap_callback = std::function<void(bool ok, const std::string& message)>;
 
 	class mono_profiler_client_data;
 	/*
@@ -81,6 +169,9 @@ namespace owlcat
 		bool save_db(const std::string& new_db_file_name, bool move);
 		// Opens previously saved profiling data
 		bool open_data(const std::string& file);
+		// Converts a trace recorded by server without a client (see mono_profiler_options::trace_path) into a new database,
+		// as if it was received over network, and leaves the database open. Blocks until the whole trace is processed
+		bool import_trace(const std::string& trace_file_name, const std::string& db_file_name);
 
 		// Returns true if the client is connected to a server
 		bool is_connected() const;
@@ -101,6 +192,21 @@ namespace owlcat
 		void pause_app(pause_app_callback callback);
 		// Sends a command to server to unpause the app
 		void resume_app(resume_app_callback callback);
+		// Sends a command to server to group the objects (or, if parents is true, objects that reference them) by type. Only
+		// page_size objects starting at cursor are returned, pass next_cursor of the page to get the next one. If the page has
+		// restart flag, server no longer has the list the cursor pointed into, and it must be requested again from cursor 0
+		void find_references_page(const std::vector<uint64_t>& addresses, bool parents, uint64_t cursor, uint32_t page_size, references_page_callback callback);
+		// Sends a command to server to find up to max_paths shortest chains of references from GC roots to the object. Search stops
+		// after visiting max_nodes objects or after timeout, whichever comes first, and reports the paths found so far
+		void find_root_paths(uint64_t address, root_paths_callback callback, uint32_t max_paths = 5, uint32_t max_nodes = 1000000, uint32_t timeout_ms = 1000);
+		// Sends a command to server to compute retained sizes of all types, and of max_objects objects that retain the most
+		void get_retained_sizes(uint32_t max_objects, retained_sizes_callback callback);
+		// Sends a command to server to write the whole heap to a file on the profiled machine (see heap_dump_file)
+		void dump_heap(const std::string& path, dump_heap_callback callback);
+		// Sends a command to server to only profile classes that pass the rules (see protocol::filter_rule). Empty list profiles everything
+		void set_type_filter(const std::vector<protocol::filter_rule>& rules);
+		// Sends a command to server to stop reporting allocations from callstacks with methods whose names contain any of the words
+		void set_stopwords(const std::vector<std::string>& stopwords);
 
 		// Returns a name for thr specified type from an in-memory cache
 		const char* get_type_name(uint64_t type_id) const;
@@ -111,12 +217,13 @@ namespace owlcat
 	*/
 	struct live_object
 	{
-		live_object(uint64_t addr, uint64_t size, uint64_t frame, uint64_t type_id, uint64_t callstack_id)
+		live_object(uint64_t addr, uint64_t size, uint64_t frame, uint64_t type_id, uint64_t callstack_id, double weight = 1.0)
 			: addr(addr)
 			, size(size)
 			, frame(frame)
 			, type_id(type_id)
 			, callstack_id(callstack_id)
+			, weight(weight)
 		{
 		}
 
@@ -130,6 +237,9 @@ namespace owlcat
 		uint64_t type_id;
 		// The ID of callstack where the object was allocated
 		uint64_t callstack_id;
+		// Estimated number of objects this one stands for. It's 1, unless the server only reported a sample of allocations:
+		// then counts and sizes of objects should be multiplied by it to get unbiased totals
+		double weight;
 	};
 
 	// Universal progress callback typr
@@ -69,6 +69,18 @@ namespace owlcat
                 },
             }
         },
+        //----------------------------------------------------------------
+        {
+            "Create sampling intervals table",
+            {
+                {
+                    "CREATE TABLE SamplingIntervals("
+                    "frame INTEGER PRIMARY KEY NOT NULL,"
+                    "interval INT NOT NULL"
+                    ")"
+                },
+            }
+        },
         ////----------------------------------------------------------------
         //// This speeds up Go To Callstack significantly, but slows down
         //// insertation too much. Investigate a better way
@@ -20,6 +20,8 @@ namespace owlcat
         query_id_t id_select_callstacks = "select_callstacks";
         query_id_t id_select_last_good_size = "select_last_good_size";
         query_id_t id_select_allocation_type_and_stack = "select_allocation_type_and_stack";
+        query_id_t id_insert_sampling_interval = "insert_sampling_interval";
+        query_id_t id_select_sampling_intervals = "select_sampling_intervals";
 
         bool insert_alloc_event(db_t& db, uint64_t frame, uint64_t addr, uint64_t size, uint64_t type_id, uint64_t callstack_id)
         {
@@ -72,6 +74,15 @@ namespace owlcat
                 });
         }
 
+        bool insert_sampling_interval(db_t& db, uint64_t frame, uint64_t interval)
+        {
+            return db.query(queries::id_insert_sampling_interval,
+                {
+                    {"frame", frame},
+                    {"interval", interval},
+                });
+        }
+
         cursor_t select_min_max_frame(db_t& db)
         {
             return db.query_data(queries::id_select_min_max_frame, {});
@@ -121,6 +132,11 @@ namespace owlcat
             return db.query_data(queries::id_select_allocation_type_and_stack, { {"address", address} });
         }
 
+        cursor_t select_sampling_intervals(db_t& db)
+        {
+            return db.query_data(queries::id_select_sampling_intervals, {});
+        }
+
         bool register_queries(persistent_storage::persistent_storage& db)
         {
             if (!db.is_open())
@@ -173,6 +189,13 @@ namespace owlcat
                 "INSERT OR REPLACE INTO FrameStats (frame, allocs, frees, size)"
                 "VALUES ($frame, $allocs, $frees, $size)"
             );            
+            register_query(queries::id_insert_sampling_interval,
+                "INSERT OR REPLACE INTO SamplingIntervals (frame, interval)"
+                "VALUES ($frame, $interval)"
+            );
+            register_query(queries::id_select_sampling_intervals,
+                "SELECT frame, interval FROM SamplingIntervals ORDER BY frame"
+            );
             register_query(queries::id_select_min_max_frame,
                 "SELECT MIN(frame) as min_frame, MAX(frame) AS max_frame FROM ProfilerEvents"
             );
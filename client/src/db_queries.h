@@ -23,6 +23,7 @@ namespace owlcat
         bool insert_type(db_t& db, const std::string& type, uint64_t id);
         bool insert_callstack(db_t& db, const std::string& callstack, uint64_t id);
         bool insert_frame_stats(db_t& db, uint64_t frame, uint64_t allocs, uint64_t frees, int64_t size);
+        bool insert_sampling_interval(db_t& db, uint64_t frame, uint64_t interval);
 
         cursor_t select_min_max_frame(db_t& db);
         cursor_t select_events(db_t& db, uint64_t from_frame, uint64_t to_frame);
@@ -33,6 +34,7 @@ namespace owlcat
         cursor_t select_callstacks(db_t& db);
         cursor_t select_last_good_size(db_t& db, uint64_t from_frame);
         cursor_t select_allocation_type_and_stack(db_t& db, uint64_t address);
+        cursor_t select_sampling_intervals(db_t& db);
 
         bool register_queries(persistent_storage::persistent_storage& db);
     }
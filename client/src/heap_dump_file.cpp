@@ -0,0 +1,337 @@
+#include "heap_dump_file.h"
+#include "dominator_tree.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace owlcat
+{
+	class heap_dump_file::details
+	{
+	public:
+#ifdef WIN32
+		HANDLE m_file = INVALID_HANDLE_VALUE;
+		HANDLE m_mapping = nullptr;
+#endif
+		const uint8_t* m_data = nullptr;
+		uint64_t m_size = 0;
+
+		const heap_dump::header* m_header = nullptr;
+		const heap_dump::object* m_objects = nullptr;
+		const uint64_t* m_parents = nullptr;
+		const heap_dump::root* m_roots = nullptr;
+		const heap_dump::type* m_types = nullptr;
+		const char* m_strings = nullptr;
+
+		~details()
+		{
+			unmap();
+		}
+
+		bool map(const std::string& path)
+		{
+#ifdef WIN32
+			m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (m_file == INVALID_HANDLE_VALUE)
+				return false;
+
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+				return false;
+			m_size = (uint64_t)size.QuadPart;
+
+			m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (m_mapping == nullptr)
+				return false;
+
+			m_data = (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+			return m_data != nullptr;
+#else
+			int fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+				return false;
+
+			struct stat st;
+			if (fstat(fd, &st) != 0 || st.st_size == 0)
+			{
+				::close(fd);
+				return false;
+			}
+			m_size = (uint64_t)st.st_size;
+
+			// The mapping keeps the file alive, descriptor is no longer needed
+			void* data = mmap(nullptr, (size_t)m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			::close(fd);
+			if (data == MAP_FAILED)
+				return false;
+
+			m_data = (const uint8_t*)data;
+			return true;
+#endif
+		}
+
+		void unmap()
+		{
+#ifdef WIN32
+			if (m_data != nullptr)
+				UnmapViewOfFile(m_data);
+			if (m_mapping != nullptr)
+				CloseHandle(m_mapping);
+			if (m_file != INVALID_HANDLE_VALUE)
+				CloseHandle(m_file);
+			m_mapping = nullptr;
+			m_file = INVALID_HANDLE_VALUE;
+#else
+			if (m_data != nullptr)
+				munmap((void*)m_data, (size_t)m_size);
+#endif
+			m_data = nullptr;
+			m_size = 0;
+			m_header = nullptr;
+			m_objects = nullptr;
+			m_parents = nullptr;
+			m_roots = nullptr;
+			m_types = nullptr;
+			m_strings = nullptr;
+		}
+
+		// Checks that section fits into the file, without overflowing on broken counts
+		bool check_section(const heap_dump::section& section, uint64_t record_size) const
+		{
+			if (section.offset > m_size || section.offset % 8 != 0)
+				return false;
+
+			return section.count <= (m_size - section.offset) / record_size;
+		}
+
+		bool validate()
+		{
+			if (m_size < sizeof(heap_dump::header))
+				return false;
+
+			m_header = (const heap_dump::header*)m_data;
+			if (memcmp(m_header->magic, heap_dump::magic, sizeof(heap_dump::magic)) != 0 || m_header->version != heap_dump::version)
+				return false;
+			if (m_header->header_size < sizeof(heap_dump::header) || m_header->header_size > m_size)
+				return false;
+
+			if (!check_section(m_header->objects, sizeof(heap_dump::object)) ||
+				!check_section(m_header->parents, sizeof(uint64_t)) ||
+				!check_section(m_header->roots, sizeof(heap_dump::root)) ||
+				!check_section(m_header->types, sizeof(heap_dump::type)))
+				return false;
+
+			// Strings are not aligned, and the last one must be terminated, or reading it could run past the end of the file
+			auto& strings = m_header->strings;
+			if (strings.offset > m_size || strings.count > m_size - strings.offset)
+				return false;
+			if (strings.count != 0 && m_data[strings.offset + strings.count - 1] != 0)
+				return false;
+
+			m_objects = (const heap_dump::object*)(m_data + m_header->objects.offset);
+			m_parents = (const uint64_t*)(m_data + m_header->parents.offset);
+			m_roots = (const heap_dump::root*)(m_data + m_header->roots.offset);
+			m_types = (const heap_dump::type*)(m_data + m_header->types.offset);
+			m_strings = (const char*)(m_data + strings.offset);
+			return true;
+		}
+	};
+
+	heap_dump_file::heap_dump_file()
+		: m_details(new details())
+	{
+	}
+
+	heap_dump_file::~heap_dump_file()
+	{
+		delete m_details;
+	}
+
+	bool heap_dump_file::open(const std::string& path)
+	{
+		close();
+
+		if (!m_details->map(path) || !m_details->validate())
+		{
+			close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void heap_dump_file::close()
+	{
+		m_details->unmap();
+	}
+
+	bool heap_dump_file::is_open() const
+	{
+		return m_details->m_header != nullptr;
+	}
+
+	uint64_t heap_dump_file::get_frame() const
+	{
+		return m_details->m_header->frame;
+	}
+
+	uint64_t heap_dump_file::get_objects_count() const
+	{
+		return m_details->m_header->objects.count;
+	}
+
+	const heap_dump::object& heap_dump_file::get_object(uint64_t index) const
+	{
+		return m_details->m_objects[index];
+	}
+
+	const heap_dump::object* heap_dump_file::find_object(uint64_t addr) const
+	{
+		auto begin = m_details->m_objects;
+		auto end = begin + m_details->m_header->objects.count;
+		auto iter = std::lower_bound(begin, end, addr, [](const heap_dump::object& obj, uint64_t addr) { return obj.addr < addr; });
+		if (iter == end || iter->addr != addr)
+			return nullptr;
+
+		return iter;
+	}
+
+	const uint64_t* heap_dump_file::get_parents(const heap_dump::object& object) const
+	{
+		// Ranges of parents are not validated on open, as that would read the whole objects section
+		auto count = m_details->m_header->parents.count;
+		if (object.first_parent > count || object.parents_count > count - object.first_parent)
+			return nullptr;
+
+		return m_details->m_parents + object.first_parent;
+	}
+
+	uint64_t heap_dump_file::get_roots_count() const
+	{
+		return m_details->m_header->roots.count;
+	}
+
+	const heap_dump::root& heap_dump_file::get_root(uint64_t index) const
+	{
+		return m_details->m_roots[index];
+	}
+
+	uint64_t heap_dump_file::get_types_count() const
+	{
+		return m_details->m_header->types.count;
+	}
+
+	const char* heap_dump_file::get_type_name(uint32_t type_index) const
+	{
+		if (type_index >= m_details->m_header->types.count)
+			return "";
+
+		auto name_offset = m_details->m_types[type_index].name_offset;
+		if (name_offset >= m_details->m_header->strings.count)
+			return "";
+
+		return m_details->m_strings + name_offset;
+	}
+
+	retained_sizes_t heap_dump_file::compute_retained_sizes(uint32_t max_objects) const
+	{
+		retained_sizes_t result;
+		if (!is_open())
+			return result;
+
+		// Graph nodes are indices of objects, which are already sorted by address
+		const uint32_t count = (uint32_t)get_objects_count();
+		std::vector<uint64_t> sizes(count);
+		std::vector<uint32_t> parents_offsets(count + 1, 0);
+		std::vector<uint32_t> parents;
+		parents.reserve((size_t)m_details->m_header->parents.count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			auto& object = get_object(i);
+			sizes[i] = object.size;
+
+			if (auto object_parents = get_parents(object))
+			{
+				for (uint32_t p = 0; p < object.parents_count; ++p)
+				{
+					if (auto parent = find_object(object_parents[p]))
+						parents.push_back((uint32_t)(parent - m_details->m_objects));
+				}
+			}
+			parents_offsets[i + 1] = (uint32_t)parents.size();
+		}
+
+		dominator_tree tree;
+		tree.build(count, parents_offsets.data(), parents.data(), [&](uint32_t node) { return (get_object(node).flags & heap_dump::OBJECT_ROOT) != 0; });
+		auto retained = tree.get_retained_sizes(sizes);
+
+		// Types of the file are indexed as is, and types without objects are dropped when sorting
+		const uint32_t types_count = (uint32_t)get_types_count();
+		std::vector<uint32_t> types(count);
+		result.types.resize(types_count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t type_index = get_object(i).type_index;
+			types[i] = type_index < types_count ? type_index : dominator_tree::none;
+			if (types[i] == dominator_tree::none)
+				continue;
+
+			auto& type = result.types[type_index];
+			++type.count;
+			type.size += sizes[i];
+		}
+
+		auto types_retained = tree.get_group_retained_sizes(retained, types, types_count);
+		for (uint32_t i = 0; i < types_count; ++i)
+		{
+			result.types[i].name = get_type_name(i);
+			result.types[i].retained = types_retained[i];
+		}
+
+		std::vector<uint32_t> order(count);
+		for (uint32_t i = 0; i < count; ++i)
+			order[i] = i;
+		size_t objects_count = std::min<size_t>(max_objects, count);
+		std::partial_sort(order.begin(), order.begin() + objects_count, order.end(), [&](uint32_t a, uint32_t b) { return retained[a] > retained[b]; });
+		for (size_t i = 0; i < objects_count; ++i)
+		{
+			uint32_t node = order[i];
+			result.objects.push_back({ get_object(node).addr, types[node], sizes[node], retained[node] });
+		}
+
+		// Same order as the server reports
+		std::vector<uint32_t> types_order;
+		for (uint32_t i = 0; i < types_count; ++i)
+		{
+			if (result.types[i].count != 0)
+				types_order.push_back(i);
+		}
+		std::sort(types_order.begin(), types_order.end(), [&](uint32_t a, uint32_t b) { return result.types[a].retained > result.types[b].retained; });
+
+		std::vector<uint32_t> new_index(types_count, retained_sizes_t::unknown_type);
+		std::vector<retained_sizes_t::type_info> sorted_types;
+		sorted_types.reserve(types_order.size());
+		for (uint32_t type_index : types_order)
+		{
+			new_index[type_index] = (uint32_t)sorted_types.size();
+			sorted_types.push_back(std::move(result.types[type_index]));
+		}
+		result.types.swap(sorted_types);
+		for (auto& object : result.objects)
+		{
+			if (object.type_index != retained_sizes_t::unknown_type)
+				object.type_index = new_index[object.type_index];
+		}
+
+		return result;
+	}
+}
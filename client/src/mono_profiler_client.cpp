@@ -5,7 +5,12 @@
 #include "persistent_storage.h"
 #include "db_migrations.h"
 #include "db_queries.h"
+#include "trace_format.h"
+#include "lz4_block.h"
 
+#include <atomic>
+#include <cstdio>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <thread>
@@ -13,6 +18,7 @@
 #include <cassert>
 #include <unordered_map>
 #include <unordered_set>
+#include <map>
 #include <filesystem>
 
 #if defined(WIN32)
@@ -35,8 +41,9 @@ namespace owlcat
 		uint64_t frame;
 		uint64_t addr;
 		uint32_t size;
-		std::string obj_type;
-		std::string callstack;
+		// Client-side IDs of object type and callstack (only for allocations)
+		uint64_t type_id;
+		uint64_t callstack_id;
 	};
 
 	struct base_command
@@ -84,6 +91,46 @@ namespace owlcat
 		resume_app_callback callback;
 	};
 
+	struct command_dump_heap : public base_command
+	{
+		command_dump_heap(uint64_t request_id, dump_heap_callback _callback)
+			: base_command(protocol::command::CMD_DUMP_HEAP, request_id)
+			, callback(_callback)
+		{}
+
+		dump_heap_callback callback;
+	};
+
+	struct command_references_page : public base_command
+	{
+		command_references_page(uint64_t request_id, references_page_callback _callback)
+			: base_command(protocol::command::CMD_REFERENCES_PAGE, request_id)
+			, callback(_callback)
+		{}
+
+		references_page_callback callback;
+	};
+
+	struct command_root_paths : public base_command
+	{
+		command_root_paths(uint64_t request_id, root_paths_callback _callback)
+			: base_command(protocol::command::CMD_ROOT_PATHS, request_id)
+			, callback(_callback)
+		{}
+
+		root_paths_callback callback;
+	};
+
+	struct command_retained_sizes : public base_command
+	{
+		command_retained_sizes(uint64_t request_id, retained_sizes_callback _callback)
+			: base_command(protocol::command::CMD_RETAINED_SIZES, request_id)
+			, callback(_callback)
+		{}
+
+		retained_sizes_callback callback;
+	};
+
 	class mono_profiler_client::details
 	{
 		network m_network;
@@ -123,7 +170,7 @@ namespace owlcat
 			return cmd->request_id;
 		}
 
-		bool m_stop = false;
+		std::atomic<bool> m_stop{ false };
 		std::thread m_thread;
 		persistent_storage::persistent_storage m_db;
 
@@ -154,6 +201,25 @@ namespace owlcat
 		uint64_t m_next_type_id = 0;
 		uint64_t m_next_callstack_id = 0;
 
+		// Maps between IDs of interned types and callstacks assigned by server, and our IDs.
+		// Server's IDs are only valid for the current connection.
+		std::unordered_map<uint64_t, uint64_t> m_server_type_ids;
+		std::unordered_map<uint64_t, uint64_t> m_server_callstack_ids;
+		// Names of methods used in callstacks, by server's method ID
+		std::unordered_map<uint64_t, std::string> m_server_method_names;
+
+		// Sampling interval of allocations by the first frame it applies to (see protocol::SRV_SAMPLING)
+		std::map<uint64_t, uint64_t> m_sampling_intervals;
+
+		uint64_t get_sampling_interval(uint64_t frame) const
+		{
+			auto iter = m_sampling_intervals.upper_bound(frame);
+			if (iter == m_sampling_intervals.begin())
+				return 0;
+
+			return std::prev(iter)->second;
+		}
+
 		std::string m_db_file_name;
 
 		// Inserts a new type ID into database, or returns one already present from memory cache
@@ -205,11 +271,7 @@ namespace owlcat
 			for (auto& e : m_frame_events)
 			{
 				if (e.type == profiler_event::alloc)
-				{
-					uint64_t type_id = get_or_create_type_id(e.obj_type);
-					uint64_t callstack_id = get_or_create_callstack_id(e.callstack);
-					queries::insert_alloc_event(m_db, e.frame, e.addr, e.size, type_id, callstack_id);
-				}
+					queries::insert_alloc_event(m_db, e.frame, e.addr, e.size, e.type_id, e.callstack_id);
 				else
 					queries::insert_free_event(m_db, e.frame, e.addr, e.size);
 			}
@@ -239,6 +301,17 @@ namespace owlcat
 			}
 		}
 
+		// Maps server's type or callstack ID to our ID. Unknown IDs should never happen, but we don't want to lose the event
+		uint64_t map_server_id(const std::unordered_map<uint64_t, uint64_t>& map, uint64_t server_id, bool is_type)
+		{
+			auto iter = map.find(server_id);
+			if (iter != map.end())
+				return iter->second;
+
+			printf("Received unknown %s ID %llu\n", is_type ? "type" : "callstack", (unsigned long long)server_id);
+			return is_type ? get_or_create_type_id("<unknown>") : get_or_create_callstack_id("<unknown>");
+		}
+
 		// Loads object types and callstacks from opened database into memory caches
 		bool load_types_and_callstacks()
 		{
@@ -268,6 +341,14 @@ namespace owlcat
 				m_id_to_callstacks_map.insert(std::make_pair(callstack_id, callstack));
 			}
 
+			m_sampling_intervals.clear();
+			auto sampling_cursor = queries::select_sampling_intervals(m_db);
+			if (sampling_cursor.has_error())
+				return false;
+
+			while (sampling_cursor.next())
+				m_sampling_intervals[sampling_cursor.get_uint64("frame")] = sampling_cursor.get_uint64("interval");
+
 			auto frames_cursor = queries::select_min_max_frame(m_db);
 			if (!frames_cursor.next())
 				return false;
@@ -278,177 +359,501 @@ namespace owlcat
 			return true;
 		}
 
-	public:
-		void process_messages()
+		// Handles a single message from server, or from an imported trace
+		void process_message(const message& msg)
 		{
-			m_frame_events.reserve(1024);
-			while (true)
+			memory_reader reader(msg.data);
+
+			if (msg.header.type == protocol::message::SRV_ALLOC)
 			{
-				message msg;
-				if (!m_network.read_message(msg))
-				{
-					if (m_stop)
-						break;
+				uint64_t frame;
+				uint64_t addr;
+				uint32_t size;
+				std::string name;
+				std::string callstack;
+				bool all_ok =
+					reader.read_uint64(frame) &&
+					reader.read_uint64(addr) &&
+					reader.read_uint32(size) &&
+					reader.read_string(name) &&
+					reader.read_string(callstack);
 
-					std::this_thread::yield();
-					continue;
-				}
-				
-				memory_reader reader(msg.data);
+#ifdef WIN32
+				// Frames should always be sequential
+				if (frame < m_prev_frame && m_prev_frame != 0xFFFFFFFFFFFFFFFF)
+					__debugbreak();
+#endif
 
-				if (msg.header.type == protocol::message::SRV_ALLOC)
+				if (all_ok)
 				{
-					uint64_t frame;
-					uint64_t addr;
-					uint32_t size;
+					try_save_events(frame);
+					m_frame_events.push_back({profiler_event::alloc, frame, addr, size, get_or_create_type_id(name), get_or_create_callstack_id(callstack)});
+					++m_frame_allocs;
+					m_size_running_total += size;
+				}
+				else
+					printf("Received alloc, but msg is broken\n");
+			}
+			else if (msg.header.type == protocol::message::SRV_METHOD_DEF || msg.header.type == protocol::message::SRV_TYPE_DEF)
+			{
+				uint64_t count;
+				bool all_ok = reader.read_varint(count);
+				for (uint64_t i = 0; i < count && all_ok; ++i)
+				{
+					uint64_t server_id;
 					std::string name;
-					std::string callstack;
-					bool all_ok =
-						reader.read_uint64(frame) &&
-						reader.read_uint64(addr) &&
-						reader.read_uint32(size) &&
-						reader.read_string(name) &&
-						reader.read_string(callstack);
+					all_ok =
+						reader.read_varint(server_id) &&
+						reader.read_string(name);
 
-#ifdef WIN32
-					// Frames should always be sequential
-					if (frame < m_prev_frame && m_prev_frame != 0xFFFFFFFFFFFFFFFF)
-						__debugbreak();
-#endif
+					if (!all_ok)
+						break;
 
-					if (all_ok)
-					{
-						try_save_events(frame);
-						m_frame_events.push_back({profiler_event::alloc, frame, addr, size, name, callstack});
-						++m_frame_allocs;
-						m_size_running_total += size;
-					}
+					if (msg.header.type == protocol::message::SRV_METHOD_DEF)
+						m_server_method_names[server_id] = name;
 					else
-						printf("Received alloc, but msg is broken\n");
+						m_server_type_ids[server_id] = get_or_create_type_id(name);
 				}
-				else if (msg.header.type == protocol::message::SRV_FREE)
+
+				if (!all_ok)
+					printf("Received definitions, but msg is broken\n");
+			}
+			else if (msg.header.type == protocol::message::SRV_STACK_DEF)
+			{
+				uint64_t count;
+				bool all_ok = reader.read_varint(count);
+				for (uint64_t i = 0; i < count && all_ok; ++i)
 				{
-					uint64_t frame;
-					uint64_t addr;
-					uint32_t size;
-					bool all_ok =
-						reader.read_uint64(frame);
-						reader.read_uint64(addr);
-						reader.read_uint32(size);
+					uint64_t server_id;
+					uint64_t frames_count;
+					all_ok =
+						reader.read_varint(server_id) &&
+						reader.read_varint(frames_count);
 
-					if (all_ok)
+					// Callstacks are stored as text, one method per line
+					std::string callstack;
+					for (uint64_t j = 0; j < frames_count && all_ok; ++j)
 					{
-						try_save_events(frame);
-						m_frame_events.push_back({ profiler_event::free, frame, addr, size, "", "" });		
-						++m_frame_frees;
-						m_size_running_total -= size;
+						uint64_t method_id;
+						all_ok = reader.read_varint(method_id);
+						auto iter = m_server_method_names.find(method_id);
+						callstack.append(iter != m_server_method_names.end() ? iter->second : "<unknown>");
+						callstack.append("\n");
 					}
-					else
-						printf("Received free, but msg is broken\n");
+
+					if (!all_ok)
+						break;
+
+					// This mostly means objects allocated directly from native Unity code, like scene objects
+					if (frames_count == 0)
+						callstack = "<no stack>";
+
+					m_server_callstack_ids[server_id] = get_or_create_callstack_id(callstack);
+				}
+
+				if (!all_ok)
+					printf("Received callstack definitions, but msg is broken\n");
+			}
+			else if (msg.header.type == protocol::message::SRV_ALLOC_BATCH)
+			{
+				uint64_t frame;
+				uint64_t count;
+				bool all_ok =
+					reader.read_uint64(frame) &&
+					reader.read_varint(count);
+
+				if (!all_ok)
+				{
+					printf("Received alloc batch, but msg is broken\n");
+					return;
 				}
-				else if (msg.header.type == protocol::message::SRV_REFERENCES)
+
+				try_save_events(frame);
+				for (uint64_t i = 0; i < count; ++i)
 				{
-					uint64_t request_id;
-					if (!reader.read_uint64(request_id))
+					protocol::alloc_record record;
+					if (!reader.read(record))
 					{
-						printf("Received references, but msg is broken\n");
-						continue;
+						printf("Received alloc batch, but msg is broken\n");
+						break;
 					}
 
-					auto cmd = get_command<command_find_references>(request_id, protocol::command::CMD_REFERENCES);
-					if (cmd == nullptr)
-						continue;
+					m_frame_events.push_back({ profiler_event::alloc, frame, record.addr, record.size,
+						map_server_id(m_server_type_ids, record.type_id, true),
+						map_server_id(m_server_callstack_ids, record.callstack_id, false) });
+					++m_frame_allocs;
+					m_size_running_total += record.size;
+				}
+			}
+			else if (msg.header.type == protocol::message::SRV_FREE)
+			{
+				uint64_t frame;
+				uint64_t addr;
+				uint32_t size;
+				bool all_ok =
+					reader.read_uint64(frame);
+					reader.read_uint64(addr);
+					reader.read_uint32(size);
+
+				if (all_ok)
+				{
+					try_save_events(frame);
+					m_frame_events.push_back({ profiler_event::free, frame, addr, size, 0, 0 });		
+					++m_frame_frees;
+					m_size_running_total -= size;
+				}
+				else
+					printf("Received free, but msg is broken\n");
+			}
+			else if (msg.header.type == protocol::message::SRV_FREE_BATCH)
+			{
+				uint64_t frame;
+				uint64_t count;
+				bool all_ok =
+					reader.read_uint64(frame) &&
+					reader.read_varint(count);
+
+				if (!all_ok)
+				{
+					printf("Received free batch, but msg is broken\n");
+					return;
+				}
 
-					uint64_t count;
-					if (!reader.read_varint(count))
+				try_save_events(frame);
+				uint64_t addr = 0;
+				for (uint64_t i = 0; i < count; ++i)
+				{
+					uint64_t delta;
+					uint64_t size;
+					if (!reader.read_varint(delta) || !reader.read_varint(size))
 					{
-						printf("Received references, but msg is broken\n");
-						continue;
+						printf("Received free batch, but msg is broken\n");
+						break;
 					}
 
-					std::vector<object_references_t> result;
+					addr += delta;
+					m_frame_events.push_back({ profiler_event::free, frame, addr, (uint32_t)size, 0, 0 });
+					++m_frame_frees;
+					m_size_running_total -= size;
+				}
+			}
+			else if (msg.header.type == protocol::message::SRV_SAMPLING)
+			{
+				uint64_t interval;
+				if (!reader.read_varint(interval))
+				{
+					printf("Received sampling settings, but msg is broken\n");
+					return;
+				}
 
-					for (uint64_t i = 0; i < count; ++i)
-					{
-						uint64_t addr;
-						uint64_t parents_count;
-						std::string type;
-
-						reader.read_varint(addr);
-						reader.read_string(type);
-						reader.read_varint(parents_count);						
-
-						object_references_t obj;
-						obj.address = addr;
-						obj.type = type;
-
-						for (uint64_t j = 0; j < parents_count; ++j)
-						{
-							uint64_t parent_addr;
-							reader.read_varint(parent_addr);
-							obj.parents.push_back({parent_addr});
-						}
-
-						result.push_back(obj);
-					}
+				// Settings apply to allocations of the session, which can't be earlier than the last received frame
+				uint64_t frame = m_prev_frame == 0xFFFFFFFFFFFFFFFF ? 0 : m_prev_frame;
+				m_sampling_intervals[frame] = interval;
+				queries::insert_sampling_interval(m_db, frame, interval);
+			}
+			else if (msg.header.type == protocol::message::SRV_UNSAMPLED_TOTALS)
+			{
+				uint64_t frame;
+				uint64_t allocs;
+				uint64_t alloc_bytes;
+				uint64_t frees;
+				uint64_t freed_bytes;
+				bool all_ok =
+					reader.read_uint64(frame) &&
+					reader.read_varint(allocs) &&
+					reader.read_varint(alloc_bytes) &&
+					reader.read_varint(frees) &&
+					reader.read_varint(freed_bytes);
+
+				if (!all_ok)
+				{
+					printf("Received unsampled totals, but msg is broken\n");
+					return;
+				}
 
-					cmd->callback(cmd->addresses, "", result);
+				// Unsampled objects have no events, but they're still a part of frame stats
+				try_save_events(frame);
+				m_frame_allocs += allocs;
+				m_frame_frees += frees;
+				m_size_running_total += (int64_t)alloc_bytes - (int64_t)freed_bytes;
+			}
+			else if (msg.header.type == protocol::message::SRV_REFERENCES)
+			{
+				uint64_t request_id;
+				if (!reader.read_uint64(request_id))
+				{
+					printf("Received references, but msg is broken\n");
+					return;
 				}
-				else if (msg.header.type == protocol::message::SRV_PAUSE)
+
+				auto cmd = get_command<command_find_references>(request_id, protocol::command::CMD_REFERENCES);
+				if (cmd == nullptr)
+					return;
+
+				uint64_t frame, count;
+				if (!reader.read_varint(frame) || !reader.read_varint(count))
 				{
-					uint64_t request_id;
-					if (!reader.read_uint64(request_id))
-					{
-						printf("Received pause, but msg is broken\n");
-						continue;
-					}
+					printf("Received references, but msg is broken\n");
+					return;
+				}
+
+				std::vector<object_references_t> result;
+
+				for (uint64_t i = 0; i < count; ++i)
+				{
+					uint64_t addr;
+					uint64_t parents_count;
+					std::string type;
+
+					reader.read_varint(addr);
+					reader.read_string(type);
+					reader.read_varint(parents_count);						
 
-					auto cmd = get_command<command_pause_app>(request_id, protocol::command::CMD_PAUSE);
-					if (cmd == nullptr)
-						continue;
+					object_references_t obj;
+					obj.address = addr;
+					obj.type = type;
 
-					uint8_t error;
-					if (!reader.read_uint8(error))
+					for (uint64_t j = 0; j < parents_count; ++j)
 					{
-						printf("Received pause, but msg is broken\n");
-						continue;
+						uint64_t parent_addr;
+						reader.read_varint(parent_addr);
+						obj.parents.push_back({parent_addr});
 					}
 
-					cmd->callback(error == 0);
+					result.push_back(obj);
+				}
+
+				cmd->callback(cmd->addresses, "", result, frame);
+			}
+			else if (msg.header.type == protocol::message::SRV_PAUSE)
+			{
+				uint64_t request_id;
+				if (!reader.read_uint64(request_id))
+				{
+					printf("Received pause, but msg is broken\n");
+					return;
+				}
+
+				auto cmd = get_command<command_pause_app>(request_id, protocol::command::CMD_PAUSE);
+				if (cmd == nullptr)
+					return;
+
+				uint8_t error;
+				if (!reader.read_uint8(error))
+				{
+					printf("Received pause, but msg is broken\n");
+					return;
+				}
+
+				cmd->callback(error == 0);
+			}
+			else if (msg.header.type == protocol::message::SRV_RESUME)
+			{
+				uint64_t request_id;
+				if (!reader.read_uint64(request_id))
+				{
+					printf("Received resume, but msg is broken\n");
+					return;
+				}
+
+				auto cmd = get_command<command_resume_app>(request_id, protocol::command::CMD_RESUME);
+				if (cmd == nullptr)
+					return;
+
+				uint8_t error;
+				if (!reader.read_uint8(error))
+				{
+					printf("Received resume, but msg is broken\n");
+					return;
 				}
-				else if (msg.header.type == protocol::message::SRV_RESUME)
+
+				cmd->callback(error == 0);
+			}
+			else if (msg.header.type == protocol::message::SRV_REFERENCES_PAGE)
+			{
+				uint64_t request_id;
+				if (!reader.read_uint64(request_id))
 				{
-					uint64_t request_id;
-					if (!reader.read_uint64(request_id))
+					printf("Received references page, but msg is broken\n");
+					return;
+				}
+
+				auto cmd = get_command<command_references_page>(request_id, protocol::command::CMD_REFERENCES_PAGE);
+				if (cmd == nullptr)
+					return;
+
+				references_page_t page;
+				uint8_t restart;
+				uint64_t groups_count;
+				bool all_ok = reader.read_varint(page.frame) && reader.read_uint8(restart) && reader.read_varint(page.total_count) && reader.read_varint(page.next_cursor) && reader.read_varint(groups_count);
+				for (uint64_t i = 0; i < groups_count && all_ok; ++i)
+				{
+					references_page_t::group group;
+					uint64_t addresses_count;
+					all_ok = reader.read_string(group.type) && reader.read_varint(group.count) && reader.read_varint(group.parents_count) && reader.read_varint(addresses_count);
+					uint64_t addr = 0;
+					for (uint64_t j = 0; j < addresses_count && all_ok; ++j)
 					{
-						printf("Received resume, but msg is broken\n");
-						continue;
+						uint64_t delta;
+						all_ok = reader.read_varint(delta);
+						addr += delta;
+						group.addresses.push_back(addr);
 					}
+					if (all_ok)
+						page.groups.push_back(std::move(group));
+				}
 
-					auto cmd = get_command<command_resume_app>(request_id, protocol::command::CMD_RESUME);
-					if (cmd == nullptr)
-						continue;
+				if (!all_ok)
+				{
+					printf("Received references page, but msg is broken\n");
+					return;
+				}
 
-					uint8_t error;
-					if (!reader.read_uint8(error))
+				page.restart = restart != 0;
+				cmd->callback(page);
+			}
+			else if (msg.header.type == protocol::message::SRV_ROOT_PATHS)
+			{
+				uint64_t request_id;
+				if (!reader.read_uint64(request_id))
+				{
+					printf("Received root paths, but msg is broken\n");
+					return;
+				}
+
+				auto cmd = get_command<command_root_paths>(request_id, protocol::command::CMD_ROOT_PATHS);
+				if (cmd == nullptr)
+					return;
+
+				uint64_t frame;
+				uint8_t status;
+				uint64_t paths_count;
+				std::vector<root_path_t> paths;
+				bool all_ok = reader.read_varint(frame) && reader.read_uint8(status) && reader.read_varint(paths_count);
+				for (uint64_t i = 0; i < paths_count && all_ok; ++i)
+				{
+					root_path_t path;
+					uint64_t hops_count;
+					all_ok = reader.read_string(path.root_source) && reader.read_varint(path.root_slot) && reader.read_varint(hops_count);
+					for (uint64_t j = 0; j < hops_count && all_ok; ++j)
 					{
-						printf("Received resume, but msg is broken\n");
-						continue;
+						root_path_t::hop hop;
+						all_ok = reader.read_varint(hop.address) && reader.read_string(hop.type);
+						if (all_ok)
+							path.hops.push_back(std::move(hop));
 					}
+					if (all_ok)
+						paths.push_back(std::move(path));
+				}
 
-					cmd->callback(error == 0);
+				if (!all_ok)
+				{
+					printf("Received root paths, but msg is broken\n");
+					return;
 				}
-				else
+
+				cmd->callback((protocol::root_paths_status)status, paths, frame);
+			}
+			else if (msg.header.type == protocol::message::SRV_RETAINED_SIZES)
+			{
+				uint64_t request_id;
+				if (!reader.read_uint64(request_id))
+				{
+					printf("Received retained sizes, but msg is broken\n");
+					return;
+				}
+
+				auto cmd = get_command<command_retained_sizes>(request_id, protocol::command::CMD_RETAINED_SIZES);
+				if (cmd == nullptr)
+					return;
+
+				retained_sizes_t result;
+				uint64_t types_count;
+				bool all_ok = reader.read_varint(result.frame) && reader.read_varint(types_count);
+				for (uint64_t i = 0; i < types_count && all_ok; ++i)
+				{
+					retained_sizes_t::type_info type;
+					all_ok = reader.read_string(type.name) && reader.read_varint(type.count) && reader.read_varint(type.size) && reader.read_varint(type.retained);
+					if (all_ok)
+						result.types.push_back(std::move(type));
+				}
+
+				uint64_t objects_count = 0;
+				all_ok = all_ok && reader.read_varint(objects_count);
+				for (uint64_t i = 0; i < objects_count && all_ok; ++i)
 				{
-					printf("Received bad message\n");
+					retained_sizes_t::object_info object;
+					all_ok = reader.read_varint(object.address) && reader.read_uint32(object.type_index) && reader.read_varint(object.size) && reader.read_varint(object.retained);
+					if (all_ok)
+						result.objects.push_back(object);
+				}
+
+				if (!all_ok)
+				{
+					printf("Received retained sizes, but msg is broken\n");
+					return;
+				}
+
+				cmd->callback(result);
+			}
+			else if (msg.header.type == protocol::message::SRV_DUMP_HEAP)
+			{
+				uint64_t request_id;
+				if (!reader.read_uint64(request_id))
+				{
+					printf("Received heap dump result, but msg is broken\n");
+					return;
+				}
+
+				auto cmd = get_command<command_dump_heap>(request_id, protocol::command::CMD_DUMP_HEAP);
+				if (cmd == nullptr)
+					return;
+
+				uint8_t error;
+				std::string message;
+				if (!reader.read_uint8(error) || !reader.read_string(message))
+				{
+					printf("Received heap dump result, but msg is broken\n");
+					return;
+				}
+
+				cmd->callback(error == 0, message);
+			}
+			else
+			{
+				printf("Received bad message\n");
 #ifdef WIN32
-					__debugbreak();
+				__debugbreak();
 #endif
+			}
+
+		}
+
+	public:
+		void process_messages()
+		{
+			m_frame_events.reserve(1024);
+			while (true)
+			{
+				message msg;
+				// Wake up from time to time to check if we need to stop
+				if (!m_network.wait_message(msg, 100))
+				{
+					if (m_stop)
+						break;
+
+					continue;
 				}
 
+				process_message(msg);
+
 				// Avoid storing too many events in queue
 				if (m_frame_events.size() > 10000)
 					save_frame_events();
+
+				// A server that streams events never lets wait_message time out
+				if (m_stop)
+					break;
 			}
 
 			// Submit last events before quitting
@@ -550,10 +955,27 @@ namespace owlcat
 			if (!m_network.connect(addr, server_port))
 				return false;
 
+			if (!create_db(db_file_name))
+				return false;
+
+			m_stop = false;
+			m_thread = std::thread(&mono_profiler_client::details::process_messages, this);
+
+			return true;
+		}
+
+		// Creates a new database for a session, and forgets IDs of the previous session
+		bool create_db(const std::string& db_file_name)
+		{
 			m_db.close();
 
 			m_db_file_name = db_file_name;
 
+			m_server_type_ids.clear();
+			m_server_callstack_ids.clear();
+			m_server_method_names.clear();
+			m_sampling_intervals.clear();
+
 			// Remove existing database (if we use a non-temporary one)
 			if (std::filesystem::exists(m_db_file_name))
 				std::filesystem::remove(m_db_file_name);
@@ -577,11 +999,70 @@ namespace owlcat
 			if (!upgrade_database(m_db))
 				return false;
 
-			if (!queries::register_queries(m_db))
+			return queries::register_queries(m_db);
+		}
+
+		bool import_trace(const std::string& trace_file_name, const std::string& db_file_name)
+		{
+			if (m_thread.joinable())
 				return false;
 
-			m_thread = std::thread(&mono_profiler_client::details::process_messages, this);
+			FILE* file = fopen(trace_file_name.c_str(), "rb");
+			if (file == nullptr)
+				return false;
+
+			trace::header header;
+			if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, trace::magic, sizeof(header.magic)) != 0 ||
+				header.version != trace::version || header.header_size < sizeof(header) ||
+				fseek(file, header.header_size, SEEK_SET) != 0 || !create_db(db_file_name))
+			{
+				fclose(file);
+				return false;
+			}
+
+			// Trace is processed as if its messages came from server. A chunk that was not written completely, because
+			// the profiled process crashed, ends the trace
+			std::vector<uint8_t> stored;
+			std::vector<uint8_t> chunk;
+			trace::chunk_header chunk_header;
+			while (fread(&chunk_header, sizeof(chunk_header), 1, file) == 1)
+			{
+				if (chunk_header.raw_size > trace::max_chunk_size || chunk_header.stored_size > chunk_header.raw_size)
+					break;
+
+				stored.resize(chunk_header.stored_size);
+				if (fread(stored.data(), 1, stored.size(), file) != stored.size() || trace::get_checksum(stored.data(), stored.size()) != chunk_header.checksum)
+					break;
+
+				if (chunk_header.stored_size == chunk_header.raw_size)
+					chunk.swap(stored);
+				else
+				{
+					chunk.resize(chunk_header.raw_size);
+					if (!lz4::decompress(stored.data(), stored.size(), chunk.data(), chunk.size()))
+						break;
+				}
+
+				size_t offset = 0;
+				while (chunk.size() - offset >= sizeof(trace::message_header))
+				{
+					trace::message_header message_header;
+					memcpy(&message_header, chunk.data() + offset, sizeof(message_header));
+					offset += sizeof(message_header);
+					if (message_header.length > chunk.size() - offset)
+						break;
+
+					process_message(message(message_header.type, message_header.length, chunk.data() + offset));
+					offset += message_header.length;
+
+					if (m_frame_events.size() > 10000)
+						save_frame_events();
+				}
+			}
+			fclose(file);
 
+			// Events of the last frame are only saved when the next frame starts, and there is none
+			save_frame_events();
 			return true;
 		}
 
@@ -674,6 +1155,82 @@ namespace owlcat
 			m_network.write_message(protocol::command::CMD_RESUME, (uint32_t)cmd.size(), cmd.data());
 		}
 
+		void find_references_page(const std::vector<uint64_t>& addresses, bool parents, uint64_t cursor, uint32_t page_size, references_page_callback callback)
+		{
+			auto request_id = add_command(std::make_shared<command_references_page>(m_next_request_id++, callback));
+
+			std::vector<uint8_t> cmd;
+			memory_writer writer(cmd);
+			writer.write_uint64(request_id);
+			writer.write_uint8(parents ? 1 : 0);
+			writer.write_varint(cursor);
+			writer.write_varint(page_size);
+			writer.write_varint(addresses.size());
+			for (auto addr : addresses)
+				writer.write_varint(addr);
+			m_network.write_message(protocol::command::CMD_REFERENCES_PAGE, (uint32_t)cmd.size(), cmd.data());
+		}
+
+		void find_root_paths(uint64_t address, root_paths_callback callback, uint32_t max_paths, uint32_t max_nodes, uint32_t timeout_ms)
+		{
+			auto request_id = add_command(std::make_shared<command_root_paths>(m_next_request_id++, callback));
+
+			std::vector<uint8_t> cmd;
+			memory_writer writer(cmd);
+			writer.write_uint64(request_id);
+			writer.write_varint(address);
+			writer.write_varint(max_paths);
+			writer.write_varint(max_nodes);
+			writer.write_varint(timeout_ms);
+			m_network.write_message(protocol::command::CMD_ROOT_PATHS, (uint32_t)cmd.size(), cmd.data());
+		}
+
+		void get_retained_sizes(uint32_t max_objects, retained_sizes_callback callback)
+		{
+			auto request_id = add_command(std::make_shared<command_retained_sizes>(m_next_request_id++, callback));
+
+			std::vector<uint8_t> cmd;
+			memory_writer writer(cmd);
+			writer.write_uint64(request_id);
+			writer.write_varint(max_objects);
+			m_network.write_message(protocol::command::CMD_RETAINED_SIZES, (uint32_t)cmd.size(), cmd.data());
+		}
+
+		void dump_heap(const std::string& path, dump_heap_callback callback)
+		{
+			auto request_id = add_command(std::make_shared<command_dump_heap>(m_next_request_id++, callback));
+
+			std::vector<uint8_t> cmd;
+			memory_writer writer(cmd);
+			writer.write_uint64(request_id);
+			writer.write_string(path.c_str());
+			m_network.write_message(protocol::command::CMD_DUMP_HEAP, (uint32_t)cmd.size(), cmd.data());
+		}
+
+		void set_type_filter(const std::vector<protocol::filter_rule>& rules)
+		{
+			std::vector<uint8_t> cmd;
+			memory_writer writer(cmd);
+			writer.write_varint(rules.size());
+			for (auto& rule : rules)
+			{
+				writer.write_uint8((uint8_t)rule.target);
+				writer.write_uint8(rule.include ? 1 : 0);
+				writer.write_string(rule.pattern.c_str());
+			}
+			m_network.write_message(protocol::command::CMD_SET_FILTER, (uint32_t)cmd.size(), cmd.data());
+		}
+
+		void set_stopwords(const std::vector<std::string>& stopwords)
+		{
+			std::vector<uint8_t> cmd;
+			memory_writer writer(cmd);
+			writer.write_varint(stopwords.size());
+			for (auto& word : stopwords)
+				writer.write_string(word.c_str());
+			m_network.write_message(protocol::command::CMD_SET_STOPWORDS, (uint32_t)cmd.size(), cmd.data());
+		}
+
 		const char* get_type_name(uint64_t type_id) const
 		{
 			auto iter = m_id_to_type_map.find(type_id);
@@ -829,7 +1386,8 @@ public:
 					uint64_t size = result.get_uint64("size");
 					uint64_t type = result.get_uint64("type_id");
 					uint64_t callstack = result.get_uint64("callstack_id");
-					live_objects_map.emplace(addr, live_object(addr, size, frame, type, callstack));
+					double weight = protocol::get_sample_weight(size, get_sampling_interval(frame));
+					live_objects_map.emplace(addr, live_object(addr, size, frame, type, callstack, weight));
 				}
 				// Deallocation: remove object from map
 				else
@@ -896,6 +1454,11 @@ public:
 		return m_details->open_data(file);
 	}
 
+	bool mono_profiler_client::import_trace(const std::string& trace_file_name, const std::string& db_file_name)
+	{
+		return m_details->import_trace(trace_file_name, db_file_name);
+	}
+
 	bool mono_profiler_client::is_connected() const
 	{
 		return m_details->is_connected();
@@ -936,6 +1499,36 @@ public:
 		return m_details->resume_app(callback);
 	}
 
+	void mono_profiler_client::find_references_page(const std::vector<uint64_t>& addresses, bool parents, uint64_t cursor, uint32_t page_size, references_page_callback callback)
+	{
+		m_details->find_references_page(addresses, parents, cursor, page_size, callback);
+	}
+
+	void mono_profiler_client::find_root_paths(uint64_t address, root_paths_callback callback, uint32_t max_paths, uint32_t max_nodes, uint32_t timeout_ms)
+	{
+		m_details->find_root_paths(address, callback, max_paths, max_nodes, timeout_ms);
+	}
+
+	void mono_profiler_client::get_retained_sizes(uint32_t max_objects, retained_sizes_callback callback)
+	{
+		m_details->get_retained_sizes(max_objects, callback);
+	}
+
+	void mono_profiler_client::dump_heap(const std::string& path, dump_heap_callback callback)
+	{
+		m_details->dump_heap(path, callback);
+	}
+
+	void mono_profiler_client::set_type_filter(const std::vector<protocol::filter_rule>& rules)
+	{
+		m_details->set_type_filter(rules);
+	}
+
+	void mono_profiler_client::set_stopwords(const std::vector<std::string>& stopwords)
+	{
+		m_details->set_stopwords(stopwords);
+	}
+
 	const char* mono_profiler_client::get_type_name(uint64_t type_id) const
 	{
 		return m_details->get_type_name(type_id);
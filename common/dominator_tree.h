@@ -0,0 +1,244 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace owlcat
+{
+    /**
+        \brief Dominator tree of an object graph, used to find out retained sizes of objects.
+
+        Object A dominates object B if every path from GC roots to B goes through A, i.e. B would be freed if A
+        was. Retained size of A is the size of A plus sizes of all objects it dominates. Unlike the list of parents,
+        it shows which objects actually keep memory alive, e.g. which cache or manager should be cleared.
+
+        The graph is given as lists of parents (predecessors) of each node, since this is what the profiler
+        records. Nodes referenced from GC roots are children of a virtual root node, which dominates everything
+        reachable. Dominators are computed with the iterative algorithm by Cooper, Harvey and Kennedy ("A Simple,
+        Fast Dominance Algorithm"): it's much simpler than Lengauer-Tarjan and is as fast on object graphs, which are
+        wide and shallow, so it converges after two or three passes.
+    */
+    class dominator_tree
+    {
+    public:
+        // Immediate dominator of nodes that are only dominated by the virtual root, or that are not reachable at all
+        static constexpr uint32_t none = 0xFFFFFFFF;
+
+    private:
+        uint32_t m_nodes_count = 0;
+        // Immediate dominators, with virtual root as m_nodes_count. none for unreachable nodes
+        std::vector<uint32_t> m_idom;
+        // Reachable nodes in DFS postorder, virtual root is the last one
+        std::vector<uint32_t> m_postorder;
+
+    public:
+        /**
+            Builds the tree. Parents of node i are parents[parents_offsets[i]] to parents[parents_offsets[i + 1] - 1],
+            so parents_offsets must have nodes_count + 1 elements. Nodes for which is_root returns true are referenced
+            from GC roots.
+        */
+        template<typename IsRoot>
+        void build(uint32_t nodes_count, const uint32_t* parents_offsets, const uint32_t* parents, IsRoot is_root)
+        {
+            const uint32_t root = nodes_count;
+            m_nodes_count = nodes_count;
+
+            // 1. Children lists, which DFS needs, in the same compact form as parents
+            std::vector<uint32_t> children_offsets(nodes_count + 2, 0);
+            for (uint32_t node = 0; node < nodes_count; ++node)
+            {
+                for (uint32_t i = parents_offsets[node]; i < parents_offsets[node + 1]; ++i)
+                    ++children_offsets[parents[i] + 1];
+                if (is_root(node))
+                    ++children_offsets[root + 1];
+            }
+            for (uint32_t node = 0; node <= nodes_count; ++node)
+                children_offsets[node + 1] += children_offsets[node];
+
+            std::vector<uint32_t> children(children_offsets[nodes_count + 1]);
+            {
+                std::vector<uint32_t> fill(children_offsets.begin(), children_offsets.end() - 1);
+                for (uint32_t node = 0; node < nodes_count; ++node)
+                {
+                    for (uint32_t i = parents_offsets[node]; i < parents_offsets[node + 1]; ++i)
+                        children[fill[parents[i]]++] = node;
+                    if (is_root(node))
+                        children[fill[root]++] = node;
+                }
+            }
+
+            // 2. Postorder numbers of nodes reachable from the root. Graph can be millions of nodes deep
+            // (e.g. a linked list), so DFS uses an explicit stack of (node, next child) pairs
+            std::vector<uint32_t> order(nodes_count + 1, none);
+            m_postorder.clear();
+            m_postorder.reserve(nodes_count + 1);
+            {
+                std::vector<bool> visited(nodes_count + 1, false);
+                std::vector<std::pair<uint32_t, uint32_t>> stack;
+                stack.push_back({ root, children_offsets[root] });
+                visited[root] = true;
+                while (!stack.empty())
+                {
+                    auto& top = stack.back();
+                    if (top.second < children_offsets[top.first + 1])
+                    {
+                        uint32_t child = children[top.second++];
+                        if (!visited[child])
+                        {
+                            visited[child] = true;
+                            stack.push_back({ child, children_offsets[child] });
+                        }
+                    }
+                    else
+                    {
+                        order[top.first] = (uint32_t)m_postorder.size();
+                        m_postorder.push_back(top.first);
+                        stack.pop_back();
+                    }
+                }
+            }
+
+            // 3. Dominators, iterating over nodes in reverse postorder until nothing changes
+            m_idom.assign(nodes_count + 1, none);
+            m_idom[root] = root;
+
+            auto intersect = [&](uint32_t a, uint32_t b)
+            {
+                while (a != b)
+                {
+                    while (order[a] < order[b])
+                        a = m_idom[a];
+                    while (order[b] < order[a])
+                        b = m_idom[b];
+                }
+                return a;
+            };
+
+            bool changed = true;
+            while (changed)
+            {
+                changed = false;
+                for (size_t i = m_postorder.size() - 1; i-- > 0;)
+                {
+                    uint32_t node = m_postorder[i];
+                    uint32_t new_idom = is_root(node) ? root : none;
+                    for (uint32_t p = parents_offsets[node]; p < parents_offsets[node + 1]; ++p)
+                    {
+                        uint32_t parent = parents[p];
+                        // Parents that were not processed yet, or are not reachable at all, don't constrain anything
+                        if (m_idom[parent] == none)
+                            continue;
+
+                        new_idom = new_idom == none ? parent : intersect(parent, new_idom);
+                    }
+
+                    if (m_idom[node] != new_idom)
+                    {
+                        m_idom[node] = new_idom;
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        uint32_t get_nodes_count() const { return m_nodes_count; }
+
+        // Returns true if the node is reachable from GC roots
+        bool is_reachable(uint32_t node) const { return m_idom[node] != none; }
+
+        // Returns immediate dominator of the node, or none if it is only dominated by GC roots, or is not reachable
+        uint32_t get_idom(uint32_t node) const
+        {
+            uint32_t idom = m_idom[node];
+            return idom == m_nodes_count ? none : idom;
+        }
+
+        /**
+            Computes retained size of every node from sizes of nodes themselves. Nodes that are not reachable
+            only retain themselves.
+        */
+        std::vector<uint64_t> get_retained_sizes(const std::vector<uint64_t>& sizes) const
+        {
+            std::vector<uint64_t> retained(sizes.begin(), sizes.end());
+            retained.resize(m_nodes_count + 1, 0);
+
+            // Every node comes after all nodes it dominates in postorder
+            for (uint32_t node : m_postorder)
+            {
+                if (node != m_nodes_count)
+                    retained[m_idom[node]] += retained[node];
+            }
+
+            retained.resize(m_nodes_count);
+            return retained;
+        }
+
+        /**
+            Sums retained sizes of nodes by groups (e.g. types of objects). A node that is dominated by another node
+            of the same group is not counted, as its size is already included in the size of the dominator.
+            Nodes in group none are not counted anywhere.
+        */
+        std::vector<uint64_t> get_group_retained_sizes(const std::vector<uint64_t>& retained, const std::vector<uint32_t>& groups, uint32_t groups_count) const
+        {
+            std::vector<uint64_t> result(groups_count, 0);
+
+            // Number of nodes of each group on the path from the root to the current node
+            std::vector<uint32_t> on_path(groups_count, 0);
+
+            // Children in dominator tree, grouped by parent
+            const uint32_t root = m_nodes_count;
+            std::vector<uint32_t> offsets(m_nodes_count + 2, 0);
+            for (uint32_t node : m_postorder)
+            {
+                if (node != root)
+                    ++offsets[m_idom[node] + 1];
+            }
+            for (uint32_t node = 0; node <= m_nodes_count; ++node)
+                offsets[node + 1] += offsets[node];
+
+            std::vector<uint32_t> children(offsets[m_nodes_count + 1]);
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (uint32_t node : m_postorder)
+            {
+                if (node != root)
+                    children[fill[m_idom[node]]++] = node;
+            }
+
+            // Unreachable nodes are not in the tree, they only retain themselves
+            for (uint32_t node = 0; node < m_nodes_count; ++node)
+            {
+                if (m_idom[node] == none && groups[node] != none)
+                    result[groups[node]] += retained[node];
+            }
+
+            std::vector<std::pair<uint32_t, uint32_t>> stack;
+            stack.push_back({ root, offsets[root] });
+            while (!stack.empty())
+            {
+                auto& top = stack.back();
+                if (top.second < offsets[top.first + 1])
+                {
+                    uint32_t child = children[top.second++];
+                    uint32_t group = groups[child];
+                    if (group != none)
+                    {
+                        if (on_path[group] == 0)
+                            result[group] += retained[child];
+                        ++on_path[group];
+                    }
+                    stack.push_back({ child, offsets[child] });
+                }
+                else
+                {
+                    if (top.first != root && groups[top.first] != none)
+                        --on_path[groups[top.first]];
+                    stack.pop_back();
+                }
+            }
+
+            return result;
+        }
+    };
+}
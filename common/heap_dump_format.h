@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+    \brief Layout of heap dump files, written by the profiler server on CMD_DUMP_HEAP request.
+
+    A dump holds the whole state known to the server at the time it was written: all tracked objects,
+    references between them found by the last full pseudo-GC pass, and GC roots. It is meant to be memory-mapped
+    by readers, so everything is stored as arrays of fixed-size little-endian records at 8-byte aligned offsets,
+    and nothing needs to be parsed or loaded before use:
+
+    - header, with offsets and sizes of all other sections
+    - objects, sorted by address, so that an object can be found with a binary search
+    - parents: addresses of objects that reference each object. Parents of an object form a contiguous range
+      described by its first_parent and parents_count
+    - roots: GC root areas, sorted by address, with overlapping areas merged
+    - types: names of object types, referenced by objects' type_index
+    - strings: zero-terminated type names, referenced by types
+*/
+namespace owlcat
+{
+    namespace heap_dump
+    {
+        static const char magic[8] = { 'O', 'W', 'L', 'H', 'E', 'A', 'P', 0 };
+        static const uint32_t version = 1;
+
+        // Type index of objects whose type could not be found out, e.g. because they were already freed by the runtime
+        static const uint32_t unknown_type = 0xFFFFFFFF;
+
+#pragma pack(push, 1)
+        struct section
+        {
+            // Offset from the start of the file, in bytes
+            uint64_t offset;
+            // Number of records (bytes for strings)
+            uint64_t count;
+        };
+
+        struct header
+        {
+            char magic[8];
+            uint32_t version;
+            // Size of header structure, so that newer readers can recognize older headers
+            uint32_t header_size;
+            // Frame when the dump was made
+            uint64_t frame;
+
+            section objects;
+            section parents;
+            section roots;
+            section types;
+            section strings;
+        };
+
+        enum object_flags : uint32_t
+        {
+            // Object is referenced from a GC root
+            OBJECT_ROOT = 1 << 0,
+            // Object was allocated after the last pseudo-GC pass, so it has no known parents yet
+            OBJECT_YOUNG = 1 << 1,
+            // Object was not reported to client because of sampling or type filter
+            OBJECT_UNSAMPLED = 1 << 2,
+        };
+
+        struct object
+        {
+            uint64_t addr;
+            uint32_t size;
+            uint32_t type_index;
+            // Index of the first parent in parents section
+            uint64_t first_parent;
+            uint32_t parents_count;
+            uint32_t flags;
+        };
+
+        struct root
+        {
+            uint64_t start;
+            uint64_t size;
+        };
+
+        struct type
+        {
+            // Offset of the name in strings section
+            uint64_t name_offset;
+        };
+#pragma pack(pop)
+
+        static_assert(sizeof(header) == 104, "heap_dump::header is a part of file format and must not change its size");
+        static_assert(sizeof(object) == 32, "heap_dump::object is a part of file format and must not change its size");
+        static_assert(sizeof(root) == 16, "heap_dump::root is a part of file format and must not change its size");
+    }
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace owlcat
+{
+    /**
+        \brief Compression of single blocks in LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md).
+
+        Used for trace files, where profiler events are written in chunks. The compressor is the simplest greedy one,
+        with a single hash table and no acceleration: profiler events are mostly small integers and repeated IDs,
+        which it compresses well, and it's fast enough to keep up with the event stream on a background thread.
+        Blocks are compatible with the reference implementation, so they can be inspected with other tools.
+    */
+    namespace lz4
+    {
+        // Minimal length of a match, and number of bytes at the end of a block that are always stored as literals
+        static constexpr size_t min_match = 4;
+        static constexpr size_t last_literals = 5;
+        // The last match must start at least this many bytes before the end of a block
+        static constexpr size_t match_limit = 12;
+        static constexpr size_t max_offset = 65535;
+
+        // Returns the largest possible size of a compressed block, for incompressible data
+        inline size_t max_compressed_size(size_t size)
+        {
+            return size + size / 255 + 16;
+        }
+
+        namespace details
+        {
+            inline uint32_t read32(const uint8_t* p)
+            {
+                uint32_t value;
+                memcpy(&value, p, sizeof(value));
+                return value;
+            }
+
+            inline uint8_t* write_length(uint8_t* op, size_t length)
+            {
+                for (; length >= 255; length -= 255)
+                    *op++ = 255;
+                *op++ = (uint8_t)length;
+                return op;
+            }
+
+            inline uint8_t* write_literals(uint8_t* op, uint8_t* token, const uint8_t* literals, size_t count)
+            {
+                *token = (uint8_t)((count < 15 ? count : 15) << 4);
+                if (count >= 15)
+                    op = write_length(op, count - 15);
+                memcpy(op, literals, count);
+                return op + count;
+            }
+
+            inline bool read_length(const uint8_t*& ip, const uint8_t* ip_end, size_t& length)
+            {
+                uint8_t b;
+                do
+                {
+                    if (ip == ip_end)
+                        return false;
+                    b = *ip++;
+                    length += b;
+                } while (b == 255);
+                return true;
+            }
+        }
+
+        /**
+            Compresses size bytes from src to dst, which must hold max_compressed_size(size) bytes.
+            Returns size of the compressed block.
+        */
+        inline size_t compress(const uint8_t* src, size_t size, uint8_t* dst)
+        {
+            static constexpr int hash_bits = 16;
+            // Positions of the last occurrence of each hashed 4-byte sequence
+            std::vector<uint32_t> table(1 << hash_bits, 0);
+
+            const uint8_t* ip = src;
+            const uint8_t* anchor = src;
+            const uint8_t* end = src + size;
+            uint8_t* op = dst;
+
+            if (size > match_limit)
+            {
+                const uint8_t* match_end_limit = end - last_literals;
+                const uint8_t* match_start_limit = end - match_limit;
+                while (ip < match_start_limit)
+                {
+                    uint32_t sequence = details::read32(ip);
+                    uint32_t hash = (sequence * 2654435761u) >> (32 - hash_bits);
+                    const uint8_t* ref = src + table[hash];
+                    table[hash] = (uint32_t)(ip - src);
+                    if (ref >= ip || (size_t)(ip - ref) > max_offset || details::read32(ref) != sequence)
+                    {
+                        ++ip;
+                        continue;
+                    }
+
+                    // Match may start earlier than the hashed sequence, and usually continues after it
+                    while (ip > anchor && ref > src && ip[-1] == ref[-1])
+                    {
+                        --ip;
+                        --ref;
+                    }
+                    const uint8_t* match_end = ip + min_match;
+                    const uint8_t* ref_end = ref + min_match;
+                    while (match_end < match_end_limit && *match_end == *ref_end)
+                    {
+                        ++match_end;
+                        ++ref_end;
+                    }
+
+                    uint8_t* token = op++;
+                    op = details::write_literals(op, token, anchor, ip - anchor);
+
+                    size_t offset = ip - ref;
+                    *op++ = (uint8_t)offset;
+                    *op++ = (uint8_t)(offset >> 8);
+
+                    size_t length = match_end - ip - min_match;
+                    *token |= (uint8_t)(length < 15 ? length : 15);
+                    if (length >= 15)
+                        op = details::write_length(op, length - 15);
+
+                    ip = match_end;
+                    anchor = ip;
+                }
+            }
+
+            // The last sequence only has literals
+            uint8_t* token = op++;
+            op = details::write_literals(op, token, anchor, end - anchor);
+            return op - dst;
+        }
+
+        /**
+            Decompresses a block of size bytes from src to dst, which must hold exactly dst_size bytes.
+            Returns false if the block is broken, without reading or writing out of bounds.
+        */
+        inline bool decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dst_size)
+        {
+            const uint8_t* ip = src;
+            const uint8_t* ip_end = src + size;
+            uint8_t* op = dst;
+            uint8_t* op_end = dst + dst_size;
+
+            while (ip != ip_end)
+            {
+                uint8_t token = *ip++;
+
+                size_t literals = token >> 4;
+                if (literals == 15 && !details::read_length(ip, ip_end, literals))
+                    return false;
+                if (literals > (size_t)(ip_end - ip) || literals > (size_t)(op_end - op))
+                    return false;
+                memcpy(op, ip, literals);
+                ip += literals;
+                op += literals;
+
+                // The last sequence has no match
+                if (ip == ip_end)
+                    return op == op_end;
+
+                if (ip_end - ip < 2)
+                    return false;
+                size_t offset = ip[0] | (ip[1] << 8);
+                ip += 2;
+                if (offset == 0 || offset > (size_t)(op - dst))
+                    return false;
+
+                size_t length = token & 15;
+                if (length == 15 && !details::read_length(ip, ip_end, length))
+                    return false;
+                length += min_match;
+                if (length > (size_t)(op_end - op))
+                    return false;
+
+                // Match may overlap the bytes it produces, e.g. a run of the same byte has offset 1
+                const uint8_t* match = op - offset;
+                if (offset >= length)
+                    memcpy(op, match, length);
+                else
+                {
+                    for (size_t i = 0; i < length; ++i)
+                        op[i] = match[i];
+                }
+                op += length;
+            }
+
+            return false;
+        }
+    }
+}
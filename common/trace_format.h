@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+    \brief Layout of trace files, written by the profiler server when it records without a client
+    (see mono_profiler_options::trace_path).
+
+    A trace holds the same messages the server would send to a client over network, so a client imports it by
+    processing them as if they were received from server. The file is append-only, and is written as:
+
+    - header
+    - chunks, each one a chunk_header followed by stored_size bytes of chunk data. If stored_size is less than
+      raw_size, the data is compressed with LZ4 block format (see lz4_block.h), otherwise it's stored as is.
+      Uncompressed data of a chunk is a sequence of whole messages: message_header followed by length bytes
+
+    Chunks are written one by one and are never modified, so if the profiled process crashes, the trace is only
+    missing the chunk that was being written. Readers stop at the first chunk that is truncated or doesn't match
+    its checksum.
+*/
+namespace owlcat
+{
+    namespace trace
+    {
+        static const char magic[8] = { 'O', 'W', 'L', 'T', 'R', 'A', 'C', 'E' };
+        static const uint32_t version = 1;
+
+        // Largest uncompressed chunk. Readers treat larger chunks as broken, so they don't allocate whatever a broken size says
+        static const uint32_t max_chunk_size = 64 * 1024 * 1024;
+
+#pragma pack(push, 1)
+        struct header
+        {
+            char magic[8];
+            uint32_t version;
+            // Size of header structure, so that newer readers can recognize older headers
+            uint32_t header_size;
+        };
+
+        struct chunk_header
+        {
+            // Size of messages in the chunk
+            uint32_t raw_size;
+            // Size of the data that follows the header
+            uint32_t stored_size;
+            // Checksum of the stored data, see get_checksum
+            uint32_t checksum;
+        };
+
+        struct message_header
+        {
+            // protocol::message
+            uint8_t type;
+            uint32_t length;
+        };
+#pragma pack(pop)
+
+        static_assert(sizeof(header) == 16, "trace::header is a part of file format and must not change its size");
+        static_assert(sizeof(chunk_header) == 12, "trace::chunk_header is a part of file format and must not change its size");
+        static_assert(sizeof(message_header) == 5, "trace::message_header is a part of file format and must not change its size");
+
+        // 32-bit FNV-1a hash. Only meant to detect chunks that were not written completely
+        inline uint32_t get_checksum(const uint8_t* data, size_t size)
+        {
+            uint32_t hash = 2166136261u;
+            for (size_t i = 0; i < size; ++i)
+                hash = (hash ^ data[i]) * 16777619u;
+            return hash;
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+/**
+    \brief An event count: lets a thread sleep until some condition becomes true, without slowing down
+    the threads that make it true.
+
+    Waiting is a two-step process: prepare_wait(), check the condition, then wait_for() (or cancel_wait() if
+    the condition is already true). Anyone who changes the condition calls notify() afterwards. notify() is
+    just a fence and a load when nobody waits, so it can be called on hot paths, e.g. for every queued item.
+
+    All waits are bounded by a timeout, so a waiter that depends on something that doesn't notify (e.g. a
+    flag set by another thread) still wakes up eventually.
+*/
+class wait_event
+{
+public:
+    // Returns a key for wait_for(). Must be called before checking the condition
+    uint64_t prepare_wait()
+    {
+        m_waiters.fetch_add(1, std::memory_order_seq_cst);
+        return m_epoch.load(std::memory_order_seq_cst);
+    }
+
+    // Cancels a wait started with prepare_wait(), when the condition turned out to be true already
+    void cancel_wait()
+    {
+        m_waiters.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    // Blocks until notify() is called after prepare_wait() that returned key, or timeout expires.
+    // Returns false on timeout.
+    bool wait_for(uint64_t key, std::chrono::milliseconds timeout)
+    {
+        bool notified;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            notified = m_cv.wait_for(lock, timeout, [&]() { return m_epoch.load(std::memory_order_seq_cst) != key; });
+        }
+        m_waiters.fetch_sub(1, std::memory_order_seq_cst);
+        return notified;
+    }
+
+    // Blocks until done() returns true. Each sleep is bounded by max_sleep
+    template<typename Pred>
+    void wait(Pred done, std::chrono::milliseconds max_sleep)
+    {
+        while (!done())
+        {
+            auto key = prepare_wait();
+            if (done())
+            {
+                cancel_wait();
+                return;
+            }
+            wait_for(key, max_sleep);
+        }
+    }
+
+    // Wakes up all threads waiting for this event. Must be called after the condition was changed
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_relaxed) == 0)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        }
+        m_cv.notify_all();
+    }
+
+private:
+    std::atomic<uint64_t> m_epoch{ 0 };
+    std::atomic<int> m_waiters{ 0 };
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cmath>
 #include <cstdint>
 #include <vector>
 #include <string>
@@ -16,18 +17,135 @@ namespace owlcat
 	{
 		enum message
 		{
+			// Single allocation with full type name and callstack text. Not sent by current servers, but still understood by client
 			SRV_ALLOC = 1,
 			SRV_FREE,
+			// Result of CMD_REFERENCES: request ID, varint frame of the snapshot the answer comes from, varint objects count,
+			// then varint address, type name, varint parents count and varint parent addresses of each object
 			SRV_REFERENCES,
 			SRV_PAUSE,
 			SRV_RESUME,
+			// Definitions of interned object types: count, then type ID and full type name for each type
+			SRV_TYPE_DEF,
+			// Definitions of interned callstacks: count, then callstack ID, frames count and method IDs for each callstack
+			SRV_STACK_DEF,
+			// All allocations from a part of a frame: frame, count and fixed-size alloc_record's
+			SRV_ALLOC_BATCH,
+			// Definitions of methods used in callstacks: count, then method ID and name for each method
+			SRV_METHOD_DEF,
+			// Objects freed by a GC pass, sorted by address: frame, count, then varint address delta from the previous
+			// object (from 0 for the first one) and varint size for each object
+			SRV_FREE_BATCH,
+			// Sampling settings of the session, sent before any allocations: varint sampling interval in bytes, 0 if every
+			// allocation is reported. In sampling mode, SRV_ALLOC_BATCH only holds sampled allocations, see get_sample_weight
+			SRV_SAMPLING,
+			// Totals of objects that were not sampled: frame, then varint counts and sizes of allocated and freed objects.
+			// Together with sampled allocations and frees, they give exact per-frame numbers
+			SRV_UNSAMPLED_TOTALS,
+			// Result of CMD_DUMP_HEAP: request ID, error flag (uint8, 0 on success), then path of the written file,
+			// or error message
+			SRV_DUMP_HEAP,
+			// Result of CMD_RETAINED_SIZES: request ID, varint frame of the snapshot, varint types count, then name and varint
+			// count, size and retained size for each type, varint objects count, then varint address, type index (uint32), size
+			// and retained size for each object
+			SRV_RETAINED_SIZES,
+			// Result of CMD_ROOT_PATHS: request ID, varint frame of the snapshot, root_paths_status (uint8), varint paths count,
+			// then for each path: name of the root source, varint address of the root slot (0 if not found), varint hops count,
+			// then varint address and type name of each hop, from the root object to the requested one
+			SRV_ROOT_PATHS,
+			// Result of CMD_REFERENCES_PAGE: request ID, varint frame of the snapshot, restart flag (uint8, 1 if the cursor is
+			// no longer valid and pages must be requested again from cursor 0), varint total objects count, varint next cursor
+			// (0 after the last page), varint groups count, then for each group: type name, varint objects count in all pages,
+			// varint parents count of objects in this page, varint objects count in this page and varint address delta from
+			// the previous object
+			SRV_REFERENCES_PAGE,
 		};
 
+		/*
+			A single allocation in SRV_ALLOC_BATCH message. Type and callstack are referenced by IDs
+			from previous SRV_TYPE_DEF and SRV_STACK_DEF messages.
+		*/
+#pragma pack(push, 1)
+		struct alloc_record
+		{
+			uint64_t addr;
+			uint32_t size;
+			uint32_t type_id;
+			uint32_t callstack_id;
+		};
+#pragma pack(pop)
+		static_assert(sizeof(alloc_record) == 20, "alloc_record is a part of protocol and must not change its size");
+
+		/*
+			Returns the estimated number of allocations represented by a sampled allocation of the specified size. An allocation
+			is sampled with probability 1 - exp(-size / interval), so its count and size are divided by that probability.
+		*/
+		inline double get_sample_weight(uint64_t size, uint64_t interval)
+		{
+			if (interval == 0 || size == 0)
+				return 1.0;
+
+			return 1.0 / -std::expm1(-(double)size / (double)interval);
+		}
+
 		enum command
 		{
 			CMD_REFERENCES = 1,
 			CMD_PAUSE,
 			CMD_RESUME,
+			// Replaces rules of type filter (see filter_rule): varint count, then target, include flag (uint8) and pattern for each rule
+			CMD_SET_FILTER,
+			// Replaces stop-list: varint count, then a string for each stopword. Allocations from callstacks with a method
+			// whose name ("Class.Method") contains any of them are not reported
+			CMD_SET_STOPWORDS,
+			// Writes the whole heap state to a file on the profiled machine (see heap_dump_format.h): request ID,
+			// then path of the file
+			CMD_DUMP_HEAP,
+			// Computes retained sizes of objects from dominator tree of the heap: request ID, then varint maximum number of
+			// objects to report. Retained sizes of all types are always reported
+			CMD_RETAINED_SIZES,
+			// Finds the shortest paths from GC roots to an object: request ID, then varint object address, maximum number
+			// of paths, maximum number of objects to visit and timeout in milliseconds
+			CMD_ROOT_PATHS,
+			// Requests a page of objects grouped by type: request ID, mode (uint8: 0 for the objects themselves, 1 for their
+			// parents), varint cursor (0 for the first page, next cursor of the previous page otherwise), varint page size,
+			// varint addresses count and varint addresses.
+			// Unlike CMD_REFERENCES, it only goes one level up, so the client expands the tree as the user opens it
+			CMD_REFERENCES_PAGE,
+		};
+
+		// How a search for root paths ended
+		enum root_paths_status : uint8_t
+		{
+			// All paths were found, or there are no more roots that reference the object
+			ROOT_PATHS_COMPLETE,
+			// Search visited the maximum number of objects before it found all paths
+			ROOT_PATHS_NODE_BUDGET,
+			ROOT_PATHS_TIMEOUT,
+			// Requested object is not tracked by the profiler
+			ROOT_PATHS_NOT_FOUND,
+		};
+
+		enum filter_target : uint8_t
+		{
+			// Namespace of a class, including nested namespaces: "System" matches "System.Collections", but not "SystemX"
+			FILTER_NAMESPACE,
+			// Name of the assembly a class is defined in, with or without ".dll"
+			FILTER_ASSEMBLY,
+			// Full name of a class, "Namespace.Name"
+			FILTER_TYPE,
+		};
+
+		/*
+			A rule of type filter, which decides which allocations are profiled. If there are any include rules, only objects
+			of classes that match at least one of them are profiled, and objects of classes that match an exclude rule never are.
+			Objects that are filtered out are still counted in frame totals, but are not reported one by one.
+		*/
+		struct filter_rule
+		{
+			filter_target target;
+			bool include;
+			std::string pattern;
 		};
 
 		extern const char* pipe_name;
@@ -89,6 +207,8 @@ uint32_t id;
 
 		void write_message(uint8_t type, uint32_t length, const uint8_t* data);
 		bool read_message(message& msg);
+		// Reads a message, waiting for up to timeout_ms milliseconds if there is none. Returns false on timeout
+		bool wait_message(message& msg, int timeout_ms);
 
 		size_t get_read_messages_count() const;
 	};
@@ -5,6 +5,7 @@
 #include <mutex>
 
 #include "concurrentqueue.h"
+#include "wait_event.h"
 
 #include <asio/io_context.hpp>
 #include <asio/ip/tcp.hpp>
@@ -31,6 +32,8 @@ namespace owlcat
 	class network::details
 	{
 		moodycamel::ConcurrentQueue<message> m_read_buffer;
+		// Notified when a message is added to m_read_buffer
+		wait_event m_read_event;
 
 #ifdef DEBUG_NETWORK
 		int write_count = 0, read_count = 0;
@@ -102,6 +105,7 @@ namespace owlcat
 
 			//m_read_buffer.enqueue(m_current_message);
 			m_read_buffer.enqueue(*msg);
+			m_read_event.notify();
 			read_message_header_from_socket();
 		}
 
@@ -294,6 +298,22 @@ namespace owlcat
 			return m_read_buffer.try_dequeue(msg);
 		}
 
+		bool wait_message(message& msg, int timeout_ms)
+		{
+			if (m_read_buffer.try_dequeue(msg))
+				return true;
+
+			auto key = m_read_event.prepare_wait();
+			if (m_read_buffer.try_dequeue(msg))
+			{
+				m_read_event.cancel_wait();
+				return true;
+			}
+
+			m_read_event.wait_for(key, std::chrono::milliseconds(timeout_ms));
+			return m_read_buffer.try_dequeue(msg);
+		}
+
 		size_t get_read_messages_count() const
 		{
 			return m_read_buffer.size_approx();
@@ -355,6 +375,11 @@ namespace owlcat
 		return m_details->read_message(msg);
 	}
 
+	bool network::wait_message(message& msg, int timeout_ms)
+	{
+		return m_details->wait_message(msg, timeout_ms);
+	}
+
 	size_t network::get_read_messages_count() const
 	{
 		return m_details->get_read_messages_count();
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string>
+
 namespace owlcat
 {
 #ifdef WIN32
@@ -7,6 +9,38 @@ namespace owlcat
 #else
     #define DLL_EXPORT __attribute__ ((dllexport))
 #endif
+	/*
+		Settings that control how the profiler works. Default values are good for most uses.
+	*/
+	struct mono_profiler_options
+	{
+		// Number of threads used to mark objects during pseudo-GC. 0 means "pick automatically",
+		// 1 runs marking on the GC thread only, which is slower, but deterministic.
+		unsigned gc_threads = 0;
+		// Every N-th pseudo-GC is a full one. Others only scan objects allocated since the previous GC and objects
+		// whose contents changed, and only report objects allocated since the previous GC as freed, so old objects
+		// are reported as freed late. Default 1 makes every GC full, set it higher if GC stalls are too long.
+		unsigned full_gc_interval = 1;
+		// If true, pseudo-GC looks for references at every byte offset of objects, not only at pointer-aligned ones.
+		// Much slower, only needed if something stores references unaligned.
+		bool unaligned_scan = false;
+		// If true, pseudo-GC only looks for references in fields that can hold them, when it knows object's class layout.
+		// Otherwise, every word of an object is treated as a possible reference. Ignored in unaligned mode.
+		bool precise_scan = true;
+		// Average number of allocated bytes between allocations that are reported with callstacks. Other allocations are
+		// only counted, which saves the stack walk. Client scales sampled numbers to estimate the totals. 0 reports
+		// every allocation.
+		unsigned sampling_interval = 0;
+		// If set, events are recorded to a local trace file at this path, instead of being sent to a client, and the server
+		// doesn't listen for connections. Meant for machines where nobody runs the UI, e.g. overnight soak tests.
+		// Client imports the file later with mono_profiler_client::import_trace
+		std::string trace_path;
+
+		// Reads options from environment variables (OWLCAT_PROFILER_*). This is the only way to
+		// configure the profiler when it is injected into the game without C# instrumentation.
+		static mono_profiler_options from_environment();
+	};
+
 	/*
 		Class that starts and stops the profiler,
 		and also handles network connections.
@@ -21,7 +55,7 @@ namespace owlcat
 		mono_profiler_server();
 		~mono_profiler_server();
 
-		void start(bool wait_for_connection, int port);
+		void start(bool wait_for_connection, int port, const mono_profiler_options& options = mono_profiler_options());
 		void stop();
 
 		void on_frame();
@@ -0,0 +1,286 @@
+#pragma once
+
+#include "counting_allocator.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace owlcat
+{
+	/*
+		Open-addressing hash table keyed by object address, used to store the list of live allocations.
+
+		std::unordered_map costs us a node allocation and a pointer chase per object, which is too much when
+		there are millions of live objects and most lookups done by GC are misses. This table stores keys and
+		values inline in a single flat array and uses Robin Hood probing, which lets a lookup for an absent
+		key stop as soon as it meets an entry that is closer to its home slot than the key would be.
+
+		Erasing uses backward shift deletion, so there are no tombstones and the table never degrades after
+		a lot of sweeps.
+
+		Important notes:
+		- Key 0 is reserved to mark empty slots. It is never a valid object address.
+		- Pointers returned by find() and insert() stay valid until the next insert() or erase() call.
+		  GC relies on this: the mark phase only looks up and modifies values, so it can store pointers
+		  in its working stack.
+	*/
+	template<typename T>
+	class address_map
+	{
+	public:
+		using key_type = uint64_t;
+		using value_type = T;
+
+	private:
+		static constexpr key_type empty_key = 0;
+		static constexpr size_t min_capacity = 1024;
+
+		struct slot
+		{
+			key_type key = empty_key;
+			T value = T();
+		};
+
+		std::vector<slot, counting_allocator<slot>> m_slots;
+		size_t m_size = 0;
+		size_t m_mask = 0;
+		int m_shift = 64;
+
+		// Objects are at least 8-byte aligned, so lower bits carry no information. Fibonacci hashing
+		// spreads the remaining bits and takes the highest ones as slot index.
+		size_t home_slot(key_type key) const
+		{
+			return (size_t)(((key >> 3) * 0x9E3779B97F4A7C15ULL) >> m_shift);
+		}
+
+		size_t probe_distance(key_type key, size_t slot_index) const
+		{
+			return (slot_index - home_slot(key)) & m_mask;
+		}
+
+		bool needs_grow() const
+		{
+			// Keep load factor under 0.75
+			return m_slots.empty() || (m_size + 1) * 4 > m_slots.size() * 3;
+		}
+
+		void rehash(size_t new_capacity)
+		{
+			std::vector<slot, counting_allocator<slot>> old_slots(new_capacity);
+			old_slots.swap(m_slots);
+
+			m_mask = new_capacity - 1;
+			m_shift = 64;
+			for (size_t c = new_capacity; c > 1; c >>= 1)
+				--m_shift;
+			m_size = 0;
+
+			for (auto& s : old_slots)
+			{
+				if (s.key != empty_key)
+					insert_unique(s.key, std::move(s.value));
+			}
+		}
+
+		// Inserts a key known to be absent. Returns index of the slot where the key was placed.
+		size_t insert_unique(key_type key, T&& value)
+		{
+			size_t index = home_slot(key);
+			size_t dist = 0;
+			size_t result = (size_t)-1;
+
+			slot current{ key, std::move(value) };
+			for (;; index = (index + 1) & m_mask, ++dist)
+			{
+				auto& s = m_slots[index];
+				if (s.key == empty_key)
+				{
+					s = std::move(current);
+					++m_size;
+					return result == (size_t)-1 ? index : result;
+				}
+
+				// Robin Hood: take the slot from an entry that is closer to its home than we are
+				size_t existing_dist = probe_distance(s.key, index);
+				if (existing_dist < dist)
+				{
+					std::swap(s, current);
+					if (result == (size_t)-1)
+						result = index;
+					dist = existing_dist;
+				}
+			}
+		}
+
+		// Removes entry at the specified slot and shifts the following entries of the cluster back
+		void erase_slot(size_t index)
+		{
+			size_t next = (index + 1) & m_mask;
+			while (m_slots[next].key != empty_key && probe_distance(m_slots[next].key, next) != 0)
+			{
+				m_slots[index] = std::move(m_slots[next]);
+				index = next;
+				next = (next + 1) & m_mask;
+			}
+
+			m_slots[index].key = empty_key;
+			m_slots[index].value = T();
+			--m_size;
+		}
+
+		size_t find_slot(key_type key) const
+		{
+			if (key == empty_key || m_size == 0)
+				return (size_t)-1;
+
+			size_t index = home_slot(key);
+			for (size_t dist = 0;; index = (index + 1) & m_mask, ++dist)
+			{
+				auto& s = m_slots[index];
+				if (s.key == key)
+					return index;
+				if (s.key == empty_key || probe_distance(s.key, index) < dist)
+					return (size_t)-1;
+			}
+		}
+
+	public:
+		address_map() = default;
+
+		size_t size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+		size_t capacity() const { return m_slots.size(); }
+
+		// Reserves enough space to store the specified number of elements without rehashing
+		void reserve(size_t count)
+		{
+			size_t capacity = min_capacity;
+			while (count * 4 > capacity * 3)
+				capacity *= 2;
+			if (capacity > m_slots.size())
+				rehash(capacity);
+		}
+
+		void clear()
+		{
+			std::vector<slot, counting_allocator<slot>> empty;
+			m_slots.swap(empty);
+			m_size = 0;
+			m_mask = 0;
+			m_shift = 64;
+		}
+
+		// Returns a pointer to the value stored for the key, or nullptr if there is no such key
+		T* find(key_type key)
+		{
+			size_t index = find_slot(key);
+			return index == (size_t)-1 ? nullptr : &m_slots[index].value;
+		}
+
+		const T* find(key_type key) const
+		{
+			size_t index = find_slot(key);
+			return index == (size_t)-1 ? nullptr : &m_slots[index].value;
+		}
+
+		/*
+			Inserts a new value for the key. If the key is already present, the existing value is not changed.
+			Returns a pointer to the value stored in the table and a flag that is true if insertion took place.
+		*/
+		std::pair<T*, bool> insert(key_type key, T value)
+		{
+			size_t index = find_slot(key);
+			if (index != (size_t)-1)
+				return { &m_slots[index].value, false };
+
+			if (needs_grow())
+				rehash(m_slots.empty() ? min_capacity : m_slots.size() * 2);
+
+			index = insert_unique(key, std::move(value));
+			return { &m_slots[index].value, true };
+		}
+
+		// Removes the key from the table. Returns false if there was no such key
+		bool erase(key_type key)
+		{
+			size_t index = find_slot(key);
+			if (index == (size_t)-1)
+				return false;
+
+			erase_slot(index);
+			return true;
+		}
+
+		// Calls func(key, value) for each element of the table
+		template<typename F>
+		void for_each(F func)
+		{
+			for (auto& s : m_slots)
+			{
+				if (s.key != empty_key)
+					func(s.key, s.value);
+			}
+		}
+
+		template<typename F>
+		void for_each(F func) const
+		{
+			for (auto& s : m_slots)
+			{
+				if (s.key != empty_key)
+					func(s.key, s.value);
+			}
+		}
+
+		/*
+			Calls func(key, value) for each element stored in slots [begin, end), where end <= capacity().
+			Lets several threads walk different parts of the table at once.
+		*/
+		template<typename F>
+		void for_each_in_slots(size_t begin, size_t end, F func)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				auto& s = m_slots[i];
+				if (s.key != empty_key)
+					func(s.key, s.value);
+			}
+		}
+
+		/*
+			Removes all elements for which pred(key, value) returns true. Returns the number of removed elements.
+
+			The walk starts right after an empty slot and wraps around the table. Backward shift deletion
+			never moves entries across an empty slot, so every entry is visited exactly once even though
+			erasing moves entries that follow the erased one.
+		*/
+		template<typename F>
+		size_t erase_if(F pred)
+		{
+			if (m_size == 0)
+				return 0;
+
+			size_t start = 0;
+			while (m_slots[start].key != empty_key)
+				++start;
+
+			size_t erased = 0;
+			size_t index = (start + 1) & m_mask;
+			while (index != start)
+			{
+				auto& s = m_slots[index];
+				if (s.key != empty_key && pred(s.key, s.value))
+				{
+					erase_slot(index);
+					++erased;
+					// The next entry of the cluster was shifted into this slot, so check it again without advancing
+					continue;
+				}
+				index = (index + 1) & m_mask;
+			}
+
+			return erased;
+		}
+	};
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+namespace owlcat
+{
+	/*
+		Decides which allocations are sampled, i.e. reported with their callstacks, when the profiler runs
+		in sampling mode. Walking the stack is the most expensive part of handling an allocation, so sampling lets
+		the profiler stay enabled during long sessions.
+
+		Sampling is done by bytes, not by allocations, the same way tcmalloc does: distances between sampled bytes
+		are drawn from exponential distribution with the mean equal to the sampling interval, and an allocation is
+		sampled if it contains a sampled byte. Since exponential distribution has no memory, an allocation of size S
+		is sampled with probability 1 - exp(-S / interval) regardless of what was allocated before it. Client divides
+		counts and sizes of sampled allocations by this probability to get unbiased estimates (see protocol::get_sample_weight).
+		Large objects are almost always sampled, and small ones are rarely sampled, but in large numbers.
+
+		Each allocating thread uses its own sampler, so no synchronization is needed.
+	*/
+	class allocation_sampler
+	{
+		uint64_t m_interval = 0;
+		// Number of bytes left to allocate until the next sampled byte
+		int64_t m_bytes_left = 0;
+		// State of xorshift random number generator. Must never be 0
+		uint64_t m_random = 0;
+
+		uint64_t next_random()
+		{
+			m_random ^= m_random >> 12;
+			m_random ^= m_random << 25;
+			m_random ^= m_random >> 27;
+			return m_random * 0x2545F4914F6CDD1DULL;
+		}
+
+		int64_t next_distance()
+		{
+			// Uniform number in (0, 1], so that log never sees 0
+			double u = ((next_random() >> 11) + 1) * (1.0 / 9007199254740992.0);
+			return (int64_t)(-std::log(u) * (double)m_interval) + 1;
+		}
+
+	public:
+		/*
+			Sets average number of bytes between sampled allocations. 0 samples every allocation.
+			seed should be different for every thread, so that threads don't sample allocations in lockstep.
+		*/
+		void init(uint64_t interval, uint64_t seed)
+		{
+			m_interval = interval;
+			m_random = seed != 0 ? seed : 0x9E3779B97F4A7C15ULL;
+			m_bytes_left = interval != 0 ? next_distance() : 0;
+		}
+
+		uint64_t get_interval() const { return m_interval; }
+
+		// Returns true if an allocation of the specified size should be sampled
+		bool sample(uint32_t size)
+		{
+			if (m_interval == 0)
+				return true;
+
+			m_bytes_left -= size;
+			if (m_bytes_left > 0)
+				return false;
+
+			m_bytes_left = next_distance();
+			return true;
+		}
+	};
+}
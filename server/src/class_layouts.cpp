@@ -0,0 +1,189 @@
+#include "class_layouts.h"
+#include "mono_functions.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+using namespace owlcat::mono_functions;
+
+namespace owlcat
+{
+	std::atomic<uint64_t> class_layouts::s_next_generation{ 1 };
+
+	/*
+		Classes whose layouts the calling thread has already resolved for a single generation of a table.
+		Only one table exists at a time, so a thread doesn't need to keep more than one set.
+	*/
+	struct resolved_classes
+	{
+		uint64_t generation = 0;
+		std::unordered_set<MonoClass*> classes;
+	};
+	static thread_local resolved_classes t_resolved;
+
+	// FIELD_ATTRIBUTE_STATIC from ECMA-335 II.23.1.5. Literal and thread-static fields are static, too
+	static const uint32_t field_attribute_static = 0x0010;
+	// Value types can't contain themselves, so this only guards against broken metadata
+	static const int max_struct_depth = 16;
+
+	/*
+		Adds offsets of all reference fields of the class, and of structs embedded in it, to the list.
+		base is added to every field offset. Returns false if some field's type is not understood.
+	*/
+	bool class_layouts::add_fields(MonoClass* klass, int64_t base, std::vector<uint32_t>& offsets, int depth)
+	{
+		if (depth > max_struct_depth)
+			return false;
+
+		// Fields of base classes are not returned by class_get_fields
+		for (MonoClass* c = klass; c != nullptr; c = class_get_parent(c))
+		{
+			void* iter = nullptr;
+			while (MonoClassField* field = class_get_fields(c, &iter))
+			{
+				if (field_get_flags(field) & field_attribute_static)
+					continue;
+
+				MonoType* type = field_get_type(field);
+				int64_t offset = base + field_get_offset(field);
+				if (offset < 0)
+					return false;
+
+				switch (type_get_type(type))
+				{
+				case MONO_TYPE_BOOLEAN:
+				case MONO_TYPE_CHAR:
+				case MONO_TYPE_I1:
+				case MONO_TYPE_U1:
+				case MONO_TYPE_I2:
+				case MONO_TYPE_U2:
+				case MONO_TYPE_I4:
+				case MONO_TYPE_U4:
+				case MONO_TYPE_I8:
+				case MONO_TYPE_U8:
+				case MONO_TYPE_R4:
+				case MONO_TYPE_R8:
+				case MONO_TYPE_I:
+				case MONO_TYPE_U:
+				// Native pointers never point to managed heap
+				case MONO_TYPE_PTR:
+				case MONO_TYPE_FNPTR:
+					break;
+
+				case MONO_TYPE_STRING:
+				case MONO_TYPE_CLASS:
+				case MONO_TYPE_OBJECT:
+				case MONO_TYPE_SZARRAY:
+				case MONO_TYPE_ARRAY:
+					offsets.push_back((uint32_t)offset);
+					break;
+
+				case MONO_TYPE_VALUETYPE:
+				case MONO_TYPE_GENERICINST:
+				{
+					MonoClass* field_class = class_from_type(type);
+					if (field_class == nullptr)
+						return false;
+
+					if (!class_is_valuetype(field_class))
+						offsets.push_back((uint32_t)offset);
+					// Offsets of struct's own fields include object header, which embedded structs don't have
+					else if (!add_fields(field_class, offset - object_header_size, offsets, depth + 1))
+						return false;
+					break;
+				}
+
+				default:
+					return false;
+				}
+			}
+
+			if (class_is_valuetype(c))
+				break;
+		}
+
+		return true;
+	}
+
+	class_layout class_layouts::resolve(MonoClass* klass)
+	{
+		class_layout layout;
+
+		if (class_get_rank(klass) > 0)
+		{
+			MonoClass* element_class = class_get_element_class(klass);
+			if (element_class == nullptr)
+				return layout;
+
+			if (!class_is_valuetype(element_class))
+			{
+				layout.type = class_layout::kind::reference_array;
+				return layout;
+			}
+
+			int element_size = class_array_element_size(klass);
+			if (element_size <= 0)
+				return layout;
+
+			if (!add_fields(element_class, -(int64_t)object_header_size, layout.offsets, 0))
+			{
+				layout.offsets.clear();
+				return layout;
+			}
+
+			layout.element_size = (uint32_t)element_size;
+			layout.type = layout.offsets.empty() ? class_layout::kind::no_references : class_layout::kind::struct_array;
+		}
+		else
+		{
+			if (!add_fields(klass, 0, layout.offsets, 0))
+			{
+				layout.offsets.clear();
+				return layout;
+			}
+
+			layout.type = layout.offsets.empty() ? class_layout::kind::no_references : class_layout::kind::fields;
+		}
+
+		std::sort(layout.offsets.begin(), layout.offsets.end());
+		return layout;
+	}
+
+	class_layouts::class_layouts()
+		: m_generation(s_next_generation++)
+	{
+	}
+
+	std::unique_ptr<class_layout> class_layouts::resolve_once(MonoClass* klass)
+	{
+		if (klass == nullptr)
+			return nullptr;
+
+		auto& resolved = t_resolved;
+		if (resolved.generation != m_generation)
+		{
+			resolved.classes.clear();
+			resolved.generation = m_generation;
+		}
+
+		if (!resolved.classes.insert(klass).second)
+			return nullptr;
+
+		return std::make_unique<class_layout>(resolve(klass));
+	}
+
+	void class_layouts::add(MonoClass* klass, std::unique_ptr<class_layout> layout)
+	{
+		if (klass == nullptr || layout == nullptr)
+			return;
+
+		// Several threads may resolve the same class, the first layout wins
+		m_layouts.emplace(klass, std::move(*layout));
+	}
+
+	const class_layout* class_layouts::find(MonoClass* klass) const
+	{
+		auto iter = m_layouts.find(klass);
+		return iter == m_layouts.end() ? nullptr : &iter->second;
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "mono/metadata/profiler.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace owlcat
+{
+	/*
+		Describes where objects of a single class store references to other objects
+	*/
+	struct class_layout
+	{
+		enum class kind : uint8_t
+		{
+			// Layout is unknown, so every word of an object may be a reference
+			conservative,
+			// Objects can't reference anything: strings, arrays of primitive types, classes with primitive fields only
+			no_references,
+			// Object stores references at offsets
+			fields,
+			// Array of references
+			reference_array,
+			// Array of structs, each of which stores references at offsets relative to the start of the element
+			struct_array,
+		};
+
+		kind type = kind::conservative;
+		// Size of a single element of struct array
+		uint32_t element_size = 0;
+		// Sorted offsets of reference fields
+		std::vector<uint32_t> offsets;
+	};
+
+	/*
+		Cache of class layouts used by GC to visit only reference slots of objects, instead of treating every word
+		as a possible reference. Precise scanning is much faster for large arrays of value types, and doesn't produce
+		false parents from numbers that happen to look like addresses.
+
+		Layouts are resolved through Mono's reflection functions, which may take Mono's loader locks. A thread suspended
+		by Mono's GC may hold them, while GC callback waits for the worker thread to process all allocations, so neither
+		of them may resolve layouts. Allocating threads do it instead, like type_filter: each thread resolves a class
+		the first time it allocates an object of it, and sends the layout along with the allocation. The worker thread
+		adds it to the table, and GC only looks layouts up. Classes whose layout can't be resolved (e.g. fields of types
+		we don't understand) are scanned conservatively.
+	*/
+	class class_layouts
+	{
+	public:
+		// Size of MonoObject (vtable and synchronization pointers). Offsets of value type fields include it, too
+		static const uint32_t object_header_size = 2 * sizeof(void*);
+		// Offset of the first array element (header, bounds pointer and length)
+		static const uint32_t array_data_offset = 4 * sizeof(void*);
+
+	private:
+		// Generations are unique across all tables, so that a new table doesn't take classes resolved for an old one as sent
+		static std::atomic<uint64_t> s_next_generation;
+
+		std::unordered_map<MonoClass*, class_layout> m_layouts;
+		const uint64_t m_generation;
+
+		static bool add_fields(MonoClass* klass, int64_t base, std::vector<uint32_t>& offsets, int depth);
+		static class_layout resolve(MonoClass* klass);
+
+	public:
+		class_layouts();
+
+		// Called on the allocating thread. Resolves layout of the class if this thread didn't do it for this table yet,
+		// otherwise returns nullptr
+		std::unique_ptr<class_layout> resolve_once(MonoClass* klass);
+		// Adds a layout resolved by resolve_once, unless the class already has one. Only called by the worker thread
+		void add(MonoClass* klass, std::unique_ptr<class_layout> layout);
+		// Returns layout of the class, or nullptr if it was never added
+		const class_layout* find(MonoClass* klass) const;
+
+		size_t size() const { return m_layouts.size(); }
+	};
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <memory>
+#include <cstddef>
+
+extern volatile size_t map_size;
+
+/*
+	Allocator used to examine the size of hash maps used by the profiler
+*/
+template<typename T>
+class counting_allocator
+{
+private:
+	using real_allocator = std::allocator<T>;
+	real_allocator m_real_allocator;
+
+public:
+	counting_allocator() {}
+	counting_allocator(const counting_allocator<T>& other) {}
+	template<typename TOther>
+	counting_allocator(const counting_allocator<TOther>& other) {}
+
+	template<typename X>
+	struct rebind
+	{
+		typedef counting_allocator<X> other;
+	};
+
+	using value_type = typename real_allocator::value_type;
+	using size_type = typename real_allocator::size_type;
+	using difference_type = typename real_allocator::difference_type;
+	using propagate_on_container_move_assignment = typename real_allocator::propagate_on_container_move_assignment;
+	using is_always_equal = typename real_allocator::is_always_equal;
+
+	value_type* allocate(std::size_t n)
+	{
+		map_size += n * sizeof(T);
+		return m_real_allocator.allocate(n);
+	}
+
+	void deallocate(value_type* p, std::size_t n)
+	{
+		map_size -= n * sizeof(T);
+		m_real_allocator.deallocate(p, n);
+	}
+};
+
+template<>
+class counting_allocator<void>
+{
+public:
+	template<typename X>
+	struct rebind
+	{
+		typedef counting_allocator<X> other;
+	};
+
+	using value_type = void;
+	using size_type = size_t;
+	using difference_type = ptrdiff_t;
+};
+
+
+// return that all specializations of this allocator are interchangeable
+template <class T1, class T2>
+bool operator== (const counting_allocator<T1>&,
+	const counting_allocator<T2>&) throw() {
+	return true;
+}
+template <class T1, class T2>
+bool operator!= (const counting_allocator<T1>&,
+	const counting_allocator<T2>&) throw() {
+	return false;
+}
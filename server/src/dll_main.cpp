@@ -90,7 +90,7 @@ bool __cdecl player_init_engine_graphics_detour(bool arg)
     pipe = INVALID_HANDLE_VALUE;
 
     // Start server. We really should pass the port here, somehow
-    server->start(true, 8888);    
+    server->start(true, 8888, mono_profiler_options::from_environment());    
 
     // Return control to the original function
     return g_original_player_init_engine_graphics(arg);
@@ -213,7 +213,7 @@ extern "C"
     {
         // Avoid second call to start if already started from detour, even if the game wants it
         if (!g_is_detoured && !g_is_detoured_by_another_dll)
-            server->start(true, 8888);
+            server->start(true, 8888, mono_profiler_options::from_environment());
     }
 
     __declspec(dllexport) void EndProfilingFrame()
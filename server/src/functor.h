@@ -42,6 +42,9 @@ namespace owlcat
 			return m_ptr != nullptr;
 		}
 
+		// Returns true if the function was found by init()
+		bool is_found() const { return m_ptr != nullptr; }
+
 		/*
 		    Performs a search for the function in the specified dynamic library module using mangled name
 			(can be used with exported C++ function and methods with some reservations)
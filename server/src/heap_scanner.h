@@ -0,0 +1,277 @@
+#pragma once
+
+#include "page_bitmap.h"
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define OWLCAT_SCAN_SSE42 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <nmmintrin.h>
+#else
+#include <nmmintrin.h>
+#endif
+#endif
+
+#if defined(OWLCAT_SCAN_SSE42) && !defined(_MSC_VER)
+// GCC and Clang only allow SSE4.2 intrinsics in functions compiled for it. Function is only called if CPU supports it.
+#define OWLCAT_TARGET_SSE42 __attribute__((target("sse4.2")))
+#else
+#define OWLCAT_TARGET_SSE42
+#endif
+
+namespace owlcat
+{
+	/*
+		Conservative scanner of memory areas (objects and roots) used by pseudo-GC.
+
+		Every word of an object may be a reference, but most words are not: they are numbers, or pointers to
+		something we don't track. So words are first checked against bounds of the tracked heap, in bulk and with
+		SIMD when CPU supports it. Words that pass are then checked against the set of pages that hold tracked objects
+		(see page_bitmap), and only the remaining ones (candidates) are looked up in the allocations table.
+
+		Normally, only words aligned to pointer size are read, which is how Mono lays out references. Unaligned mode
+		reads a word at every byte offset like the old scanner did, for compatibility in case something stores
+		references unaligned.
+
+		Memory being scanned may no longer be accessible to us (an object may be long freed by the time we see it).
+		We can't know if it is, so we use SEH to handle the resulting access violation. Actually, we probably can
+		call into BoehmGC itself to check, but this is a more complicated and less stable way. This approach, however,
+		can hide some errors. Words are collected in blocks of block_size under a single guard, so a guard is set up
+		once per object for all but very large objects.
+	*/
+	class heap_scanner
+	{
+	public:
+		// Maximum number of words looked at, and candidates returned, by one call to collect()
+		static const size_t block_size = 256;
+
+	private:
+		// Lowest and highest address of a tracked object. Only starting addresses can be references to them
+		uintptr_t m_min = std::numeric_limits<uintptr_t>::max();
+		uintptr_t m_max = 0;
+		// Pages that contain tracked objects
+		page_bitmap m_pages;
+		bool m_unaligned = false;
+		bool m_use_sse42 = false;
+
+		static bool cpu_has_sse42()
+		{
+#if !defined(OWLCAT_SCAN_SSE42)
+			return false;
+#elif defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 1);
+			return (info[2] & (1 << 20)) != 0;
+#else
+			return __builtin_cpu_supports("sse4.2");
+#endif
+		}
+
+		// Unsigned min <= w <= max is the same as w - min <= max - min. Branchless: every word is written to out,
+		// but only candidates advance the output position.
+		static size_t filter_scalar(const uintptr_t* words, size_t count, uintptr_t min, uintptr_t max, uintptr_t* out)
+		{
+			const uintptr_t range = max - min;
+			size_t n = 0;
+			for (size_t i = 0; i < count; ++i)
+			{
+				uintptr_t w = words[i];
+				out[n] = w;
+				n += (w - min <= range) ? 1 : 0;
+			}
+			return n;
+		}
+
+#ifdef OWLCAT_SCAN_SSE42
+		// Same as filter_scalar, 4 words at a time. SSE only has signed 64-bit comparison, so sign bits are flipped
+		OWLCAT_TARGET_SSE42 static size_t filter_sse42(const uintptr_t* words, size_t count, uintptr_t min, uintptr_t max, uintptr_t* out)
+		{
+			const __m128i sign = _mm_set1_epi64x(std::numeric_limits<int64_t>::min());
+			const __m128i vmin = _mm_set1_epi64x((int64_t)min);
+			const __m128i vrange = _mm_xor_si128(_mm_set1_epi64x((int64_t)(max - min)), sign);
+
+			size_t n = 0;
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i*)(words + i));
+				__m128i b = _mm_loadu_si128((const __m128i*)(words + i + 2));
+				__m128i out_a = _mm_cmpgt_epi64(_mm_xor_si128(_mm_sub_epi64(a, vmin), sign), vrange);
+				__m128i out_b = _mm_cmpgt_epi64(_mm_xor_si128(_mm_sub_epi64(b, vmin), sign), vrange);
+				int outside = _mm_movemask_pd(_mm_castsi128_pd(out_a)) | (_mm_movemask_pd(_mm_castsi128_pd(out_b)) << 2);
+				// The common case: none of the words can be a reference
+				if (outside == 0xF)
+					continue;
+
+				for (int j = 0; j < 4; ++j)
+				{
+					if ((outside & (1 << j)) == 0)
+						out[n++] = words[i + j];
+				}
+			}
+
+			return n + filter_scalar(words + i, count - i, min, max, out + n);
+		}
+#endif
+
+		// Collects candidates from a block of aligned words
+		size_t filter(const uintptr_t* words, size_t count, uintptr_t* out) const
+		{
+#ifdef OWLCAT_SCAN_SSE42
+			if (m_use_sse42)
+				return filter_sse42(words, count, m_min, m_max, out);
+#endif
+			return filter_scalar(words, count, m_min, m_max, out);
+		}
+
+		// Drops words that point into memory without any tracked objects
+		size_t filter_pages(uintptr_t* out, size_t n) const
+		{
+			size_t count = 0;
+			for (size_t i = 0; i < n; ++i)
+			{
+				out[count] = out[i];
+				count += m_pages.test(out[i]) ? 1 : 0;
+			}
+			return count;
+		}
+
+		// Collects candidates at every byte offset of [p, p + count + sizeof(uintptr_t) - 1)
+		size_t filter_unaligned(const uint8_t* p, size_t count, uintptr_t* out) const
+		{
+			const uintptr_t range = m_max - m_min;
+			size_t n = 0;
+			for (size_t i = 0; i < count; ++i)
+			{
+				uintptr_t w;
+				memcpy(&w, p + i, sizeof(w));
+				out[n] = w;
+				n += (w - m_min <= range) ? 1 : 0;
+			}
+			return n;
+		}
+
+	public:
+		heap_scanner()
+			: m_use_sse42(cpu_has_sse42())
+		{
+		}
+
+		void set_unaligned(bool unaligned) { m_unaligned = unaligned; }
+
+		// Forgets all tracked objects, so that no word is a candidate until include() is called
+		void reset()
+		{
+			m_min = std::numeric_limits<uintptr_t>::max();
+			m_max = 0;
+			m_pages.clear();
+		}
+
+		// Adds a tracked object address
+		void include(uintptr_t addr)
+		{
+			if (addr < m_min)
+				m_min = addr;
+			if (addr > m_max)
+				m_max = addr;
+			m_pages.set(addr);
+		}
+
+		/*
+			Looks at no more than block_size words of [p, e) and stores those that might be references to tracked objects
+			in out, which must have space for block_size words. Returns the number of candidates, and moves p past the
+			words it looked at. If the memory turns out to be inaccessible, p is moved to e and nothing is returned.
+		*/
+		size_t collect(const uint8_t*& p, const uint8_t* e, uintptr_t* out) const
+		{
+			if (m_min > m_max)
+			{
+				p = e;
+				return 0;
+			}
+
+			const uint8_t* start = p;
+			size_t n = 0;
+#ifdef WIN32
+			__try
+			{
+#endif
+				if (m_unaligned)
+				{
+					size_t count = p + sizeof(uintptr_t) <= e ? (size_t)(e - p) - sizeof(uintptr_t) + 1 : 0;
+					if (count > block_size)
+						count = block_size;
+					n = filter_unaligned(p, count, out);
+					p = count > 0 ? p + count : e;
+				}
+				else
+				{
+					// References are always aligned, but the area may not start at a pointer boundary
+					const uintptr_t mask = sizeof(uintptr_t) - 1;
+					const uintptr_t* words = (const uintptr_t*)(((uintptr_t)start + mask) & ~mask);
+					const uintptr_t* words_end = (const uintptr_t*)((uintptr_t)e & ~mask);
+					size_t count = words < words_end ? (size_t)(words_end - words) : 0;
+					if (count > block_size)
+						count = block_size;
+					n = filter(words, count, out);
+					p = count > 0 ? (const uint8_t*)(words + count) : e;
+				}
+#ifdef WIN32
+			}
+			__except (GetExceptionCode() == EXCEPTION_ACCESS_VIOLATION ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+			{
+				// TODO: Add log?
+				p = e;
+				return 0;
+			}
+#endif
+			return filter_pages(out, n);
+		}
+
+		/*
+			Reads words at base + offsets[i] for i in [0, count), where count <= block_size, and stores those that might be
+			references to tracked objects in out. Offsets are known to hold references (see class_layouts), so they're not
+			checked for alignment, but words that don't fit before e are skipped. Returns the number of candidates, or 0
+			if the memory turns out to be inaccessible.
+		*/
+		size_t collect_slots(const uint8_t* base, const uint8_t* e, const uint32_t* offsets, size_t count, uintptr_t* out) const
+		{
+			if (m_min > m_max)
+				return 0;
+
+			const uintptr_t range = m_max - m_min;
+			size_t n = 0;
+#ifdef WIN32
+			__try
+			{
+#endif
+				for (size_t i = 0; i < count; ++i)
+				{
+					const uint8_t* slot = base + offsets[i];
+					if (slot + sizeof(uintptr_t) > e)
+						break;
+
+					uintptr_t w;
+					memcpy(&w, slot, sizeof(w));
+					out[n] = w;
+					n += (w - m_min <= range) ? 1 : 0;
+				}
+#ifdef WIN32
+			}
+			__except (GetExceptionCode() == EXCEPTION_ACCESS_VIOLATION ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+			{
+				return 0;
+			}
+#endif
+			return filter_pages(out, n);
+		}
+	};
+}
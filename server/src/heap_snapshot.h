@@ -0,0 +1,72 @@
+#pragma once
+
+#include "mono/metadata/profiler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace owlcat
+{
+	/*
+		Immutable copy of the reference graph, published by a full GC pass (see worker_thread::publish_snapshot).
+
+		Reference queries (find_references, root paths, retained sizes...) walk the graph for a long time, and used to do it
+		on live data, holding GC locks so that neither GC nor allocations could change it, which stalled the game. A snapshot
+		is never modified after it's published, so queries run on their own thread, at the same time as allocations and
+		further GC passes, and several of them can share one snapshot. It is freed when the last query that uses it finishes.
+
+		Objects are indexed by their position in the sorted list of addresses, and parents are stored as indices
+		in compressed form: parents of object i are parents[parents_offsets[i]] to parents[parents_offsets[i + 1] - 1].
+		Classes are captured when the snapshot is made, so queries never touch memory of objects, which may be freed by then.
+		Roots are not copied: they can be unregistered and their memory freed at any time, so the few queries that need
+		to read them (root paths) do it under the roots lock.
+	*/
+	struct heap_snapshot
+	{
+		// Index of an object that is not in the snapshot
+		static constexpr uint32_t none = 0xFFFFFFFF;
+
+		enum object_flags : uint8_t
+		{
+			// Object is referenced by a GC root
+			ROOT = 1 << 0,
+			// Object was not reached by GC pass that made the snapshot, and would have been freed by a normal pass
+			DELETED = 1 << 1,
+		};
+
+		// Frame of GC pass that made the snapshot
+		uint64_t frame = 0;
+		// Increases with every published snapshot
+		uint64_t version = 0;
+		// App was paused during the whole GC pass that made the snapshot, so it stays exact until the app is resumed
+		bool paused = false;
+
+		// Sorted
+		std::vector<uint64_t> addresses;
+		std::vector<uint32_t> sizes;
+		std::vector<uint8_t> flags;
+		std::vector<MonoClass*> classes;
+
+		std::vector<uint32_t> parents_offsets;
+		std::vector<uint32_t> parents;
+
+		uint32_t size() const { return (uint32_t)addresses.size(); }
+
+		// Returns index of the object at the specified address, or none
+		uint32_t find(uint64_t addr) const
+		{
+			auto iter = std::lower_bound(addresses.begin(), addresses.end(), addr);
+			if (iter == addresses.end() || *iter != addr)
+				return none;
+
+			return (uint32_t)(iter - addresses.begin());
+		}
+
+		bool flag(uint32_t index, object_flags f) const { return (flags[index] & f) != 0; }
+
+		const uint32_t* parents_begin(uint32_t index) const { return parents.data() + parents_offsets[index]; }
+		const uint32_t* parents_end(uint32_t index) const { return parents.data() + parents_offsets[index + 1]; }
+		uint32_t get_parents_count(uint32_t index) const { return parents_offsets[index + 1] - parents_offsets[index]; }
+	};
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+namespace owlcat
+{
+	/*
+		Destination of protocol messages produced by the events sink: a connected client, or a trace file when
+		the server records without one (see trace_file_writer)
+	*/
+	class message_output
+	{
+	public:
+		virtual ~message_output() {}
+
+		// Returns true if messages written now will reach their destination
+		virtual bool is_connected() const = 0;
+		virtual void write_message(uint8_t type, uint32_t length, const uint8_t* data) = 0;
+	};
+}
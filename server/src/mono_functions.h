@@ -75,6 +75,35 @@ namespace owlcat
 		typedef unsigned int (CALLING_CONV* ObjectGetSize)(MonoObject*);
 		extern mono_func<ObjectGetSize> object_get_size;
 
+		// Functions used to find out where objects of a class store references (see class_layouts).
+		// They're optional: if any of them is not found, objects are scanned conservatively.
+		typedef MonoClassField* (CALLING_CONV* ClassGetFieldsType)(MonoClass* klass, void** iter);
+		extern mono_func<ClassGetFieldsType> class_get_fields;
+		typedef MonoType* (CALLING_CONV* FieldGetTypeType)(MonoClassField*);
+		extern mono_func<FieldGetTypeType> field_get_type;
+		typedef uint32_t (CALLING_CONV* FieldGetUIntType)(MonoClassField*);
+		extern mono_func<FieldGetUIntType> field_get_offset;
+		extern mono_func<FieldGetUIntType> field_get_flags;
+		typedef int (CALLING_CONV* TypeGetTypeType)(MonoType*);
+		extern mono_func<TypeGetTypeType> type_get_type;
+		typedef MonoClass* (CALLING_CONV* ClassFromTypeType)(MonoType*);
+		extern mono_func<ClassFromTypeType> class_from_type;
+		typedef MonoClass* (CALLING_CONV* ClassGetClassType)(MonoClass*);
+		extern mono_func<ClassGetClassType> class_get_parent;
+		extern mono_func<ClassGetClassType> class_get_element_class;
+		typedef int (CALLING_CONV* ClassGetIntType)(MonoClass*);
+		extern mono_func<ClassGetIntType> class_get_rank;
+		extern mono_func<ClassGetIntType> class_array_element_size;
+		// Returns mono_bool in Mono and bool in IL2CPP. Only the lowest byte is meaningful in both cases
+		typedef bool (CALLING_CONV* ClassIsValueType)(MonoClass*);
+		extern mono_func<ClassIsValueType> class_is_valuetype;
+
+		// Functions used to find out the assembly of a class for type filter. Optional, too
+		typedef MonoImage* (CALLING_CONV* ClassGetImageType)(MonoClass*);
+		extern mono_func<ClassGetImageType> class_get_image;
+		typedef const char* (CALLING_CONV* ImageGetNameType)(MonoImage*);
+		extern mono_func<ImageGetNameType> image_get_name;
+
 		typedef void (*register_object_callback)(void* arr, int size, void* callback_userdata);
 		typedef void (*WorldStateChanged)();
 		struct LivenessState;
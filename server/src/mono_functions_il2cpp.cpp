@@ -21,6 +21,20 @@ namespace owlcat
 		mono_func<MethodGetClassType> method_get_class("il2cpp_method_get_class");
 		mono_func<ObjectGetClassType> object_get_class("il2cpp_object_get_class");
 		mono_func<ObjectGetSize> object_get_size("il2cpp_object_get_size");
+
+		mono_func<ClassGetFieldsType> class_get_fields("il2cpp_class_get_fields");
+		mono_func<FieldGetTypeType> field_get_type("il2cpp_field_get_type");
+		mono_func<FieldGetUIntType> field_get_offset("il2cpp_field_get_offset");
+		mono_func<FieldGetUIntType> field_get_flags("il2cpp_field_get_flags");
+		mono_func<TypeGetTypeType> type_get_type("il2cpp_type_get_type");
+		mono_func<ClassFromTypeType> class_from_type("il2cpp_class_from_type");
+		mono_func<ClassGetClassType> class_get_parent("il2cpp_class_get_parent");
+		mono_func<ClassGetClassType> class_get_element_class("il2cpp_class_get_element_class");
+		mono_func<ClassGetIntType> class_get_rank("il2cpp_class_get_rank");
+		mono_func<ClassGetIntType> class_array_element_size("il2cpp_class_array_element_size");
+		mono_func<ClassIsValueType> class_is_valuetype("il2cpp_class_is_valuetype");
+		mono_func<ClassGetImageType> class_get_image("il2cpp_class_get_image");
+		mono_func<ImageGetNameType> image_get_name("il2cpp_image_get_name");
 		
 		mono_func<BeginLivenessCalculation> begin_liveness_calculation("il2cpp_unity_liveness_calculation_begin");
 		mono_func<EndLivenessCalculation> end_liveness_calculation("il2cpp_unity_liveness_calculation_end");
@@ -4,7 +4,9 @@
 #include <string>
 #include <queue>
 #include <mutex>
+#include <atomic>
 #include <thread>
+#include <chrono>
 #include <functional>
 #include <unordered_map>
 
@@ -67,13 +69,83 @@ namespace owlcat
 		// A sink for reporting events to client. mono_profiler_server is reponsible for creating and destroying it
 		events_sink* m_events_sink;
 
-		// Current frame
-		uint64_t m_frame_index = 0;
+		// Settings the profiler was started with
+		mono_profiler_options m_options;
+		// True if all functions needed to resolve class layouts were found
+		bool m_layout_functions_found = false;
 
-		// A mutex to prevent two allocations being reported concurrently from different threads (this leads to wrong frame number order in sequential allocations)
-		std::mutex m_add_alloc_mutex;
+		// Current frame. Allocations are not serialized, so worker_thread takes care of keeping frames in order
+		std::atomic<uint64_t> m_frame_index{ 0 };
+
+		// Pseudo-GC statistics accumulated since they were logged last time. GC may be triggered by any thread,
+		// while they're logged on the main one
+		struct gc_log
+		{
+			size_t full = 0;
+			size_t incremental = 0;
+			double time = 0;
+			double max_time = 0;
+			// Sums over all passes, except for the last pass's state of objects, callstacks and roots
+			worker_thread::gc_stats stats;
+		};
+		gc_log m_gc_log;
+		std::mutex m_gc_log_mutex;
+		// GC statistics are logged at most once per this interval
+		static constexpr std::chrono::seconds gc_log_interval{ 10 };
+		std::chrono::steady_clock::time_point m_gc_log_time = std::chrono::steady_clock::now();
+
+		// Logs statistics of pseudo-GCs since the previous call, if there were any
+		void log_gc_stats()
+		{
+			gc_log log;
+			{
+				std::scoped_lock lock(m_gc_log_mutex);
+				log = m_gc_log;
+				m_gc_log = gc_log();
+			}
+
+			size_t count = log.full + log.incremental;
+			if (count == 0)
+				return;
+
+			auto& stats = log.stats;
+			char tmp[256];
+			sprintf(tmp, "%zu GCs (%zu full) took %fs, at most %fs. %zu objects scanned, %f per object. %zu young, %zu freed, %zu live",
+				count, log.full, log.time, log.max_time, stats.scanned, log.time / std::max<size_t>(stats.scanned, 1),
+				stats.young, stats.freed, stats.live);
+			m_logger.log_str(tmp);
+			if (log.incremental != 0)
+			{
+				sprintf(tmp, "%zu old objects checked, %zu modified", stats.checked, stats.modified);
+				m_logger.log_str(tmp);
+			}
+			sprintf(tmp, "%zu objects of unknown layout scanned conservatively", stats.conservative);
+			m_logger.log_str(tmp);
+
+			sprintf(tmp, "Callstacks: %zu distinct, %llu hits, %llu misses", stats.callstacks.count,
+				(unsigned long long)stats.callstacks.hits, (unsigned long long)stats.callstacks.misses);
+			m_logger.log_str(tmp);
+
+			for (int source = 0; source < root_registry::sources_count; ++source)
+			{
+				auto& s = stats.roots.sources[source];
+				if (s.registered == 0)
+					continue;
+				sprintf(tmp, "Roots (%s): %llu areas, %llu bytes, %llu registered, %llu unregistered", root_registry::get_source_name(source),
+					(unsigned long long)s.count, (unsigned long long)s.bytes, (unsigned long long)s.registered, (unsigned long long)s.unregistered);
+				m_logger.log_str(tmp);
+			}
+		}
 
 	private:
+		// Settings for worker thread, with features we can't support disabled
+		mono_profiler_options get_worker_options() const
+		{
+			mono_profiler_options options = m_options;
+			options.precise_scan = options.precise_scan && m_layout_functions_found;
+			return options;
+		}
+
 		void on_shutdown()
 		{
 		}
@@ -81,8 +153,6 @@ namespace owlcat
 		// Callback for allocation events
 		void on_allocation(MonoObject* obj, MonoClass* klass)
 		{
-			std::scoped_lock items_lock(m_add_alloc_mutex);
-
 			m_processing_thread->add_allocation_async(m_frame_index, klass, obj);
 		}
 
@@ -93,13 +163,25 @@ namespace owlcat
 				return;
 
 			auto t1 = std::chrono::high_resolution_clock::now();
-			int iterations = m_processing_thread->do_gc_sync(m_frame_index, false);
+			auto stats = m_processing_thread->do_gc_sync(m_frame_index, false);
 			auto t2 = std::chrono::high_resolution_clock::now();
 
+			// Game is stalled while we're here, so statistics are only accumulated, and on_frame logs them
 			std::chrono::duration<double> diff = t2 - t1;
-			char tmp[256];
-			sprintf(tmp, "GC took %fs. %i iterations, %f per iter", diff.count(), iterations, diff.count()/iterations);
-			m_logger.log_str(tmp);
+			std::scoped_lock lock(m_gc_log_mutex);
+			m_gc_log.time += diff.count();
+			m_gc_log.max_time = std::max(m_gc_log.max_time, diff.count());
+			++(stats.full ? m_gc_log.full : m_gc_log.incremental);
+			auto& sum = m_gc_log.stats;
+			sum.scanned += stats.scanned;
+			sum.conservative += stats.conservative;
+			sum.checked += stats.checked;
+			sum.modified += stats.modified;
+			sum.young += stats.young;
+			sum.freed += stats.freed;
+			sum.live = stats.live;
+			sum.callstacks = stats.callstacks;
+			sum.roots = stats.roots;
 		}
 		
 		// Callback for root registration
@@ -108,7 +190,7 @@ namespace owlcat
 			//char tmp[1024];
 			//sprintf(tmp, "Add: source=%i %p %I64u %s", source, start, size, name);
 			//m_logger.log_str(tmp);
-			m_processing_thread->register_root((const char*)start, size);
+			m_processing_thread->register_root((const char*)start, size, source);
 		}
 
 		// Callback for root unregistration
@@ -139,8 +221,9 @@ namespace owlcat
 				return false;
 
 			m_logger.log_str("restarting profiling");
+			log_gc_stats();
 			m_processing_thread->stop();
-			m_processing_thread = std::make_unique<worker_thread>(m_events_sink);
+			m_processing_thread = std::make_unique<worker_thread>(m_events_sink, get_worker_options());
 			m_processing_thread->start();
 
 			return true;
@@ -170,7 +253,47 @@ namespace owlcat
 				//begin_liveness_calculation.init(module_mono, m_logger) &&
 				//end_liveness_calculation.init(module_mono, m_logger) &&
 				//calculate_liveness_from_statics.init(module_mono, m_logger) &&
-				true;
+				setup_layout_functions() &&
+				setup_filter_functions();
+		}
+
+		// Finds optional functions used for precise scanning of objects. Returns true even if some are missing
+		bool setup_layout_functions()
+		{
+			library* module_mono = m_module_mono.get();
+
+			m_layout_functions_found =
+				class_get_fields.init(module_mono, m_logger) &&
+				field_get_type.init(module_mono, m_logger) &&
+				field_get_offset.init(module_mono, m_logger) &&
+				field_get_flags.init(module_mono, m_logger) &&
+				type_get_type.init(module_mono, m_logger) &&
+				class_from_type.init(module_mono, m_logger) &&
+				class_get_parent.init(module_mono, m_logger) &&
+				class_get_element_class.init(module_mono, m_logger) &&
+				class_get_rank.init(module_mono, m_logger) &&
+				class_array_element_size.init(module_mono, m_logger) &&
+				class_is_valuetype.init(module_mono, m_logger);
+
+			if (!m_layout_functions_found)
+				m_logger.log_str("Functions needed for precise scanning were not found, objects will be scanned conservatively");
+
+			return true;
+		}
+
+		// Finds optional functions used by type filter to match assemblies. Returns true even if some are missing
+		bool setup_filter_functions()
+		{
+			library* module_mono = m_module_mono.get();
+
+			bool found =
+				class_get_image.init(module_mono, m_logger) &&
+				image_get_name.init(module_mono, m_logger);
+
+			if (!found)
+				m_logger.log_str("Functions needed to find assemblies of classes were not found, assembly filters won't match anything");
+
+			return true;
 		}
 
 		void init(mono_profiler* profiler)
@@ -252,7 +375,7 @@ namespace owlcat
 				});
 #endif
 			// 7. Start worker thread that stores allocations in memory (it does a lot of heavy lifting with strings and containers, so we run it in another thread)
-			m_processing_thread = std::make_unique<worker_thread>(m_events_sink);
+			m_processing_thread = std::make_unique<worker_thread>(m_events_sink, get_worker_options());
 			m_processing_thread->start();
 		}
 	};
@@ -262,8 +385,10 @@ namespace owlcat
 		m_details = new details(sink);
 	}
 
-	bool mono_profiler::start()
+	bool mono_profiler::start(const mono_profiler_options& options)
 	{
+		m_details->m_options = options;
+
 		// If the start is called the second time, we don't need to do anything, but
 		// restart the worker thread
 		if (m_details->try_restart_profiling())
@@ -309,19 +434,40 @@ namespace owlcat
 	void mono_profiler::on_frame()
 	{
 		++m_details->m_frame_index;
+
+		auto now = std::chrono::steady_clock::now();
+		if (now - m_details->m_gc_log_time >= details::gc_log_interval)
+		{
+			m_details->log_gc_stats();
+			m_details->m_gc_log_time = now;
+		}
 	}
 
 	void mono_profiler::find_references(uint64_t request_id, const std::vector<uint64_t>& addresses)
 	{
-		if (m_details->m_processing_thread->is_paused())
-		{
-			m_details->m_processing_thread->find_references(request_id, addresses, m_details->m_frame_index);
-		}
-		else
-		{
-			std::scoped_lock items_lock(m_details->m_add_alloc_mutex);
-			m_details->m_processing_thread->find_references(request_id, addresses, m_details->m_frame_index);
-		}
+		m_details->m_processing_thread->find_references(request_id, addresses, m_details->m_frame_index);
+	}
+
+	void mono_profiler::find_references_page(uint64_t request_id, const std::vector<uint64_t>& addresses, bool parents, uint64_t cursor, uint32_t page_size)
+	{
+		m_details->m_processing_thread->find_references_page(request_id, addresses, parents, cursor, page_size, m_details->m_frame_index);
+	}
+
+	void mono_profiler::find_root_paths(uint64_t request_id, uint64_t addr, uint32_t max_paths, uint32_t max_nodes, uint32_t timeout_ms)
+	{
+		m_details->m_processing_thread->find_root_paths(request_id, addr, max_paths, max_nodes, timeout_ms, m_details->m_frame_index);
+	}
+
+	void mono_profiler::get_retained_sizes(uint64_t request_id, uint32_t max_objects)
+	{
+		m_details->m_processing_thread->get_retained_sizes(request_id, max_objects, m_details->m_frame_index);
+	}
+
+	void mono_profiler::dump_heap(uint64_t request_id, const std::string& path)
+	{
+		m_details->m_logger.log_str(("Dumping heap to " + path).c_str());
+
+		m_details->m_processing_thread->dump_heap(request_id, path, m_details->m_frame_index);
 	}
 
 	void mono_profiler::pause_app(uint64_t request_id)
@@ -333,4 +479,22 @@ namespace owlcat
 	{
 		m_details->m_processing_thread->resume_app(request_id);
 	}
+
+	void mono_profiler::set_type_filter(const std::vector<protocol::filter_rule>& rules)
+	{
+		char tmp[256];
+		sprintf(tmp, "Type filter set: %zu rules", rules.size());
+		m_details->m_logger.log_str(tmp);
+
+		m_details->m_processing_thread->set_type_filter(rules);
+	}
+
+	void mono_profiler::set_stopwords(const std::vector<std::string>& stopwords)
+	{
+		char tmp[256];
+		sprintf(tmp, "Stop-list set: %zu words", stopwords.size());
+		m_details->m_logger.log_str(tmp);
+
+		m_details->m_processing_thread->set_stopwords(stopwords);
+	}
 }
@@ -4,6 +4,9 @@
 #include <string>
 #include <vector>
 
+#include "mono_profiler_server.h"
+#include "network.h"
+
 namespace owlcat
 {
 	/*
@@ -25,16 +28,145 @@ namespace owlcat
 	};
 
 	/*
-		Interface used by profiler to report events and send responses to commands
+		A page of objects grouped by type, see mono_profiler::find_references_page
+	*/
+	struct references_page_t
+	{
+		struct group
+		{
+			// Type name, with " (Root)" or " (Deleted)" marks
+			std::string type;
+			// Number of objects of this group in all pages
+			uint64_t count = 0;
+			// Objects of this group in the page, sorted
+			std::vector<uint64_t> addresses;
+			// Total number of parents of objects in the page
+			uint64_t parents_count = 0;
+		};
+
+		// Frame of the snapshot the answer comes from. Objects allocated and references made after it are not there
+		uint64_t frame = 0;
+		// Number of objects in all pages
+		uint64_t total_count = 0;
+		// Cursor of the next page, 0 if this page is the last one
+		uint64_t next_cursor = 0;
+		// Requested cursor belongs to a list that is no longer kept, and the page is empty. Pages must be requested again from cursor 0
+		bool restart = false;
+		// Sorted by type name. Only the first and the last group may continue in other pages
+		std::vector<group> groups;
+	};
+
+	/*
+		A chain of references that keeps an object alive, from an object referenced by a GC root to the object itself
+	*/
+	struct root_path_t
+	{
+		struct hop
+		{
+			uint64_t addr;
+			// Full type name
+			std::string type;
+		};
+
+		// Name of the root source (see root_registry::get_source_name), or "unknown" if the root slot was not found
+		std::string root_source;
+		// Address of the root memory that references the first object, 0 if not found
+		uint64_t root_slot = 0;
+		// The first hop is referenced by the root, the last one is the requested object
+		std::vector<hop> hops;
+	};
+
+	/*
+		Retained sizes of objects and types, computed from dominator tree of the heap (see dominator_tree.h)
+	*/
+	struct retained_sizes_t
+	{
+		struct type_info
+		{
+			// Full type name
+			std::string name;
+			uint64_t count = 0;
+			// Total size of objects of this type
+			uint64_t size = 0;
+			// Total retained size of objects of this type, without objects dominated by objects of the same type
+			uint64_t retained = 0;
+		};
+
+		struct object_info
+		{
+			uint64_t addr;
+			// Index in types, or 0xFFFFFFFF if type of the object is unknown
+			uint32_t type_index;
+			uint64_t size;
+			uint64_t retained;
+		};
+
+		// Frame of the snapshot the answer comes from. Objects allocated and references made after it are not there
+		uint64_t frame = 0;
+		// Sorted by retained size, largest first
+		std::vector<type_info> types;
+		// Objects with the largest retained sizes, largest first
+		std::vector<object_info> objects;
+	};
+
+	/*
+		An object freed by GC
+	*/
+	struct freed_object
+	{
+		uint64_t addr;
+		uint32_t size;
+	};
+
+	/*
+		Numbers of objects that were allocated and freed without being sampled, see mono_profiler_options::sampling_interval
+	*/
+	struct unsampled_totals
+	{
+		uint64_t allocs = 0;
+		uint64_t alloc_bytes = 0;
+		uint64_t frees = 0;
+		uint64_t freed_bytes = 0;
+
+		bool empty() const { return allocs == 0 && frees == 0; }
+	};
+
+	/*
+		Interface used by profiler to report events and send responses to commands.
+
+		Methods, types and callstacks are interned by the profiler: each one is reported once per session with
+		report_method/report_type/report_callstack, and everything else only refers to them by ID. A session is a single
+		connection with a client. When get_session() returns a value different from the previous one, all definitions
+		are reported again. Sink may delay sending definitions, but must send them before events that use them.
 	*/
 	class events_sink
 	{
 	public:
-		virtual void report_alloc(uint64_t frame, uint64_t addr, uint32_t size, const char* full_name, const char* callstack) = 0;
+		// Returns ID of the current session, or 0 if nobody listens for events right now
+		virtual uint64_t get_session() = 0;
+		virtual void report_method(uint32_t method_id, const char* name) = 0;
+		virtual void report_type(uint32_t type_id, const char* full_name) = 0;
+		virtual void report_callstack(uint32_t callstack_id, const uint32_t* method_ids, size_t count) = 0;
+		virtual void report_alloc(uint64_t frame, uint64_t addr, uint32_t size, uint32_t type_id, uint32_t callstack_id) = 0;
 		virtual void report_free(uint64_t frame, uint64_t addr, uint32_t size) = 0;
-		virtual void report_references(uint64_t request_id, const std::vector<object_references_t>& references) = 0;
+		// Reports all objects freed by a single GC pass, sorted by address
+		virtual void report_free_batch(uint64_t frame, const std::vector<freed_object>& objects) = 0;
+		// Reports sampling interval in bytes (0 if every allocation is reported). Called at the start of every session
+		virtual void report_sampling(uint64_t interval) = 0;
+		// Reports objects allocated and freed in a frame that were not reported individually
+		virtual void report_unsampled_totals(uint64_t frame, const unsampled_totals& totals) = 0;
+		// Sends all events that were buffered by the sink
+		virtual void flush() = 0;
+		// Reports references found in the snapshot made at the specified frame
+		virtual void report_references(uint64_t request_id, uint64_t frame, const std::vector<object_references_t>& references) = 0;
 		virtual void report_paused(uint64_t request_id, bool ok) = 0;
 		virtual void report_resumed(uint64_t request_id, bool ok) = 0;
+		virtual void report_references_page(uint64_t request_id, const references_page_t& page) = 0;
+		// Reports root paths found in the snapshot made at the specified frame
+		virtual void report_root_paths(uint64_t request_id, uint64_t frame, protocol::root_paths_status status, const std::vector<root_path_t>& paths) = 0;
+		virtual void report_retained_sizes(uint64_t request_id, const retained_sizes_t& sizes) = 0;
+		// Reports result of a heap dump: path of the written file on success, error message otherwise
+		virtual void report_heap_dumped(uint64_t request_id, bool ok, const std::string& message) = 0;
 	};
 
 	/*
@@ -49,15 +181,27 @@ namespace owlcat
 		mono_profiler(events_sink* sink);
 
 		// Starts, or restarts the profiler
-		bool start();
+		bool start(const mono_profiler_options& options);
 		// Notifies the profiler that frame number has changed
 		void on_frame();
 
 		// Finds references to the specified object and reports them back to client with events_sink interface
 		void find_references(uint64_t request_id, const std::vector<uint64_t>& addresses);
+		// Reports page_size objects starting at cursor, either the specified objects themselves, or their parents, grouped by type
+		void find_references_page(uint64_t request_id, const std::vector<uint64_t>& addresses, bool parents, uint64_t cursor, uint32_t page_size);
+		// Finds up to max_paths shortest paths from GC roots to the object, visiting at most max_nodes objects, and reports them back to client
+		void find_root_paths(uint64_t request_id, uint64_t addr, uint32_t max_paths, uint32_t max_nodes, uint32_t timeout_ms);
+		// Computes retained sizes of all types and of max_objects largest objects, and reports them back to client
+		void get_retained_sizes(uint64_t request_id, uint32_t max_objects);
+		// Writes the whole heap state to a local file and reports the result back to client
+		void dump_heap(uint64_t request_id, const std::string& path);
 		// Pauses the profiled application (see implementation for details)
 		void pause_app(uint64_t request_id);
 		// Unpauses the profiled application
 		void resume_app(uint64_t request_id);
+		// Replaces rules that decide which classes are profiled
+		void set_type_filter(const std::vector<protocol::filter_rule>& rules);
+		// Replaces words that exclude callstacks from profiling
+		void set_stopwords(const std::vector<std::string>& stopwords);
 	};
 }
@@ -1,11 +1,15 @@
 #include "mono_profiler_server.h"
 #include "mono_profiler.h"
+#include "message_output.h"
+#include "trace_file_writer.h"
 
 #include "network.h"
 #include "logger.h"
 
+#include <algorithm>
 #include <memory>
 #include <thread>
+#include <cstdlib>
 
 #include <memory_writer.h>
 #include <memory_reader.h>
@@ -19,38 +23,181 @@ namespace owlcat
 	class mono_profiler_server::details
 	{
 		/*
-			Class that handles reporting profiler events to client over network
+			Sends messages to client over network
 		*/
-		class network_events_sink : public events_sink
+		class network_output : public message_output
 		{
 			network& m_network;
 
 		public:
-			network_events_sink(network& network) : m_network(network) {}
+			network_output(network& network) : m_network(network) {}
 
-			virtual void report_alloc(uint64_t frame, uint64_t addr, uint32_t size, const char* full_name, const char* callstack) override
+			virtual bool is_connected() const override { return m_network.is_connected(); }
+			virtual void write_message(uint8_t type, uint32_t length, const uint8_t* data) override { m_network.write_message(type, length, data); }
+		};
+
+		/*
+			Class that handles reporting profiler events as protocol messages, to client over network or to a trace file
+		*/
+		class protocol_events_sink : public events_sink
+		{
+			// Maximum number of allocations sent in a single SRV_ALLOC_BATCH message
+			static const size_t max_batch_size = 4096;
+			// Maximum number of objects sent in a single SRV_FREE_BATCH message
+			static const size_t max_free_batch_size = 65536;
+
+			// Where messages go. Only changed before the profiler is started
+			message_output* m_output = nullptr;
+
+			// Session is incremented every time a new client connects (or a new trace file is opened)
+			uint64_t m_session = 0;
+			bool m_connected = false;
+
+			// Allocations that were not sent yet. All of them happened in m_batch_frame
+			std::vector<protocol::alloc_record> m_batch;
+			uint64_t m_batch_frame = 0;
+
+			/*
+				Definitions that were not sent yet. They are sent in one message per kind right before
+				allocations, so that a lot of new symbols doesn't result in a lot of tiny messages.
+			*/
+			struct pending_definitions
+			{
+				std::vector<uint8_t> data;
+				uint64_t count = 0;
+
+				void clear()
+				{
+					data.clear();
+					count = 0;
+				}
+			};
+			pending_definitions m_methods;
+			pending_definitions m_types;
+			pending_definitions m_callstacks;
+
+			void send_definitions(protocol::message type, pending_definitions& definitions)
 			{
-				if (!m_network.is_connected())
+				if (definitions.count == 0)
 					return;
 
 				static std::vector<uint8_t> data;
-				data.reserve(5 * 1024);
 				data.clear();
 				memory_writer writer(data);
-				writer.write_uint64(frame);
-				writer.write_uint64(addr);
-				writer.write_uint32(size);
-				writer.write_string(full_name);
-				writer.write_string(callstack);
+				writer.write_varint(definitions.count);
+				writer.write_buffer(definitions.data);
+				definitions.clear();
 
-				m_network.write_message(protocol::message::SRV_ALLOC, (uint32_t)data.size(), (uint8_t*)&data[0]);
+				m_output->write_message(type, (uint32_t)data.size(), (uint8_t*)&data[0]);
+			}
+
+			void send_batch()
+			{
+				// Callstacks reference methods, and allocations reference types and callstacks
+				send_definitions(protocol::message::SRV_METHOD_DEF, m_methods);
+				send_definitions(protocol::message::SRV_TYPE_DEF, m_types);
+				send_definitions(protocol::message::SRV_STACK_DEF, m_callstacks);
+
+				if (m_batch.empty())
+					return;
+
+				static std::vector<uint8_t> data;
+				data.reserve(16 + max_batch_size * sizeof(protocol::alloc_record));
+				data.clear();
+				memory_writer writer(data);
+				writer.write_uint64(m_batch_frame);
+				writer.write_varint(m_batch.size());
+				writer.write_buffer((const uint8_t*)m_batch.data(), m_batch.size() * sizeof(protocol::alloc_record));
+				m_batch.clear();
+
+				m_output->write_message(protocol::message::SRV_ALLOC_BATCH, (uint32_t)data.size(), (uint8_t*)&data[0]);
+			}
+
+			void add_definition(pending_definitions& definitions, uint32_t id, const char* text)
+			{
+				if (m_output == nullptr || !m_output->is_connected())
+					return;
+
+				memory_writer writer(definitions.data);
+				writer.write_varint(id);
+				writer.write_string(text);
+				++definitions.count;
+			}
+
+		public:
+			// New output doesn't know anything that was written to the previous one, so it starts a new session
+			void set_output(message_output* output)
+			{
+				m_output = output;
+				m_connected = false;
+			}
+
+			virtual uint64_t get_session() override
+			{
+				if (m_output == nullptr || !m_output->is_connected())
+				{
+					m_connected = false;
+					return 0;
+				}
+
+				// New client doesn't know anything that was sent to the previous one
+				if (!m_connected)
+				{
+					m_connected = true;
+					++m_session;
+					m_batch.clear();
+					m_methods.clear();
+					m_types.clear();
+					m_callstacks.clear();
+				}
+
+				return m_session;
+			}
+
+			virtual void report_method(uint32_t method_id, const char* name) override
+			{
+				add_definition(m_methods, method_id, name);
+			}
+
+			virtual void report_type(uint32_t type_id, const char* full_name) override
+			{
+				add_definition(m_types, type_id, full_name);
+			}
+
+			virtual void report_callstack(uint32_t callstack_id, const uint32_t* method_ids, size_t count) override
+			{
+				if (m_output == nullptr || !m_output->is_connected())
+					return;
+
+				memory_writer writer(m_callstacks.data);
+				writer.write_varint(callstack_id);
+				writer.write_varint(count);
+				for (size_t i = 0; i < count; ++i)
+					writer.write_varint(method_ids[i]);
+				++m_callstacks.count;
+			}
+
+			virtual void report_alloc(uint64_t frame, uint64_t addr, uint32_t size, uint32_t type_id, uint32_t callstack_id) override
+			{
+				if (m_output == nullptr || !m_output->is_connected())
+					return;
+
+				// A batch only holds allocations from a single frame
+				if (frame != m_batch_frame || m_batch.size() >= max_batch_size)
+					send_batch();
+
+				m_batch_frame = frame;
+				m_batch.push_back({ addr, size, type_id, callstack_id });
 			}
 
 			virtual void report_free(uint64_t frame, uint64_t addr, uint32_t size) override
 			{
-				if (!m_network.is_connected())
+				if (m_output == nullptr || !m_output->is_connected())
 					return;
 
+				// Keep the order of events: the object might have been allocated in the pending batch
+				send_batch();
+
 				static std::vector<uint8_t> data;
 				data.reserve(32);
 				data.clear();
@@ -59,12 +206,83 @@ namespace owlcat
 				writer.write_uint64(addr);
 				writer.write_uint32(size);
 
-				m_network.write_message(protocol::message::SRV_FREE, (uint32_t)data.size(), (uint8_t*)&data[0]);
+				m_output->write_message(protocol::message::SRV_FREE, (uint32_t)data.size(), (uint8_t*)&data[0]);
+			}
+
+			virtual void report_free_batch(uint64_t frame, const std::vector<freed_object>& objects) override
+			{
+				if (m_output == nullptr || !m_output->is_connected())
+					return;
+
+				// Keep the order of events: objects might have been allocated in the pending batch
+				send_batch();
+
+				// Objects are sorted, so deltas between addresses are small and take only a few bytes each
+				static std::vector<uint8_t> data;
+				for (size_t first = 0; first < objects.size(); first += max_free_batch_size)
+				{
+					size_t count = std::min(objects.size() - first, max_free_batch_size);
+					data.reserve(16 + count * 8);
+					data.clear();
+					memory_writer writer(data);
+					writer.write_uint64(frame);
+					writer.write_varint(count);
+					uint64_t prev_addr = 0;
+					for (size_t i = first; i < first + count; ++i)
+					{
+						writer.write_varint(objects[i].addr - prev_addr);
+						writer.write_varint(objects[i].size);
+						prev_addr = objects[i].addr;
+					}
+
+					m_output->write_message(protocol::message::SRV_FREE_BATCH, (uint32_t)data.size(), (uint8_t*)&data[0]);
+				}
+			}
+
+			virtual void report_sampling(uint64_t interval) override
+			{
+				if (m_output == nullptr || !m_output->is_connected())
+					return;
+
+				std::vector<uint8_t> data;
+				memory_writer writer(data);
+				writer.write_varint(interval);
+
+				m_output->write_message(protocol::message::SRV_SAMPLING, (uint32_t)data.size(), (uint8_t*)&data[0]);
+			}
+
+			virtual void report_unsampled_totals(uint64_t frame, const unsampled_totals& totals) override
+			{
+				if (m_output == nullptr || !m_output->is_connected())
+					return;
+
+				// Keep the order of events: the pending batch may be from an earlier frame
+				send_batch();
+
+				static std::vector<uint8_t> data;
+				data.reserve(64);
+				data.clear();
+				memory_writer writer(data);
+				writer.write_uint64(frame);
+				writer.write_varint(totals.allocs);
+				writer.write_varint(totals.alloc_bytes);
+				writer.write_varint(totals.frees);
+				writer.write_varint(totals.freed_bytes);
+
+				m_output->write_message(protocol::message::SRV_UNSAMPLED_TOTALS, (uint32_t)data.size(), (uint8_t*)&data[0]);
+			}
+
+			virtual void flush() override
+			{
+				if (m_output == nullptr || !m_output->is_connected())
+					return;
+
+				send_batch();
 			}
 
-			virtual void report_references(uint64_t request_id, const std::vector<object_references_t>& references) override
+			virtual void report_references(uint64_t request_id, uint64_t frame, const std::vector<object_references_t>& references) override
 			{
-				if (!m_network.is_connected())
+				if (m_output == nullptr || !m_output->is_connected())
 					return;
 
 				static std::vector<uint8_t> data;
@@ -73,6 +291,7 @@ namespace owlcat
 				memory_writer writer(data);
 				
 				writer.write_uint64(request_id);
+				writer.write_varint(frame);
 				writer.write_varint(references.size());
 				for (auto& refs : references)
 				{
@@ -83,12 +302,12 @@ namespace owlcat
 						writer.write_varint(parent);
 				}
 
-				m_network.write_message(protocol::message::SRV_REFERENCES, (uint32_t)data.size(), (uint8_t*)&data[0]);
+				m_output->write_message(protocol::message::SRV_REFERENCES, (uint32_t)data.size(), (uint8_t*)&data[0]);
 			}
 
 			virtual void report_paused(uint64_t request_id, bool ok) override
 			{
-				if (!m_network.is_connected())
+				if (m_output == nullptr || !m_output->is_connected())
 					return;
 
 				std::vector<uint8_t> data;
@@ -98,12 +317,117 @@ namespace owlcat
 				writer.write_uint64(request_id);
 				writer.write_uint8(ok ? 0 : 1);
 
-				m_network.write_message(protocol::message::SRV_PAUSE, (uint32_t)data.size(), (uint8_t*)&data[0]);
+				m_output->write_message(protocol::message::SRV_PAUSE, (uint32_t)data.size(), (uint8_t*)&data[0]);
+			}
+
+			virtual void report_references_page(uint64_t request_id, const references_page_t& page) override
+			{
+				if (m_output == nullptr || !m_output->is_connected())
+					return;
+
+				std::vector<uint8_t> data;
+				data.reserve(1024);
+				memory_writer writer(data);
+
+				writer.write_uint64(request_id);
+				writer.write_varint(page.frame);
+				writer.write_uint8(page.restart ? 1 : 0);
+				writer.write_varint(page.total_count);
+				writer.write_varint(page.next_cursor);
+				writer.write_varint(page.groups.size());
+				for (auto& group : page.groups)
+				{
+					writer.write_string(group.type.c_str());
+					writer.write_varint(group.count);
+					writer.write_varint(group.parents_count);
+					writer.write_varint(group.addresses.size());
+					uint64_t prev_addr = 0;
+					for (uint64_t addr : group.addresses)
+					{
+						writer.write_varint(addr - prev_addr);
+						prev_addr = addr;
+					}
+				}
+
+				m_output->write_message(protocol::message::SRV_REFERENCES_PAGE, (uint32_t)data.size(), (uint8_t*)&data[0]);
+			}
+
+			virtual void report_root_paths(uint64_t request_id, uint64_t frame, protocol::root_paths_status status, const std::vector<root_path_t>& paths) override
+			{
+				if (m_output == nullptr || !m_output->is_connected())
+					return;
+
+				std::vector<uint8_t> data;
+				memory_writer writer(data);
+
+				writer.write_uint64(request_id);
+				writer.write_varint(frame);
+				writer.write_uint8((uint8_t)status);
+				writer.write_varint(paths.size());
+				for (auto& path : paths)
+				{
+					writer.write_string(path.root_source.c_str());
+					writer.write_varint(path.root_slot);
+					writer.write_varint(path.hops.size());
+					for (auto& hop : path.hops)
+					{
+						writer.write_varint(hop.addr);
+						writer.write_string(hop.type.c_str());
+					}
+				}
+
+				m_output->write_message(protocol::message::SRV_ROOT_PATHS, (uint32_t)data.size(), (uint8_t*)&data[0]);
+			}
+
+			virtual void report_retained_sizes(uint64_t request_id, const retained_sizes_t& sizes) override
+			{
+				if (m_output == nullptr || !m_output->is_connected())
+					return;
+
+				std::vector<uint8_t> data;
+				data.reserve(1024);
+				memory_writer writer(data);
+
+				writer.write_uint64(request_id);
+				writer.write_varint(sizes.frame);
+				writer.write_varint(sizes.types.size());
+				for (auto& type : sizes.types)
+				{
+					writer.write_string(type.name.c_str());
+					writer.write_varint(type.count);
+					writer.write_varint(type.size);
+					writer.write_varint(type.retained);
+				}
+				writer.write_varint(sizes.objects.size());
+				for (auto& object : sizes.objects)
+				{
+					writer.write_varint(object.addr);
+					writer.write_uint32(object.type_index);
+					writer.write_varint(object.size);
+					writer.write_varint(object.retained);
+				}
+
+				m_output->write_message(protocol::message::SRV_RETAINED_SIZES, (uint32_t)data.size(), (uint8_t*)&data[0]);
+			}
+
+			virtual void report_heap_dumped(uint64_t request_id, bool ok, const std::string& message) override
+			{
+				if (m_output == nullptr || !m_output->is_connected())
+					return;
+
+				std::vector<uint8_t> data;
+				memory_writer writer(data);
+
+				writer.write_uint64(request_id);
+				writer.write_uint8(ok ? 0 : 1);
+				writer.write_string(message.c_str());
+
+				m_output->write_message(protocol::message::SRV_DUMP_HEAP, (uint32_t)data.size(), (uint8_t*)&data[0]);
 			}
 
 			virtual void report_resumed(uint64_t request_id, bool ok) override
 			{
-				if (!m_network.is_connected())
+				if (m_output == nullptr || !m_output->is_connected())
 					return;
 
 				std::vector<uint8_t> data;
@@ -113,12 +437,19 @@ namespace owlcat
 				writer.write_uint64(request_id);
 				writer.write_uint8(ok ? 0 : 1);
 
-				m_network.write_message(protocol::message::SRV_RESUME, (uint32_t)data.size(), (uint8_t*)&data[0]);
+				m_output->write_message(protocol::message::SRV_RESUME, (uint32_t)data.size(), (uint8_t*)&data[0]);
 			}
 		};
 
+		// Maximum number of objects sent in a single SRV_REFERENCES_PAGE message
+		static constexpr uint64_t max_references_page_size = 65536;
+
 		network m_network;
-		network_events_sink m_sink;
+		network_output m_network_output;
+		// Used instead of network when recording without a client, see mono_profiler_options::trace_path
+		trace_file_writer m_trace;
+		std::string m_trace_path;
+		protocol_events_sink m_sink;
 		mono_profiler m_profiler;
 
 		std::thread m_watchdog;
@@ -131,7 +462,7 @@ namespace owlcat
 
 	public:
 		details()
-			: m_sink(m_network)
+			: m_network_output(m_network)
 			, m_profiler(&m_sink)
 		{
 		}
@@ -146,25 +477,19 @@ namespace owlcat
 				m_commands_thread.join();
 
 			m_network.stop();
+			m_trace.close();
 		}
 
 		/*
 			Starts the profiler and networking. If wait_for_connection is true,
 			will block the main thread until connection with client is established.			
+			If options have a trace path, events are recorded to that file instead, and the server doesn't listen at all.
 		*/
-		void start(bool wait_for_connection, int port)
+		void start(bool wait_for_connection, int port, const mono_profiler_options& options)
 		{
 			m_wait_for_connection = wait_for_connection;
 			m_port = port;
 
-			if (!m_network.is_connected())
-			{
-				if (wait_for_connection)
-					m_network.listen_sync(port);
-				else
-					m_network.listen_async(port);
-			}
-
 			// Stop watchdog thread if we're restarting
 			m_stop_watchdog = true;
 			if (m_watchdog.joinable())
@@ -177,6 +502,34 @@ namespace owlcat
 				m_commands_thread.join();
 			m_stop_commands_thread = false;
 
+			if (!options.trace_path.empty())
+			{
+				// Nobody is going to connect, and waiting for a client would block the app forever. If the file can't be
+				// created, the profiler still runs, but reports nothing
+				m_network.stop();
+				// Restart keeps recording into the same file
+				if (options.trace_path != m_trace_path || !m_trace.is_connected())
+				{
+					m_trace_path = options.trace_path;
+					m_trace.open(m_trace_path);
+				}
+				m_sink.set_output(&m_trace);
+				m_profiler.start(options);
+				return;
+			}
+
+			m_trace.close();
+			m_trace_path.clear();
+			m_sink.set_output(&m_network_output);
+
+			if (!m_network.is_connected())
+			{
+				if (wait_for_connection)
+					m_network.listen_sync(port);
+				else
+					m_network.listen_async(port);
+			}
+
 			// Create watchdog thread. It's sole purpose is to watch for network disconnects and enter
 			// listening mode if this happens
 			m_watchdog = std::thread([this]()
@@ -201,7 +554,7 @@ namespace owlcat
 			m_commands_thread = std::thread(&details::process_messages, this);
 
 			// Start the profiler
-			m_profiler.start();
+			m_profiler.start(options);
 		}
 
 		void process_messages()
@@ -209,11 +562,9 @@ namespace owlcat
 			while (!m_stop_commands_thread)
 			{
 				message msg;
-				if (!m_network.read_message(msg))
-				{
-					std::this_thread::yield();
+				// Wake up from time to time to check if we need to stop
+				if (!m_network.wait_message(msg, 100))
 					continue;
-				}
 
 				memory_reader reader(msg.data);
 
@@ -233,6 +584,50 @@ namespace owlcat
 
 					m_profiler.find_references(request_id, adddresses);
 				}
+				else if (msg.header.type == protocol::command::CMD_REFERENCES_PAGE)
+				{
+					uint64_t request_id;
+					uint8_t mode;
+					uint64_t cursor, page_size, count;
+					bool all_ok = reader.read_uint64(request_id) && reader.read_uint8(mode) && reader.read_varint(cursor) && reader.read_varint(page_size) && reader.read_varint(count);
+					std::vector<uint64_t> addresses;
+					for (uint64_t i = 0; i < count && all_ok; ++i)
+					{
+						uint64_t addr;
+						all_ok = reader.read_varint(addr);
+						if (all_ok)
+							addresses.push_back(addr);
+					}
+
+					// Pages are limited, so that a single message never gets too large
+					if (all_ok)
+						m_profiler.find_references_page(request_id, addresses, mode != 0, cursor, (uint32_t)std::min<uint64_t>(std::max<uint64_t>(page_size, 1), max_references_page_size));
+				}
+				else if (msg.header.type == protocol::command::CMD_ROOT_PATHS)
+				{
+					uint64_t request_id;
+					uint64_t addr, max_paths, max_nodes, timeout_ms;
+					if (reader.read_uint64(request_id) && reader.read_varint(addr) && reader.read_varint(max_paths) && reader.read_varint(max_nodes) && reader.read_varint(timeout_ms))
+					{
+						auto clamp = [](uint64_t value) { return (uint32_t)std::min<uint64_t>(value, 0xFFFFFFFF); };
+						// The requested object itself takes one node of the budget
+						m_profiler.find_root_paths(request_id, addr, clamp(max_paths), clamp(std::max<uint64_t>(max_nodes, 1)), clamp(timeout_ms));
+					}
+				}
+				else if (msg.header.type == protocol::command::CMD_RETAINED_SIZES)
+				{
+					uint64_t request_id;
+					uint64_t max_objects;
+					if (reader.read_uint64(request_id) && reader.read_varint(max_objects))
+						m_profiler.get_retained_sizes(request_id, (uint32_t)std::min<uint64_t>(max_objects, 0xFFFFFFFF));
+				}
+				else if (msg.header.type == protocol::command::CMD_DUMP_HEAP)
+				{
+					uint64_t request_id;
+					std::string path;
+					if (reader.read_uint64(request_id) && reader.read_string(path))
+						m_profiler.dump_heap(request_id, path);
+				}
 				else if (msg.header.type == protocol::command::CMD_PAUSE)
 				{
 					uint64_t request_id;
@@ -247,6 +642,45 @@ namespace owlcat
 
 					m_profiler.resume_app(request_id);
 				}
+				else if (msg.header.type == protocol::command::CMD_SET_FILTER)
+				{
+					uint64_t count;
+					bool all_ok = reader.read_varint(count);
+					std::vector<protocol::filter_rule> rules;
+					for (uint64_t i = 0; i < count && all_ok; ++i)
+					{
+						uint8_t target;
+						uint8_t include;
+						std::string pattern;
+						all_ok =
+							reader.read_uint8(target) &&
+							reader.read_uint8(include) &&
+							reader.read_string(pattern);
+
+						if (all_ok)
+							rules.push_back({ (protocol::filter_target)target, include != 0, pattern });
+					}
+
+					// Applying a part of rules would profile something the client didn't ask for
+					if (all_ok)
+						m_profiler.set_type_filter(rules);
+				}
+				else if (msg.header.type == protocol::command::CMD_SET_STOPWORDS)
+				{
+					uint64_t count;
+					bool all_ok = reader.read_varint(count);
+					std::vector<std::string> stopwords;
+					for (uint64_t i = 0; i < count && all_ok; ++i)
+					{
+						std::string word;
+						all_ok = reader.read_string(word);
+						if (all_ok)
+							stopwords.push_back(word);
+					}
+
+					if (all_ok)
+						m_profiler.set_stopwords(stopwords);
+				}
 			}
 		}
 
@@ -257,6 +691,7 @@ namespace owlcat
 				m_watchdog.join();
 
 			m_network.stop();			
+			m_trace.close();
 		}
 
 		void on_frame()
@@ -265,6 +700,42 @@ namespace owlcat
 		}
 	};
 
+	// Reads an unsigned integer from environment variable, leaving the value unchanged if the variable is not set
+	static void read_env_option(const char* name, unsigned& value)
+	{
+		const char* str = getenv(name);
+		if (str != nullptr && *str != 0)
+			value = (unsigned)strtoul(str, nullptr, 10);
+	}
+
+	// Reads a boolean from environment variable as a number, leaving the value unchanged if the variable is not set
+	static void read_env_option(const char* name, bool& value)
+	{
+		unsigned number = value ? 1 : 0;
+		read_env_option(name, number);
+		value = number != 0;
+	}
+
+	// Reads a string from environment variable, leaving the value unchanged if the variable is not set
+	static void read_env_option(const char* name, std::string& value)
+	{
+		const char* str = getenv(name);
+		if (str != nullptr && *str != 0)
+			value = str;
+	}
+
+	mono_profiler_options mono_profiler_options::from_environment()
+	{
+		mono_profiler_options options;
+		read_env_option("OWLCAT_PROFILER_GC_THREADS", options.gc_threads);
+		read_env_option("OWLCAT_PROFILER_FULL_GC_INTERVAL", options.full_gc_interval);
+		read_env_option("OWLCAT_PROFILER_UNALIGNED_SCAN", options.unaligned_scan);
+		read_env_option("OWLCAT_PROFILER_PRECISE_SCAN", options.precise_scan);
+		read_env_option("OWLCAT_PROFILER_SAMPLING_INTERVAL", options.sampling_interval);
+		read_env_option("OWLCAT_PROFILER_TRACE_PATH", options.trace_path);
+		return options;
+	}
+
 	mono_profiler_server::mono_profiler_server()
 	{
 		m_details = new details();
@@ -275,9 +746,9 @@ namespace owlcat
 		delete m_details;
 	}
 
-	void mono_profiler_server::start(bool wait_for_connection, int port)
+	void mono_profiler_server::start(bool wait_for_connection, int port, const mono_profiler_options& options)
 	{
-		m_details->start(wait_for_connection, port);
+		m_details->start(wait_for_connection, port, options);
 	}
 
 	void mono_profiler_server::stop()
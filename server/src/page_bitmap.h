@@ -0,0 +1,88 @@
+#pragma once
+
+#include "counting_allocator.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace owlcat
+{
+	/*
+		Set of memory pages that contain at least one tracked object, used to reject words that can't be
+		references before probing the allocations table.
+
+		Most words found by conservative scanning are small numbers, floats or pointers to native memory. Heap bounds
+		check (see heap_scanner) rejects most of them, but Boehm's heap sections are scattered across the address space,
+		so the bounds also cover a lot of memory with no managed objects at all. A miss in the allocations table costs
+		a cache miss, while the bits of pages that hold the heap fit in cache: 32 KB of bitmap covers 1 GB of heap.
+
+		It's a two-level table: the top level splits 48-bit address space into 4 GB regions, and bitmap of a region
+		is allocated when the first object in it is added. Bits are never cleared one by one, because we don't count
+		objects on each page. Instead, the whole set is rebuilt from surviving objects after a GC pass frees something.
+	*/
+	class page_bitmap
+	{
+	public:
+		static constexpr int page_shift = 12;
+
+	private:
+		static constexpr int region_shift = 32;
+		static constexpr int address_bits = 48;
+		static constexpr size_t regions_count = size_t(1) << (address_bits - region_shift);
+		static constexpr size_t words_per_region = (size_t(1) << (region_shift - page_shift)) / 64;
+
+		using region_bits = std::vector<uint64_t, counting_allocator<uint64_t>>;
+
+		// Bits of each region, or nullptr if it doesn't have any tracked objects
+		std::vector<uint64_t*> m_regions;
+		// Storage for allocated regions
+		std::vector<region_bits> m_storage;
+
+	public:
+		page_bitmap()
+			: m_regions(regions_count, nullptr)
+		{
+		}
+
+		// Marks page that contains the address
+		void set(uint64_t addr)
+		{
+			uint64_t region = addr >> region_shift;
+			if (region >= regions_count)
+				return;
+
+			uint64_t*& bits = m_regions[region];
+			if (bits == nullptr)
+			{
+				m_storage.emplace_back(words_per_region, 0);
+				bits = m_storage.back().data();
+			}
+
+			uint64_t page = (addr & ((uint64_t(1) << region_shift) - 1)) >> page_shift;
+			bits[page / 64] |= uint64_t(1) << (page % 64);
+		}
+
+		// Checks if page that contains the address has any tracked objects
+		bool test(uint64_t addr) const
+		{
+			uint64_t region = addr >> region_shift;
+			if (region >= regions_count)
+				return false;
+
+			const uint64_t* bits = m_regions[region];
+			if (bits == nullptr)
+				return false;
+
+			uint64_t page = (addr & ((uint64_t(1) << region_shift) - 1)) >> page_shift;
+			return (bits[page / 64] & (uint64_t(1) << (page % 64))) != 0;
+		}
+
+		// Clears all bits. Memory of regions is kept, as they're likely to be used again
+		void clear()
+		{
+			for (auto& bits : m_storage)
+				memset(bits.data(), 0, bits.size() * sizeof(uint64_t));
+		}
+	};
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "counting_allocator.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+namespace owlcat
+{
+	/*
+		Compact storage for "object is referenced by parent" edges found by GC.
+
+		Storing a vector of parents in every allocation costs us a lot of memory (even an empty vector
+		is 24 bytes) and millions of small heap allocations per GC. Instead, GC appends edges to a single
+		flat array during the mark phase. The array is sorted by child address only when someone actually
+		needs to look parents up (i.e. when the client requests references), after which parents of an
+		object form a contiguous range found with a binary search.
+
+		The array is rebuilt from scratch on every GC pass. Parallel GC gives each marking thread its own
+		chunk to append to, and chunks are merged together by build().
+	*/
+	class parent_edges
+	{
+	public:
+		struct edge
+		{
+			uint64_t child;
+			uint64_t parent;
+
+			bool operator<(const edge& other) const
+			{
+				return child < other.child || (child == other.child && parent < other.parent);
+			}
+		};
+
+		/*
+			A range of parents of a single object
+		*/
+		class parents_range
+		{
+			const edge* m_begin;
+			const edge* m_end;
+
+		public:
+			class iterator
+			{
+				const edge* m_edge;
+			public:
+				using iterator_category = std::forward_iterator_tag;
+				using value_type = uint64_t;
+				using difference_type = std::ptrdiff_t;
+				using pointer = const uint64_t*;
+				using reference = uint64_t;
+
+				iterator(const edge* e) : m_edge(e) {}
+				uint64_t operator*() const { return m_edge->parent; }
+				iterator& operator++() { ++m_edge; return *this; }
+				bool operator!=(const iterator& other) const { return m_edge != other.m_edge; }
+				bool operator==(const iterator& other) const { return m_edge == other.m_edge; }
+			};
+
+			parents_range(const edge* b, const edge* e) : m_begin(b), m_end(e) {}
+
+			iterator begin() const { return iterator(m_begin); }
+			iterator end() const { return iterator(m_end); }
+			size_t size() const { return m_end - m_begin; }
+			bool empty() const { return m_begin == m_end; }
+		};
+
+	private:
+		using edges_vector = std::vector<edge, counting_allocator<edge>>;
+
+		// Sorted edges, valid after build()
+		edges_vector m_edges;
+		// Unsorted edges, one chunk per writer
+		std::vector<edges_vector> m_chunks;
+		bool m_sorted = true;
+
+	public:
+		// Removes all edges and prepares storage for the specified number of concurrent writers.
+		// Memory of chunks is kept to be reused by the next GC pass.
+		void clear(size_t writers = 1)
+		{
+			m_edges.clear();
+			m_chunks.resize(writers);
+			for (auto& chunk : m_chunks)
+				chunk.clear();
+			m_sorted = true;
+		}
+
+		// Records that parent object holds a reference to child object. Different threads
+		// may call this function at the same time, as long as they use different writer indices.
+		void add(uint64_t child, uint64_t parent, size_t writer = 0)
+		{
+			m_chunks[writer].push_back({ child, parent });
+		}
+
+		// Sorts edges by child, so that parents can be looked up. Does nothing if edges are already sorted
+		void build()
+		{
+			for (auto& chunk : m_chunks)
+			{
+				if (chunk.empty())
+					continue;
+
+				if (m_edges.empty())
+					m_edges.swap(chunk);
+				else
+				{
+					m_edges.insert(m_edges.end(), chunk.begin(), chunk.end());
+					chunk.clear();
+				}
+				m_sorted = false;
+			}
+
+			if (m_sorted)
+				return;
+
+			std::sort(m_edges.begin(), m_edges.end());
+			m_edges.erase(std::unique(m_edges.begin(), m_edges.end(), [](const edge& a, const edge& b) { return a.child == b.child && a.parent == b.parent; }), m_edges.end());
+			m_sorted = true;
+		}
+
+		// Returns number of edges. Only exact after build()
+		size_t size() const { return m_edges.size(); }
+
+		// Calls f(child, parent) for every edge, in order of children. build() must be called after the last add() call
+		template<typename F>
+		void for_each(F f) const
+		{
+			for (auto& e : m_edges)
+				f(e.child, e.parent);
+		}
+
+		// Returns parents of the specified object. build() must be called after the last add() call
+		parents_range get_parents(uint64_t child) const
+		{
+			auto first = std::lower_bound(m_edges.begin(), m_edges.end(), edge{ child, 0 });
+			auto last = first;
+			while (last != m_edges.end() && last->child == child)
+				++last;
+
+			const edge* data = m_edges.data();
+			return parents_range(data + (first - m_edges.begin()), data + (last - m_edges.begin()));
+		}
+	};
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace owlcat
+{
+	/*
+		Registry of GC root areas, i.e. areas of memory which store references to objects that should never
+		be freed even if no other references to them exist.
+
+		Roots are registered and unregistered by Mono's callbacks on game threads, often in large numbers during
+		asset loading, so both operations must be cheap: roots are kept in a map sorted by start address.
+		Mono may register overlapping areas, which are merged when GC asks for the list of ranges to scan,
+		so that no memory is scanned twice.
+
+		Not thread-safe, worker_thread guards it with a mutex.
+	*/
+	class root_registry
+	{
+	public:
+		// Number of root sources we keep statistics for (see MonoGCRootSource). Unknown sources are counted as the last one
+		static const int sources_count = 16;
+
+		struct range
+		{
+			const char* start;
+			uint64_t size;
+		};
+
+		struct source_stats
+		{
+			// Number and total size of currently registered roots
+			uint64_t count = 0;
+			uint64_t bytes = 0;
+			// Total number of registrations and unregistrations
+			uint64_t registered = 0;
+			uint64_t unregistered = 0;
+		};
+
+		struct stats
+		{
+			source_stats sources[sources_count];
+		};
+
+	private:
+		struct root_entry
+		{
+			uint64_t size;
+			int source;
+		};
+
+		std::map<const char*, root_entry> m_roots;
+		stats m_stats;
+
+		static int clamp_source(int source)
+		{
+			return source >= 0 && source < sources_count ? source : sources_count - 1;
+		}
+
+		void forget(std::map<const char*, root_entry>::iterator iter)
+		{
+			auto& s = m_stats.sources[iter->second.source];
+			--s.count;
+			s.bytes -= iter->second.size;
+			m_roots.erase(iter);
+		}
+
+	public:
+		// Registers a root. A root with the same start address replaces the previous one
+		void add(const char* start, uint64_t size, int source)
+		{
+			source = clamp_source(source);
+
+			auto iter = m_roots.find(start);
+			if (iter != m_roots.end())
+				forget(iter);
+
+			m_roots.emplace(start, root_entry{ size, source });
+			auto& s = m_stats.sources[source];
+			++s.count;
+			s.bytes += size;
+			++s.registered;
+		}
+
+		// Unregisters a root that starts at the specified address, if there is one
+		void remove(const char* start)
+		{
+			auto iter = m_roots.find(start);
+			if (iter == m_roots.end())
+				return;
+
+			++m_stats.sources[iter->second.source].unregistered;
+			forget(iter);
+		}
+
+		// Fills the list of ranges to scan: sorted, with overlapping and adjacent roots merged together
+		void get_ranges(std::vector<range>& ranges) const
+		{
+			ranges.clear();
+			for (auto& r : m_roots)
+			{
+				const char* end = r.first + r.second.size;
+				if (!ranges.empty() && r.first <= ranges.back().start + ranges.back().size)
+				{
+					auto& last = ranges.back();
+					last.size = std::max<uint64_t>(last.size, end - last.start);
+				}
+				else if (r.second.size > 0)
+				{
+					ranges.push_back({ r.first, r.second.size });
+				}
+			}
+		}
+
+		// Returns source of a root that contains the specified address, or -1 if there is none
+		int find_source(const char* addr) const
+		{
+			// Roots may overlap, so a root that starts earlier may still contain the address
+			for (auto iter = m_roots.upper_bound(addr); iter != m_roots.begin();)
+			{
+				--iter;
+				if (addr < iter->first + iter->second.size)
+					return iter->second.source;
+			}
+			return -1;
+		}
+
+		const stats& get_stats() const { return m_stats; }
+		size_t size() const { return m_roots.size(); }
+
+		// Returns a name of MonoGCRootSource value for logging
+		static const char* get_source_name(int source)
+		{
+			static const char* names[] = { "external", "stack", "finalizer queue", "static", "thread static", "context static",
+				"GC handle", "JIT", "threading", "domain", "reflection", "marshal", "thread pool", "debugger", "handle" };
+			return source >= 0 && source < (int)(sizeof(names) / sizeof(names[0])) ? names[source] : "unknown";
+		}
+	};
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "mono/metadata/profiler.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace owlcat
+{
+	/*
+		Callstack storage for a single allocation.
+
+		This is filled on the allocating (game) thread for every managed allocation, so it must not touch the heap
+		in a common case. Frames are stored inline, and only callstacks deeper than inline_capacity spill into a heap
+		buffer. Moving a backtrace only copies frames that are actually used, so enqueueing a work item by move is cheap.
+	*/
+	class stack_backtrace
+	{
+	public:
+		// Covers the vast majority of callstacks in practice
+		static const size_t inline_capacity = 64;
+
+	private:
+		// Points either to m_inline, or to m_heap
+		MonoMethod** m_data = m_inline;
+		uint32_t m_size = 0;
+		uint32_t m_capacity = inline_capacity;
+		MonoMethod* m_inline[inline_capacity];
+		// Used instead of m_inline when callstack doesn't fit into it
+		std::unique_ptr<MonoMethod*[]> m_heap;
+
+		void move_from(stack_backtrace& other)
+		{
+			m_size = other.m_size;
+			m_capacity = other.m_capacity;
+			if (other.m_heap)
+			{
+				m_heap = std::move(other.m_heap);
+				m_data = m_heap.get();
+			}
+			else
+			{
+				memcpy(m_inline, other.m_inline, m_size * sizeof(MonoMethod*));
+				m_data = m_inline;
+			}
+
+			other.clear();
+		}
+
+		void grow()
+		{
+			std::unique_ptr<MonoMethod*[]> heap(new MonoMethod*[m_capacity * 2]);
+			memcpy(heap.get(), m_data, m_size * sizeof(MonoMethod*));
+			m_heap = std::move(heap);
+			m_data = m_heap.get();
+			m_capacity *= 2;
+		}
+
+	public:
+		stack_backtrace() {}
+		stack_backtrace(const stack_backtrace&) = delete;
+		stack_backtrace& operator=(const stack_backtrace&) = delete;
+
+		stack_backtrace(stack_backtrace&& other) noexcept
+		{
+			move_from(other);
+		}
+
+		stack_backtrace& operator=(stack_backtrace&& other) noexcept
+		{
+			if (this != &other)
+				move_from(other);
+			return *this;
+		}
+
+		// A callback for Mono's stack-walking function. Does nothing, but stores method pointer for now
+		mono_bool add_trace(MonoMethod* method, int32_t native_offset, int32_t il_offset, mono_bool managed)
+		{
+			push_back(method);
+			return 0;
+		}
+
+		void push_back(MonoMethod* method)
+		{
+			if (m_size == m_capacity)
+				grow();
+			m_data[m_size++] = method;
+		}
+
+		void clear()
+		{
+			m_heap.reset();
+			m_data = m_inline;
+			m_size = 0;
+			m_capacity = inline_capacity;
+		}
+
+		MonoMethod* const* data() const { return m_data; }
+		size_t size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+
+		MonoMethod* const* begin() const { return data(); }
+		MonoMethod* const* end() const { return data() + m_size; }
+	};
+}
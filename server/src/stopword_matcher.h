@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace owlcat
+{
+	/*
+		Finds out if a string contains any of a set of stopwords, in a single pass over the string.
+
+		Stopwords are compiled into Aho-Corasick automaton, with failure links folded into transitions, so matching
+		takes one table lookup per character regardless of the number of stopwords. It's only used when a method
+		is seen for the first time (see symbol_table), but lists of stopwords can be long and method names are
+		many, so checking every stopword with strstr adds up.
+	*/
+	class stopword_matcher
+	{
+		static const int alphabet_size = 256;
+
+		struct state
+		{
+			int32_t next[alphabet_size];
+			// True if some stopword ends here, or at a state reachable by failure links
+			bool terminal = false;
+		};
+
+		// State 0 is the root. Empty if there are no stopwords
+		std::vector<state> m_states;
+
+	public:
+		// Replaces the set of stopwords. Empty stopwords are ignored, as they would match everything
+		void build(const std::vector<std::string>& stopwords)
+		{
+			m_states.clear();
+			m_states.emplace_back();
+			for (auto& t : m_states[0].next)
+				t = -1;
+
+			bool any = false;
+			// 1. Trie of stopwords. -1 is a missing transition
+			for (auto& word : stopwords)
+			{
+				if (word.empty())
+					continue;
+
+				any = true;
+				int32_t s = 0;
+				for (unsigned char c : word)
+				{
+					if (m_states[s].next[c] < 0)
+					{
+						m_states[s].next[c] = (int32_t)m_states.size();
+						m_states.emplace_back();
+						for (auto& t : m_states.back().next)
+							t = -1;
+					}
+					s = m_states[s].next[c];
+				}
+				m_states[s].terminal = true;
+			}
+
+			if (!any)
+			{
+				m_states.clear();
+				return;
+			}
+
+			// 2. Breadth-first, replace missing transitions with transitions of the failure state,
+			// which is always closer to the root and therefore already complete
+			std::vector<int32_t> fail(m_states.size(), 0);
+			std::queue<int32_t> queue;
+			for (auto& t : m_states[0].next)
+			{
+				if (t < 0)
+					t = 0;
+				else
+					queue.push(t);
+			}
+
+			while (!queue.empty())
+			{
+				int32_t s = queue.front();
+				queue.pop();
+				m_states[s].terminal = m_states[s].terminal || m_states[fail[s]].terminal;
+
+				for (int c = 0; c < alphabet_size; ++c)
+				{
+					int32_t t = m_states[s].next[c];
+					if (t < 0)
+					{
+						m_states[s].next[c] = m_states[fail[s]].next[c];
+					}
+					else
+					{
+						fail[t] = m_states[fail[s]].next[c];
+						queue.push(t);
+					}
+				}
+			}
+		}
+
+		bool empty() const { return m_states.empty(); }
+
+		// Returns true if the string contains any stopword
+		bool matches(const char* str) const
+		{
+			if (m_states.empty())
+				return false;
+
+			int32_t s = 0;
+			for (const unsigned char* p = (const unsigned char*)str; *p != 0; ++p)
+			{
+				s = m_states[s].next[*p];
+				if (m_states[s].terminal)
+					return true;
+			}
+			return false;
+		}
+	};
+}
@@ -0,0 +1,156 @@
+#include "symbol_table.h"
+#include "mono_functions.h"
+#include "mono_profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using namespace owlcat::mono_functions;
+
+namespace owlcat
+{
+	void get_full_class_name(char* buffer, size_t buffer_size, MonoClass* klass)
+	{
+		const char* namespace_name = get_class_namespace(klass);
+		if (namespace_name == nullptr)
+			namespace_name = "<global>";
+		const char* class_name = get_class_name(klass);
+		snprintf(buffer, buffer_size - 1, "%s.%s", namespace_name, class_name);
+	}
+
+	symbol_table::symbol_table(events_sink* sink)
+		: m_events_sink(sink)
+	{
+	}
+
+	void symbol_table::set_stopwords(const std::vector<std::string>& stopwords)
+	{
+		m_stopwords.build(stopwords);
+		for (auto& method : m_methods)
+			method.second.stopword_met = m_stopwords.matches(method.second.name.c_str());
+
+		for (auto& callstack : m_callstacks)
+		{
+			auto& info = callstack.second;
+			info.stopword_met = std::any_of(info.frames.begin(), info.frames.end(), [this](MonoMethod* frame) { return get_method(frame).stopword_met; });
+		}
+	}
+
+	void symbol_table::set_session(uint64_t session)
+	{
+		m_session = session;
+	}
+
+	symbol_table::method_info& symbol_table::get_method(MonoMethod* method)
+	{
+		auto iter = m_methods.find(method);
+		if (iter != m_methods.end())
+			return iter->second;
+
+		method_info info;
+		info.id = (uint32_t)m_methods.size();
+
+		static char method_name[2048];
+		snprintf(method_name, sizeof(method_name) - 1, "%s.%s", get_class_name(method_get_class(method)), get_method_name(method));
+		info.name = method_name;
+		info.stopword_met = m_stopwords.matches(method_name);
+
+		return m_methods.emplace(method, std::move(info)).first->second;
+	}
+
+	uint32_t symbol_table::get_type_id(MonoClass* klass)
+	{
+		auto iter = m_types.try_emplace(klass, type_info{ (uint32_t)m_types.size() }).first;
+		auto& info = iter->second;
+		if (info.session != m_session && m_session != 0)
+		{
+			static char full_name[2048];
+			get_full_class_name(full_name, sizeof(full_name), klass);
+			m_events_sink->report_type(info.id, full_name);
+			info.session = m_session;
+		}
+
+		return info.id;
+	}
+
+	uint64_t symbol_table::hash_callstack(MonoMethod* const* frames, size_t count)
+	{
+		uint64_t h = 0xcbf29ce484222325ULL ^ count;
+		for (size_t i = 0; i < count; ++i)
+		{
+			h ^= (uint64_t)frames[i];
+			h *= 0x100000001b3ULL;
+			h ^= h >> 29;
+		}
+		return h;
+	}
+
+	symbol_table::resolved_callstack symbol_table::resolve_callstack(MonoMethod* const* frames, size_t count)
+	{
+		auto hash = hash_callstack(frames, count);
+		callstack_info* info = nullptr;
+		auto range = m_callstacks.equal_range(hash);
+		for (auto iter = range.first; iter != range.second; ++iter)
+		{
+			auto& candidate = iter->second;
+			if (candidate.frames.size() == count && std::equal(frames, frames + count, candidate.frames.begin()))
+			{
+				info = &candidate;
+				break;
+			}
+		}
+
+		if (info != nullptr)
+			++m_callstack_stats.hits;
+		else
+		{
+			++m_callstack_stats.misses;
+
+			callstack_info new_info;
+			new_info.id = (uint32_t)m_callstacks.size();
+			new_info.frames.assign(frames, frames + count);
+			new_info.method_ids.reserve(count);
+			for (size_t i = 0; i < count; ++i)
+			{
+				auto& method = get_method(frames[i]);
+				new_info.method_ids.push_back(method.id);
+				new_info.stopword_met = new_info.stopword_met || method.stopword_met;
+			}
+
+			info = &m_callstacks.emplace(hash, std::move(new_info))->second;
+		}
+
+		if (info->stopword_met)
+			return { invalid_id, true };
+
+		if (m_session == 0)
+			return { invalid_id, false };
+
+		if (info->session != m_session)
+		{
+			// Methods must be known to the client before the callstack that references them
+			for (size_t i = 0; i < count; ++i)
+			{
+				auto& method = get_method(frames[i]);
+				if (method.session != m_session)
+				{
+					m_events_sink->report_method(method.id, method.name.c_str());
+					method.session = m_session;
+				}
+			}
+
+			m_events_sink->report_callstack(info->id, info->method_ids.data(), info->method_ids.size());
+			info->session = m_session;
+		}
+
+		return { info->id, false };
+	}
+
+	symbol_table::callstack_stats symbol_table::get_callstack_stats() const
+	{
+		callstack_stats result = m_callstack_stats;
+		result.count = m_callstacks.size();
+		return result;
+	}
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "mono/metadata/profiler.h"
+#include "stopword_matcher.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace owlcat
+{
+	class events_sink;
+
+	// Gets full class name, including namespace, into the specified buffer. Will not overflow the buffer.
+	void get_full_class_name(char* buffer, size_t buffer_size, MonoClass* klass);
+
+	/*
+		Per-session table of symbols: methods, types and callstacks seen by the profiler.
+
+		Each symbol gets a permanent ID the first time it is seen, and its name is resolved only once.
+		Callstacks are stored as sequences of method IDs, so the only string work done by the server
+		is getting a name of every distinct method once. Callstacks are looked up by a hash of their raw
+		MonoMethod pointers, so resolving a callstack that was already seen doesn't allocate anything.
+
+		Definitions are reported to events sink lazily: a symbol is reported the first time it is used
+		in a session (see events_sink), and sink decides when to actually send them. IDs never change,
+		so when a new client connects, symbols are simply reported again.
+	*/
+	class symbol_table
+	{
+	public:
+		// Callstack ID used when callstack was not interned
+		static const uint32_t invalid_id = 0xFFFFFFFF;
+
+		// Result of resolving a callstack
+		struct resolved_callstack
+		{
+			// Interned callstack ID (see events_sink), invalid_id if there is no session
+			uint32_t callstack_id;
+			// If true, callstack contains a stopword and allocation should be ignored
+			bool stopword_met;
+		};
+
+		struct callstack_stats
+		{
+			// Number of callstacks found in the table and added to it
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			size_t count = 0;
+		};
+
+	private:
+		struct method_info
+		{
+			uint32_t id;
+			// Session in which the method was last reported, 0 if it never was
+			uint64_t session = 0;
+			// If true, method name contains one of stopwords
+			bool stopword_met = false;
+			// Class.Method
+			std::string name;
+		};
+
+		struct type_info
+		{
+			uint32_t id;
+			uint64_t session = 0;
+		};
+
+		struct callstack_info
+		{
+			uint32_t id;
+			uint64_t session = 0;
+			// If true, one of methods contains a stopword
+			bool stopword_met = false;
+			std::vector<MonoMethod*> frames;
+			std::vector<uint32_t> method_ids;
+		};
+
+		events_sink* m_events_sink;
+		stopword_matcher m_stopwords;
+		uint64_t m_session = 0;
+
+		std::unordered_map<MonoMethod*, method_info> m_methods;
+		std::unordered_map<MonoClass*, type_info> m_types;
+		// Keyed by hash of frames. Colliding callstacks are told apart by comparing frames
+		std::unordered_multimap<uint64_t, callstack_info> m_callstacks;
+		callstack_stats m_callstack_stats;
+
+		static uint64_t hash_callstack(MonoMethod* const* frames, size_t count);
+
+		// Returns method info, resolving its name the first time the method is seen
+		method_info& get_method(MonoMethod* method);
+
+	public:
+		symbol_table(events_sink* sink);
+
+		// Replaces stop-list. Methods that were already seen are checked against the new one
+		void set_stopwords(const std::vector<std::string>& stopwords);
+
+		// Sets current session of events sink. Session 0 means that nothing should be reported
+		void set_session(uint64_t session);
+
+		// Returns type ID, reporting the type if it wasn't reported in the current session
+		uint32_t get_type_id(MonoClass* klass);
+
+		/*
+			Interns the callstack, resolving its methods and checking them against stop-list the first time it is seen.
+			If session is not 0 and no stopwords were met, reports the callstack along with its methods if they weren't
+			reported in the current session.
+		*/
+		resolved_callstack resolve_callstack(MonoMethod* const* frames, size_t count);
+
+		size_t get_methods_count() const { return m_methods.size(); }
+		size_t get_callstacks_count() const { return m_callstacks.size(); }
+		callstack_stats get_callstack_stats() const;
+	};
+}
@@ -0,0 +1,167 @@
+#include "trace_file_writer.h"
+#include "trace_format.h"
+#include "lz4_block.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace owlcat
+{
+	trace_file_writer::~trace_file_writer()
+	{
+		close();
+	}
+
+	bool trace_file_writer::open(const std::string& path)
+	{
+		close();
+
+		m_file = fopen(path.c_str(), "wb");
+		if (m_file == nullptr)
+			return false;
+
+		trace::header header;
+		memcpy(header.magic, trace::magic, sizeof(header.magic));
+		header.version = trace::version;
+		header.header_size = sizeof(header);
+		if (fwrite(&header, sizeof(header), 1, m_file) != 1 || fflush(m_file) != 0)
+		{
+			fclose(m_file);
+			m_file = nullptr;
+			return false;
+		}
+
+		m_stop = false;
+		m_current.reserve(chunk_size);
+		m_open = true;
+		m_thread = std::thread(&trace_file_writer::write_chunks, this);
+		return true;
+	}
+
+	void trace_file_writer::close()
+	{
+		{
+			std::scoped_lock lock(m_mutex);
+			m_stop = true;
+		}
+		m_chunk_ready.notify_all();
+		if (m_thread.joinable())
+			m_thread.join();
+
+		{
+			std::scoped_lock lock(m_mutex);
+			m_open = false;
+			m_current.clear();
+			m_pending.clear();
+		}
+		m_chunk_written.notify_all();
+
+		if (m_file != nullptr)
+		{
+			fclose(m_file);
+			m_file = nullptr;
+		}
+	}
+
+	bool trace_file_writer::is_connected() const
+	{
+		return m_open;
+	}
+
+	void trace_file_writer::write_message(uint8_t type, uint32_t length, const uint8_t* data)
+	{
+		if (!m_open)
+			return;
+
+		// Chunks only hold whole messages, and a message that doesn't fit into any chunk can't be read back
+		const size_t message_size = sizeof(trace::message_header) + length;
+		if (message_size > trace::max_chunk_size)
+			return;
+
+		std::unique_lock lock(m_mutex);
+		if (!m_current.empty() && m_current.size() + message_size > chunk_size)
+		{
+			m_chunk_written.wait(lock, [this]() { return m_pending.size() < max_pending_chunks || !m_open; });
+			if (!m_open)
+				return;
+
+			seal_current();
+		}
+
+		trace::message_header header{ type, length };
+		const uint8_t* header_bytes = (const uint8_t*)&header;
+		m_current.insert(m_current.end(), header_bytes, header_bytes + sizeof(header));
+		m_current.insert(m_current.end(), data, data + length);
+	}
+
+	void trace_file_writer::seal_current()
+	{
+		m_pending.push_back(std::move(m_current));
+		m_current = std::vector<uint8_t>();
+		m_current.reserve(chunk_size);
+		m_chunk_ready.notify_one();
+	}
+
+	void trace_file_writer::write_chunks()
+	{
+		std::vector<uint8_t> compressed;
+		while (true)
+		{
+			std::vector<uint8_t> chunk;
+			{
+				std::unique_lock lock(m_mutex);
+				m_chunk_ready.wait_for(lock, std::chrono::seconds(1), [this]() { return m_stop || !m_pending.empty(); });
+
+				// Partial chunk is written when nothing else is waiting, so that a slow stream of events still gets to the file
+				if (m_pending.empty() && !m_current.empty())
+					seal_current();
+				if (m_pending.empty())
+				{
+					if (m_stop)
+						return;
+					continue;
+				}
+
+				chunk = std::move(m_pending.front());
+				m_pending.pop_front();
+			}
+			m_chunk_written.notify_all();
+
+			if (!write_chunk(chunk, compressed))
+			{
+				// Disk is full or gone. Sink sees that nobody listens anymore and stops reporting
+				std::scoped_lock lock(m_mutex);
+				m_open = false;
+				m_current.clear();
+				m_pending.clear();
+				m_chunk_written.notify_all();
+				return;
+			}
+		}
+	}
+
+	bool trace_file_writer::write_chunk(const std::vector<uint8_t>& chunk, std::vector<uint8_t>& compressed)
+	{
+		compressed.resize(lz4::max_compressed_size(chunk.size()));
+		size_t compressed_size = lz4::compress(chunk.data(), chunk.size(), compressed.data());
+
+		// Data that doesn't compress is stored as is
+		const uint8_t* stored = compressed.data();
+		size_t stored_size = compressed_size;
+		if (compressed_size >= chunk.size())
+		{
+			stored = chunk.data();
+			stored_size = chunk.size();
+		}
+
+		trace::chunk_header header;
+		header.raw_size = (uint32_t)chunk.size();
+		header.stored_size = (uint32_t)stored_size;
+		header.checksum = trace::get_checksum(stored, stored_size);
+
+		// Every chunk is flushed, so that it survives a crash of the process
+		return fwrite(&header, sizeof(header), 1, m_file) == 1 &&
+			fwrite(stored, 1, stored_size, m_file) == stored_size &&
+			fflush(m_file) == 0;
+	}
+}
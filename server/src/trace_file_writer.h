@@ -0,0 +1,64 @@
+#pragma once
+
+#include "message_output.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace owlcat
+{
+	/*
+		Writes protocol messages to a local trace file (see trace_format.h), so that the server can record
+		without a client, e.g. on machines that run soak tests overnight.
+
+		Messages are appended to the current chunk, which is handed over to a background thread when it's full, or
+		when it was not handed over for a second, so that a crash loses little. The thread compresses chunks and
+		appends them to the file, so threads that report events don't wait for the disk. If the disk can't keep up,
+		they block until a chunk is written, so memory used by the writer never grows beyond a few chunks.
+	*/
+	class trace_file_writer : public message_output
+	{
+	public:
+		// Size of uncompressed chunks. Larger chunks compress better, but more is lost on a crash
+		static constexpr size_t chunk_size = 1024 * 1024;
+		// Number of full chunks that may wait to be written before writing threads are blocked
+		static constexpr size_t max_pending_chunks = 8;
+
+	private:
+		FILE* m_file = nullptr;
+		std::atomic<bool> m_open{ false };
+
+		std::thread m_thread;
+		std::mutex m_mutex;
+		// Notifies the writing thread about new chunks, and threads blocked by a full queue about written ones
+		std::condition_variable m_chunk_ready;
+		std::condition_variable m_chunk_written;
+		std::vector<uint8_t> m_current;
+		std::deque<std::vector<uint8_t>> m_pending;
+		bool m_stop = false;
+
+		// Moves the current chunk to the queue. Must be called under m_mutex
+		void seal_current();
+		// Main function of the writing thread
+		void write_chunks();
+		bool write_chunk(const std::vector<uint8_t>& chunk, std::vector<uint8_t>& compressed);
+
+	public:
+		~trace_file_writer();
+
+		// Creates the file, replacing an existing one, and starts the writing thread
+		bool open(const std::string& path);
+		// Writes all buffered messages and closes the file
+		void close();
+
+		virtual bool is_connected() const override;
+		virtual void write_message(uint8_t type, uint32_t length, const uint8_t* data) override;
+	};
+}
@@ -0,0 +1,161 @@
+#include "type_filter.h"
+#include "mono_functions.h"
+
+#include <cstring>
+#include <unordered_map>
+
+using namespace owlcat::mono_functions;
+
+namespace owlcat
+{
+	std::atomic<uint64_t> type_filter::s_next_generation{ 1 };
+
+	/*
+		Verdicts of the calling thread, valid for a single generation of a filter. Only one filter
+		exists at a time, so a thread doesn't need to keep more than one cache.
+	*/
+	struct verdict_cache
+	{
+		uint64_t generation = 0;
+		std::unordered_map<MonoClass*, bool> verdicts;
+	};
+	static thread_local verdict_cache t_verdicts;
+
+	// Compares names of assemblies, ignoring ".dll" that IL2CPP adds to them and Mono doesn't
+	static bool assembly_names_equal(const char* name, const std::string& pattern)
+	{
+		auto length_without_dll = [](const char* s, size_t length)
+		{
+			return length > 4 && strcmp(s + length - 4, ".dll") == 0 ? length - 4 : length;
+		};
+
+		size_t name_length = length_without_dll(name, strlen(name));
+		size_t pattern_length = length_without_dll(pattern.c_str(), pattern.size());
+		return name_length == pattern_length && strncmp(name, pattern.c_str(), name_length) == 0;
+	}
+
+	type_filter::type_filter()
+		: m_generation(s_next_generation++)
+	{
+	}
+
+	void type_filter::set_rules(const std::vector<protocol::filter_rule>& rules)
+	{
+		auto rule_set_ptr = std::make_shared<rule_set>();
+		for (auto& rule : rules)
+		{
+			if (rule.include)
+				rule_set_ptr->include.push_back(rule);
+			else
+				rule_set_ptr->exclude.push_back(rule);
+		}
+
+		std::scoped_lock lock(m_mutex);
+		m_rules = rule_set_ptr;
+		m_generation = s_next_generation++;
+		m_empty.store(rules.empty(), std::memory_order_release);
+	}
+
+	bool type_filter::matches(const protocol::filter_rule& rule, const char* namespace_name, const char* class_name, const char* assembly_name)
+	{
+		switch (rule.target)
+		{
+		case protocol::FILTER_NAMESPACE:
+		{
+			size_t length = rule.pattern.size();
+			return strncmp(namespace_name, rule.pattern.c_str(), length) == 0 && (namespace_name[length] == 0 || namespace_name[length] == '.');
+		}
+
+		case protocol::FILTER_ASSEMBLY:
+			return assembly_name != nullptr && assembly_names_equal(assembly_name, rule.pattern);
+
+		case protocol::FILTER_TYPE:
+		{
+			// Classes from the global namespace have no prefix
+			size_t namespace_length = strlen(namespace_name);
+			const std::string& pattern = rule.pattern;
+			if (namespace_length == 0)
+				return pattern == class_name;
+
+			return pattern.size() > namespace_length && pattern[namespace_length] == '.' &&
+				pattern.compare(0, namespace_length, namespace_name) == 0 && pattern.compare(namespace_length + 1, std::string::npos, class_name) == 0;
+		}
+		}
+
+		return false;
+	}
+
+	bool type_filter::evaluate(const rule_set& rules, MonoClass* klass)
+	{
+		const char* namespace_name = get_class_namespace(klass);
+		if (namespace_name == nullptr)
+			namespace_name = "";
+		const char* class_name = get_class_name(klass);
+		if (class_name == nullptr)
+			class_name = "";
+
+		// Assembly rules never match if runtime doesn't let us find out the assembly
+		const char* assembly_name = nullptr;
+		if (class_get_image.is_found() && image_get_name.is_found())
+		{
+			if (auto image = class_get_image(klass))
+				assembly_name = image_get_name(image);
+		}
+
+		bool included = rules.include.empty();
+		for (auto& rule : rules.include)
+		{
+			if (matches(rule, namespace_name, class_name, assembly_name))
+			{
+				included = true;
+				break;
+			}
+		}
+
+		if (!included)
+			return false;
+
+		for (auto& rule : rules.exclude)
+		{
+			if (matches(rule, namespace_name, class_name, assembly_name))
+				return false;
+		}
+
+		return true;
+	}
+
+	bool type_filter::is_included_cached(MonoClass* klass)
+	{
+		auto& cache = t_verdicts;
+		if (cache.generation != m_generation.load(std::memory_order_acquire))
+		{
+			cache.verdicts.clear();
+			cache.generation = 0;
+		}
+		else
+		{
+			auto iter = cache.verdicts.find(klass);
+			if (iter != cache.verdicts.end())
+				return iter->second;
+		}
+
+		// Rules and their generation must match, or the verdict would be cached for the wrong rules
+		std::shared_ptr<const rule_set> rules;
+		uint64_t generation;
+		{
+			std::scoped_lock lock(m_mutex);
+			rules = m_rules;
+			generation = m_generation;
+		}
+
+		if (cache.generation != generation)
+		{
+			cache.verdicts.clear();
+			cache.generation = generation;
+		}
+
+		bool verdict = rules == nullptr || evaluate(*rules, klass);
+		cache.verdicts.emplace(klass, verdict);
+		return verdict;
+	}
+}
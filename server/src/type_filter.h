@@ -0,0 +1,60 @@
+#pragma once
+
+#include "mono/metadata/profiler.h"
+#include "network.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace owlcat
+{
+	/*
+		Decides which classes are profiled, according to rules sent by client (see protocol::filter_rule).
+		Objects of classes that are filtered out are handled like unsampled allocations: no stack walk, and
+		no individual events, but they're still tracked by pseudo-GC and counted in frame totals.
+
+		It is called on every allocation, from the allocating thread, before the stack walk. Evaluating rules takes
+		a few string comparisons, so every thread caches verdicts by class. Every change of rules gets a new generation
+		number, which makes threads drop their caches the next time they look at the filter. When there are no rules,
+		the filter costs a single load.
+	*/
+	class type_filter
+	{
+		struct rule_set
+		{
+			std::vector<protocol::filter_rule> include;
+			std::vector<protocol::filter_rule> exclude;
+		};
+
+		// Generations are unique across all filters, so that caches can't mistake a new filter for an old one
+		static std::atomic<uint64_t> s_next_generation;
+
+		std::atomic<bool> m_empty{ true };
+		std::atomic<uint64_t> m_generation;
+		// Guards m_rules, which are only read when a verdict is not cached
+		std::mutex m_mutex;
+		std::shared_ptr<const rule_set> m_rules;
+
+		static bool matches(const protocol::filter_rule& rule, const char* namespace_name, const char* class_name, const char* assembly_name);
+		static bool evaluate(const rule_set& rules, MonoClass* klass);
+		bool is_included_cached(MonoClass* klass);
+
+	public:
+		type_filter();
+
+		// Replaces all rules
+		void set_rules(const std::vector<protocol::filter_rule>& rules);
+
+		// Returns true if objects of the class should be profiled
+		bool is_included(MonoClass* klass)
+		{
+			if (m_empty.load(std::memory_order_acquire))
+				return true;
+
+			return is_included_cached(klass);
+		}
+	};
+}
@@ -2,9 +2,12 @@
 #include "mono_functions.h"
 #include "mono_profiler.h"
 #include "logger.h"
+#include "heap_dump_format.h"
+#include "dominator_tree.h"
 
 #include <thread>
 #include <string>
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <mono/metadata/object.h>
@@ -15,25 +18,42 @@ volatile size_t map_size = 0;
 
 namespace owlcat
 {
-	/*
-		A callback for Mono's stack-walking function. Does nothing, but stores method pointer for now
-	*/
-	mono_bool worker_thread::stack_backtrace::add_trace(MonoMethod* method, int32_t native_offset, int32_t il_offset, mono_bool managed)
-	{
-		backtrace.push_back(method);
+	// When incremental GC checks old objects for modifications, allocation table is split into chunks of this many slots
+	static const size_t gc_slot_chunk_size = 64 * 1024;
 
-		return 0;
-	}
+	// Cursor of a references page holds snapshot version in its upper half (a snapshot is made by a full GC pass, so versions
+	// never get near 2^32), and index of the first entry in the lower one. A following page never starts at entry 0,
+	// so 0 is still the cursor of the first page
+	static uint64_t make_references_cursor(uint64_t version, uint32_t begin) { return (version << 32) | begin; }
+	static uint64_t get_cursor_version(uint64_t cursor) { return cursor >> 32; }
+	static uint32_t get_cursor_begin(uint64_t cursor) { return (uint32_t)cursor; }
 
-	worker_thread::worker_thread(events_sink* sink)
+	std::atomic<uint64_t> worker_thread::s_next_sequence{ 0 };
+	wait_event worker_thread::s_work_items_event;
+
+	worker_thread::worker_thread(events_sink* sink, const mono_profiler_options& options)
 		: m_events_sink(sink)
-		, m_work_items_token(m_work_items)
+		, m_symbols(sink)
 	{
-		//TODO: Allow to specify stopwords externally
-		m_stopwords.push_back("UberConsole");
-		m_stopwords.push_back("FPSCounter");
-		m_stopwords.push_back("CullStateChanged");
-		m_stopwords.push_back("IMGUI");
+		// Items left from a previous worker (if any) will be processed as soon as they're dequeued
+		m_next_sequence_to_process = s_next_sequence.load();
+
+		m_gc_threads = options.gc_threads;
+		// By default, use half of available cores: the game is blocked during GC anyway, but its native threads may not be
+		if (m_gc_threads == 0)
+			m_gc_threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+
+		for (unsigned i = 0; i < m_gc_threads; ++i)
+			m_mark_workers.push_back(std::make_unique<mark_worker>());
+
+		m_full_gc_interval = std::max(1u, options.full_gc_interval);
+		m_scanner.set_unaligned(options.unaligned_scan);
+		// Offsets of fields are aligned, and unaligned mode is there for the cases when we can't trust that
+		m_precise_scan = options.precise_scan && !options.unaligned_scan;
+		m_sampling_interval = options.sampling_interval;
+
+		// Default stop-list, until client sends its own
+		m_symbols.set_stopwords({ "UberConsole", "FPSCounter", "CullStateChanged", "IMGUI" });
 
 		//m_alloc_loc = fopen("allocs.log", "w");
 	}
@@ -43,31 +63,85 @@ namespace owlcat
 		stop();
 	}
 
-	// Gets full class name, including namespace, into the specified buffer. Will not overflow the buffer.
-	void get_full_class_name(char *buffer, size_t buffer_size, MonoClass* klass)
+	moodycamel::ConcurrentQueue<worker_thread::work_item>& worker_thread::get_work_items()
 	{
-		const char* namespace_name = get_class_namespace(klass);
-		if (namespace_name == nullptr)
-			namespace_name = "<global>";
-		const char* class_name = get_class_name(klass);
-		snprintf(buffer, buffer_size - 1, "%s.%s", namespace_name, class_name);
+		// Never destroyed: thread-local producer tokens may be destroyed at thread exit, after static destructors have run
+		static auto* queue = new moodycamel::ConcurrentQueue<work_item>();
+		return *queue;
 	}
 
-	// This is called by find_references. The object in question may no longer be allocated in reality, so guard with SEH
-	void get_full_class_name(char* buffer, size_t buffer_size, uint64_t address)
+	void worker_thread::enqueue_work_item(work_item& item)
 	{
-#ifdef WIN32
-		__try
-#endif
-		{
-			auto klass = object_get_class((MonoObject*)address);
-			get_full_class_name(buffer, buffer_size, klass);
-		}
-#ifdef WIN32
-		__except (EXCEPTION_EXECUTE_HANDLER)
+		thread_local moodycamel::ProducerToken token(get_work_items());
+
+		// Sequence number is taken at the last moment, so that the window in which the consumer
+		// has to wait for an item that has a number, but is not in the queue yet, is as short as possible
+		item.sequence = s_next_sequence++;
+		get_work_items().enqueue(token, std::move(item));
+		s_work_items_event.notify();
+	}
+
+	bool worker_thread::get_next_work_item(work_item& item)
+	{
+		// If an item is missing for this long, we assume it is lost and skip it
+		const auto max_gap_wait = std::chrono::seconds(1);
+
+		auto by_sequence = [](const work_item& a, const work_item& b) { return a.sequence > b.sequence; };
+		auto& queue = get_work_items();
+		uint64_t expected = m_next_sequence_to_process;
+
+		for (;;)
 		{
+			if (!m_reorder_heap.empty() && m_reorder_heap.front().sequence <= expected)
+			{
+				std::pop_heap(m_reorder_heap.begin(), m_reorder_heap.end(), by_sequence);
+				item = std::move(m_reorder_heap.back());
+				m_reorder_heap.pop_back();
+				break;
+			}
+
+			if (!queue.try_dequeue(item))
+			{
+				if (m_reorder_heap.empty())
+					return false;
+
+				// Some thread took a sequence number, but haven't enqueued its item yet
+				auto now = std::chrono::steady_clock::now();
+				if (m_gap_start == std::chrono::steady_clock::time_point())
+					m_gap_start = now;
+				if (now - m_gap_start < max_gap_wait)
+					return false;
+
+				expected = m_reorder_heap.front().sequence;
+				m_next_sequence_to_process = expected;
+				continue;
+			}
+
+			// Items from before the gap was skipped, or from previous worker, are processed right away
+			if (item.sequence <= expected)
+				break;
+
+			m_reorder_heap.push_back(std::move(item));
+			std::push_heap(m_reorder_heap.begin(), m_reorder_heap.end(), by_sequence);
 		}
-#endif
+
+		m_gap_start = std::chrono::steady_clock::time_point();
+		if (item.sequence == expected)
+			m_next_sequence_to_process = expected + 1;
+
+		// Sequence number is taken after the frame, so frames might go back a little when the frame changes
+		if (item.frame < m_last_frame)
+			item.frame = m_last_frame;
+		m_last_frame = item.frame;
+
+		m_progress_event.notify();
+		return true;
+	}
+
+	void worker_thread::wait_while_paused()
+	{
+		std::unique_lock lock(m_pause_mutex);
+		m_pause_cv.wait(lock, [this]() { return !m_paused; });
 	}
 
 	/*
@@ -75,136 +149,237 @@ namespace owlcat
 	*/
 	void worker_thread::do_work()
 	{
+		// True if some events were reported to sink since the last flush
+		bool needs_flush = false;
+		// True if there was nothing to process during the last pass
+		bool idle = false;
+
 		while (!m_stop)
 		{
-			m_work_items_empty = false;
+			// Sleep until something is enqueued. This must be done without holding any locks
+			if (idle)
+			{
+				// When waiting for a missing sequence number, wake up often to check if we waited long enough
+				auto max_sleep = m_reorder_heap.empty() ? std::chrono::milliseconds(100) : std::chrono::milliseconds(1);
+				auto key = s_work_items_event.prepare_wait();
+				if (get_work_items().size_approx() == 0 && !m_stop)
+					s_work_items_event.wait_for(key, max_sleep);
+				else
+					s_work_items_event.cancel_wait();
+				idle = false;
+			}
+
 			// If GC is in progress, block.
 			std::scoped_lock gc_lock(m_gc_mutex);
 
-			// Try to dequeue a work item
+			// Try to get the next work item
 			work_item item;
-			if (!m_work_items.try_dequeue(item))
+			if (!get_next_work_item(item))
 			{
-				m_work_items_empty = true;
-				std::this_thread::yield();
-				continue;
-			}
+				// Send buffered events as soon as we're out of work, so that client doesn't lag behind
+				if (needs_flush)
+				{
+					report_unsampled_totals();
+					m_events_sink->flush();
+					needs_flush = false;
+				}
 
-			// Report free event to client
-			if (item.type == work_item_type::free)
-			{
-				m_events_sink->report_free(item.frame, (uint64_t)item.obj, item.size);
-				m_freed += item.size;
+				++m_idle_passes;
+				m_progress_event.notify();
+				idle = true;
 				continue;
 			}
 
-			// 1. ---------- Get full class name
-
-			static char full_name[2048];
-			get_full_class_name(full_name, sizeof(full_name), item.klass);
-			
+			needs_flush = true;
 
-			// 2. ---------- Get function names for callstack and check stop-list
+			if (item.frame != m_unsampled_frame)
+			{
+				report_unsampled_totals();
+				m_unsampled_frame = item.frame;
+			}
 
-			static std::string backtrace_str;
-			backtrace_str.reserve(1024 * 10);
-			backtrace_str.clear();
+			// Report objects freed by GC to client
+			if (item.type == work_item_type::free_batch)
+			{
+				for (auto& obj : item.freed)
+					m_freed += obj.size;
+				m_freed += item.unsampled.freed_bytes;
+				m_unsampled.frees += item.unsampled.frees;
+				m_unsampled.freed_bytes += item.unsampled.freed_bytes;
+				if (!item.freed.empty())
+					m_events_sink->report_free_batch(item.frame, item.freed);
+				continue;
+			}
 
-			bool stopword_met = false;
-			for (auto& bt_item : item.backtrace.backtrace)
+			auto session = m_events_sink->get_session();
+			if (session != m_session)
 			{
-				auto klass = method_get_class(bt_item);
+				// New client: all definitions need to be sent again
+				m_symbols.set_session(session);
+				m_session = session;
+				m_events_sink->report_sampling(m_sampling_interval);
+			}
 
-				static char method_name[2048];
-				snprintf(method_name, sizeof(method_name)-1, "%s.%s\n", get_class_name(klass), get_method_name(bt_item));
-				for (auto s : m_stopwords)
-				{
-					if (strstr(method_name, s) != nullptr)
-					{
-						stopword_met = true;
-						break;
-					}
-				}
+			// Allocating thread sends a layout only once, so it is kept even if the allocation itself is ignored
+			if (item.layout != nullptr)
+				m_layouts.add(item.klass, std::move(item.layout));
 
-				if (stopword_met)
-					break;
+			// 1. ---------- Resolve callstack and check stop-list. Unsampled allocations have no callstack, so they're always counted
 
-				backtrace_str.append(method_name);
+			symbol_table::resolved_callstack callstack;
+			if (item.sampled)
+			{
+				callstack = m_symbols.resolve_callstack(item.backtrace.data(), item.backtrace.size());
+				if (callstack.stopword_met)
+					continue;
 			}
 
-			if (stopword_met)
-				continue;
-
-			// This mostly means objects allocated directly from native Unity code, like scene objects
-			if (item.backtrace.backtrace.empty())
-				backtrace_str = "<no stack>";
-
 			auto addr = (uint64_t)item.obj;
-			auto addr_iter = m_allocations.find(addr);
-			if (addr_iter == m_allocations.end())
+			auto alloc = m_allocations.find(addr);
+			if (alloc == nullptr)
 			{
 #ifdef DEBUG_ALLOCS
-				m_allocations.insert(std::make_pair(addr, alloc_info{ item.size, false, std::string(get_class_name(object_get_class(item.obj)))}));
+				alloc = m_allocations.insert(addr, alloc_info{ item.size, false, 0, std::string(get_class_name(object_get_class(item.obj))) }).first;
 #else
-				m_allocations.insert(std::make_pair(addr, alloc_info{ item.size, false }));
+				alloc = m_allocations.insert(addr, alloc_info{ item.size, (uint8_t)((uint8_t)alloc_info::flag::YOUNG | (item.sampled ? 0 : (uint8_t)alloc_info::flag::UNSAMPLED)), 0 }).first;
 #endif
+				m_scanner.include((uintptr_t)addr);
 			}
 			else // reallocation
 			{
 #ifdef DEBUG_ALLOCS
 				auto new_name = std::string(get_class_name(object_get_class(item.obj)));
-				if (new_name != addr_iter->second.original_class)
+				if (new_name != alloc->original_class)
 					assert("Reallocation with a different class?!");
-				addr_iter->second.reallocated = true;
+				alloc->reallocated = true;
 #endif
 
-				m_events_sink->report_free(item.frame, addr, addr_iter->second.size);
-				m_freed += addr_iter->second.size;
-				auto& alloc = alloc_value(addr_iter);
-				alloc.size = item.size;
+				if (alloc->flag(alloc_info::flag::UNSAMPLED))
+				{
+					++m_unsampled.frees;
+					m_unsampled.freed_bytes += alloc->size;
+				}
+				else
+					m_events_sink->report_free(item.frame, addr, alloc->size);
+				m_freed += alloc->size;
+				alloc->size = item.size;
+				if (item.sampled)
+					alloc->reset_flag(alloc_info::flag::UNSAMPLED);
+				else
+					alloc->set_flag(alloc_info::flag::UNSAMPLED);
 			}
 
-			m_events_sink->report_alloc(item.frame, addr, item.size, full_name, backtrace_str.c_str());
 			m_allocated += item.size;
+			if (m_precise_scan)
+			{
+				auto layout = m_layouts.find(item.klass);
+				if (layout != nullptr && layout->type == class_layout::kind::no_references)
+					alloc->set_flag(alloc_info::flag::NO_REFERENCES);
+				else
+					alloc->reset_flag(alloc_info::flag::NO_REFERENCES);
+			}
+
+			if (!item.sampled)
+			{
+				++m_unsampled.allocs;
+				m_unsampled.alloc_bytes += item.size;
+				continue;
+			}
+
+			// 2. ---------- Intern type and report the allocation
+
+			// Nobody listens
+			if (session == 0)
+				continue;
+
+			m_events_sink->report_alloc(item.frame, addr, item.size, m_symbols.get_type_id(item.klass), callstack.callstack_id);
 		}
 
 		// Clear queue when thread stops
-		auto empty_queue = moodycamel::ConcurrentQueue<work_item>();
-		m_work_items.swap(empty_queue);
+		work_item item;
+		while (get_work_items().try_dequeue(item))
+			;
+		m_reorder_heap.clear();
 		m_allocations.clear();
 	}
 
+	void worker_thread::report_unsampled_totals()
+	{
+		if (m_unsampled.empty())
+			return;
+
+		m_events_sink->report_unsampled_totals(m_unsampled_frame, m_unsampled);
+		m_unsampled = unsampled_totals();
+	}
+
 	void worker_thread::start()
 	{
+		{
+			// The thread that calls GC is the first marker, the rest wait in the pool
+			std::scoped_lock gc_lock(m_gc_mutex);
+			m_stop_markers = false;
+			for (size_t i = 1; i < m_mark_workers.size(); ++i)
+				m_mark_threads.emplace_back(&worker_thread::run_marker, this, i, m_mark_pass.load());
+		}
+
+		m_stop_queries = false;
+		m_query_thread = std::thread(&worker_thread::process_queries, this);
 		m_thread = std::thread(&worker_thread::do_work, this);
 	}
 
 	void worker_thread::stop()
 	{
 		// Unpause the app if it was paused
-		if (m_stop_lock.owns_lock())
-			m_stop_lock.unlock();
+		{
+			std::scoped_lock lock(m_pause_mutex);
+			m_paused = false;
+		}
+		m_pause_cv.notify_all();
 
 		m_stop = true;
+		s_work_items_event.notify();
 		if (m_thread.joinable())
 			m_thread.join();
+
+		// A pass in progress holds the lock, so it finishes with all of its markers. Passes after that are marked by their calling thread alone
+		{
+			std::scoped_lock gc_lock(m_gc_mutex);
+			m_stop_markers = true;
+			m_mark_event.notify();
+			for (auto& t : m_mark_threads)
+				t.join();
+			m_mark_threads.clear();
+		}
+
+		// Queries that were not started yet are dropped
+		{
+			std::scoped_lock lock(m_queries_mutex);
+			m_stop_queries = true;
+			m_queries.clear();
+		}
+		m_queries_cv.notify_all();
+		if (m_query_thread.joinable())
+			m_query_thread.join();
 	}
 
 	void worker_thread::add_allocation_async(uint64_t frame, MonoClass* klass, MonoObject* obj)
 	{
-		std::shared_lock stop_lock(m_stop_mutex);
+		// This is the only thing allocations have to check to support pausing
+		if (m_paused.load(std::memory_order_acquire))
+			wait_while_paused();
+
 		//fprintf(m_alloc_loc, "%p\n", obj);
 		//fflush(m_alloc_loc);
 
 #ifdef DEBUG_ALLOCS
 		std::scoped_lock lock(m_gc_mutex);
-		auto addr_iter = m_allocations.find((uint64_t)obj);
-		if (addr_iter != m_allocations.end())
+		auto alloc = m_allocations.find((uint64_t)obj);
+		if (alloc != nullptr)
 		{
 			auto new_name = std::string(get_class_name(object_get_class(obj)));
-			if (new_name != addr_iter->second.original_class)
+			if (new_name != alloc->original_class)
 				printf("Reallocation with a different class?!");
-			addr_iter->second.reallocated = true;
+			alloc->reallocated = true;
 		}
 #endif		
 
@@ -214,6 +389,22 @@ namespace owlcat
 		item.obj = obj;
 		item.size = mono_functions::object_get_size(obj);
 		item.type = work_item_type::alloc;
+		// Mono's reflection can't be used by the worker thread, see class_layouts
+		if (m_precise_scan)
+			item.layout = m_layouts.resolve_once(klass);
+
+		// In sampling mode, most allocations skip the stack walk below. Every thread samples on its own
+		static thread_local allocation_sampler sampler;
+		if (sampler.get_interval() != m_sampling_interval)
+			sampler.init(m_sampling_interval, (uint64_t)(uintptr_t)&sampler ^ (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count());
+
+		// Classes that are filtered out skip it, too. They don't take part in sampling, since nobody will see their samples
+		item.sampled = m_type_filter.is_included(klass) && sampler.sample(item.size);
+		if (!item.sampled)
+		{
+			enqueue_work_item(item);
+			return;
+		}
 
 		// This is a heavy call, but it can only be done here, for obvious reasons.
 		// We ease things up a bit by only collecting addresses here. do_work translates them into strings in another thread.
@@ -230,143 +421,459 @@ namespace owlcat
 				((stack_backtrace*)data)->add_trace(frame_info->method, 0, 0, true);
 			}, (void*)&item.backtrace);
 #endif
-		m_work_items.enqueue(m_work_items_token, item);
+		enqueue_work_item(item);
 	}
 
-	// It is possible that the memory pointed to by addr is no longer accessible to us.
-	// We can't know if it is, so we use SEH to handle the resulting access violation.
-	// Actually, we probably can call into BoehmGC itself to check, but this is a more complicated and less stable way
-	// This approach, however, can hide some errors
-	intptr_t get_ptr_safe(const uint8_t* p)
+	// Hash of object's contents (see alloc_info::content_hash). The object may be no longer accessible, see heap_scanner
+	uint64_t get_content_hash_safe(const uint8_t* p, uint32_t size)
 	{
+		uint64_t h = 0;
 #ifdef WIN32
 		__try
 		{
 #endif
-			return *((intptr_t*)p);
+			const uint8_t* e = p + size;
+			for (; p + sizeof(uint64_t) <= e; p += sizeof(uint64_t))
+			{
+				uint64_t word;
+				memcpy(&word, p, sizeof(word));
+				h ^= word;
+				h = ((h << 27) | (h >> 37)) * 0x9E3779B97F4A7C15ULL;
+			}
+			for (; p < e; ++p)
+			{
+				h ^= *p;
+				h = ((h << 27) | (h >> 37)) * 0x9E3779B97F4A7C15ULL;
+			}
 #ifdef WIN32
 		}
 		__except (EXCEPTION_EXECUTE_HANDLER)
 		{
-			// TODO: Add log?
+			return 0;
 		}
-
-		return 0;
 #endif
+		return h;
 	}
 
-	int worker_thread::do_gc_internal(uint64_t frame, bool only_update_parents)
+	// Used by GC to find object's layout. The object may no longer be allocated in reality, so guard with SEH
+	MonoClass* get_class_safe(uint64_t address)
 	{
-		int iterations = 0;
-
-		std::scoped_lock gc_lock(m_gc_mutex);
-		std::scoped_lock roots_lock(m_roots_mutex);
+#ifdef WIN32
+		__try
+		{
+#endif
+			return object_get_class((MonoObject*)address);
+#ifdef WIN32
+		}
+		__except (EXCEPTION_EXECUTE_HANDLER)
+		{
+			return nullptr;
+		}
+#endif
+	}
 
-		m_stack.reserve(1024 * 1024);
-		m_stack.clear();
+	void worker_thread::mark_candidates(size_t worker_index, const stack_entry& entry, const uintptr_t* candidates, size_t count)
+	{
+		auto& worker = *m_mark_workers[worker_index];
 
-		// Clear all objects' marks
-		for (auto iter = m_allocations.begin(); iter != m_allocations.end(); ++iter)
+		for (size_t i = 0; i < count; ++i)
 		{
-			auto& alloc = alloc_value(iter);
-			alloc.reset_flag(alloc_info::flag::TMP_ALLOCATED);
-			alloc.reset_flag(alloc_info::flag::IS_ROOT);
-			alloc.reset_flag(alloc_info::flag::TMP_VISITED);
-			alloc.parents.clear();
+			uintptr_t candidate = candidates[i];
+			auto alloc = m_allocations.find(candidate);
+			if (alloc == nullptr)
+				continue;
+
+			// Incremental passes don't see references from unmodified objects, so they don't update the edges at all
+			if (m_full_pass)
+				m_parents.add((uint64_t)candidate, entry.addr, worker_index);
+			// Only the thread which actually set the mark pushes the object
+			if ((alloc->set_flags_atomic((uint8_t)alloc_info::flag::TMP_ALLOCATED) & (uint8_t)alloc_info::flag::TMP_ALLOCATED) == 0)
+			{
 #ifdef DEBUG_ALLOCS
-			iter.second.parent = nullptr;
+				alloc->parent = entry.info;
 #endif
+				worker.stack.push_back({ (uint64_t)candidate, alloc });
+			}
 		}
+	}
+
+	void worker_thread::mark_children(size_t worker_index, const stack_entry& entry)
+	{
+		const uint8_t* p = (const uint8_t*)entry.addr;
+		const uint8_t* e = (const uint8_t*)entry.addr + entry.info->size;
+
+		// Remember what the object looked like, so that incremental passes can tell if it was modified
+		if (m_full_gc_interval > 1)
+			entry.info->content_hash = get_content_hash_safe(p, entry.info->size);
 
-		// 1. Push roots onto stack
-		for (auto& r : m_roots)
+		const class_layout* layout = m_precise_scan ? m_layouts.find(get_class_safe(entry.addr)) : nullptr;
+		auto type = layout != nullptr ? layout->type : class_layout::kind::conservative;
+
+		uintptr_t candidates[heap_scanner::block_size];
+		switch (type)
 		{
-			uintptr_t* p = (uintptr_t*)r.start;
-			while (p < (uintptr_t*)r.start + r.size / sizeof(uintptr_t))
-			{
-				uintptr_t ref = *p;
+		case class_layout::kind::no_references:
+			break;
 
-				if (ref != 0)
+		case class_layout::kind::fields:
+		case class_layout::kind::struct_array:
+		{
+			const uint32_t* offsets = layout->offsets.data();
+			const size_t offsets_count = layout->offsets.size();
+			// An object is a single element with no stride
+			const uint8_t* element = type == class_layout::kind::fields ? p : p + class_layouts::array_data_offset;
+			const size_t stride = type == class_layout::kind::fields ? 0 : layout->element_size;
+			for (; element < e; element += stride)
+			{
+				for (size_t first = 0; first < offsets_count; first += heap_scanner::block_size)
 				{
-					auto iter = m_allocations.find(ref);
-					if (iter != m_allocations.end() && !iter->second.flag(alloc_info::flag::TMP_ALLOCATED))
-					{
-						alloc_value(iter).set_flag(alloc_info::flag::IS_ROOT);
-						alloc_value(iter).set_flag(alloc_info::flag::TMP_ALLOCATED);
-						m_stack.push_back({ alloc_key(iter), &alloc_value(iter) });
-					}
+					size_t count = std::min(offsets_count - first, heap_scanner::block_size);
+					count = m_scanner.collect_slots(element, e, offsets + first, count, candidates);
+					mark_candidates(worker_index, entry, candidates, count);
 				}
 
-				++p;
+				if (stride == 0)
+					break;
 			}
+			break;
+		}
+
+		case class_layout::kind::reference_array:
+			// Every element is a reference, so scanning all words of array's data is precise
+			p += class_layouts::array_data_offset;
+			break;
+
+		case class_layout::kind::conservative:
+			++m_mark_workers[worker_index]->conservative;
+			break;
 		}
 
-		// 2. Process stack
-		while (!m_stack.empty())
+		if (type != class_layout::kind::conservative && type != class_layout::kind::reference_array)
+			return;
+
+		while (p < e)
+		{
+			size_t count = m_scanner.collect(p, e, candidates);
+			mark_candidates(worker_index, entry, candidates, count);
+		}
+	}
+
+	void worker_thread::run_marker(size_t worker_index, uint64_t last_pass)
+	{
+		for (;;)
+		{
+			m_mark_event.wait([&]() { return m_stop_markers || m_mark_pass != last_pass; }, std::chrono::milliseconds(100));
+			if (m_stop_markers)
+				return;
+
+			last_pass = m_mark_pass;
+			auto& context = *m_mark_context;
+			mark_objects(worker_index, context);
+			++context.finished_workers;
+			m_mark_event.notify();
+		}
+	}
+
+	bool worker_thread::acquire_mark_work(size_t worker_index)
+	{
+		auto& worker = *m_mark_workers[worker_index];
+
+		// Take back what we shared, if nobody stole it yet
+		if (worker.shared_size > 0)
+		{
+			std::scoped_lock lock(worker.shared_mutex);
+			worker.stack.swap(worker.shared);
+			worker.shared_size = 0;
+			if (!worker.stack.empty())
+				return true;
+		}
+
+		// Steal half of other marker's shared stack
+		for (size_t i = 1; i < m_mark_workers.size(); ++i)
 		{
-			++iterations;
-			//auto obj_iter = m_stack.back();
-			//m_stack.pop_back();
+			auto& victim = *m_mark_workers[(worker_index + i) % m_mark_workers.size()];
+			if (victim.shared_size == 0)
+				continue;
+
+			std::scoped_lock lock(victim.shared_mutex);
+			size_t count = victim.shared.size() - victim.shared.size() / 2;
+			if (count == 0)
+				continue;
 
-			//const uint8_t* p = (const uint8_t*)obj_iter->first;
-			//const uint8_t* e = (const uint8_t*)obj_iter->first + obj_iter->second.size;
+			worker.stack.insert(worker.stack.end(), victim.shared.end() - count, victim.shared.end());
+			victim.shared.resize(victim.shared.size() - count);
+			victim.shared_size = victim.shared.size();
+			return true;
+		}
+
+		return false;
+	}
 
-			auto entry = m_stack.back();
-			m_stack.pop_back();
+	void worker_thread::mark_objects(size_t worker_index, mark_context& context)
+	{
+		// Share work when we have at least this many objects in stack, and nobody took previously shared work yet
+		const size_t share_threshold = 256;
 
-			const uint8_t* p = (const uint8_t*)entry.addr;
-			const uint8_t* e = (const uint8_t*)entry.addr + entry.info->size;
+		auto& worker = *m_mark_workers[worker_index];
+		const size_t workers_count = context.workers_count;
 
-			while (p + sizeof(intptr_t) <= e)
-			{				
-				intptr_t candidate = get_ptr_safe(p);
-				auto iter = m_allocations.find(candidate);
-				if (iter != m_allocations.end())
+		// 1. Push roots onto stack. Roots are split in chunks, and each marker takes the next free chunk
+		for (size_t chunk_index = context.next_root_chunk++; chunk_index < context.root_chunks.size(); chunk_index = context.next_root_chunk++)
+		{
+			auto& r = context.root_chunks[chunk_index];
+			const uint8_t* p = (const uint8_t*)r.start;
+			const uint8_t* e = p + r.size;
+			uintptr_t candidates[heap_scanner::block_size];
+			while (p < e)
+			{
+				size_t count = m_scanner.collect(p, e, candidates);
+				for (size_t i = 0; i < count; ++i)
 				{
-					auto& alloc = alloc_value(iter);
-					alloc.parents.push_back(entry.addr);
-					if (!iter->second.flag(alloc_info::flag::TMP_ALLOCATED))
+					uintptr_t ref = candidates[i];
+					auto alloc = m_allocations.find(ref);
+					if (alloc == nullptr)
+						continue;
+
+					// Object is a root if any root area references it, regardless of whether some other
+					// marker has already reached it through another object
+					auto prev_flags = alloc->set_flags_atomic((uint8_t)alloc_info::flag::IS_ROOT | (uint8_t)alloc_info::flag::TMP_ALLOCATED);
+					if ((prev_flags & (uint8_t)alloc_info::flag::TMP_ALLOCATED) == 0)
+						worker.stack.push_back({ ref, alloc });
+				}
+			}
+		}
+
+		// 1a. Incremental pass only: rescan old objects that were modified since they were last scanned, as they
+		// may now reference young objects. Old objects are already marked, so marking never pushes them itself.
+		for (size_t chunk_index = context.next_slot_chunk++; chunk_index < context.slot_chunks; chunk_index = context.next_slot_chunk++)
+		{
+			size_t begin = chunk_index * gc_slot_chunk_size;
+			size_t end = std::min(begin + gc_slot_chunk_size, m_allocations.capacity());
+			m_allocations.for_each_in_slots(begin, end, [&](uint64_t addr, alloc_info& alloc)
+				{
+					if (alloc.flag(alloc_info::flag::YOUNG) || alloc.flag(alloc_info::flag::NO_REFERENCES))
+						return;
+
+					++worker.checked;
+					if (get_content_hash_safe((const uint8_t*)addr, alloc.size) == alloc.content_hash)
+						return;
+
+					++worker.modified;
+					++worker.iterations;
+					mark_children(worker_index, { addr, &alloc });
+				});
+		}
+
+		// 2. Process stack until all markers are out of work
+		for (;;)
+		{
+			while (!worker.stack.empty())
+			{
+				++worker.iterations;
+
+				auto entry = worker.stack.back();
+				worker.stack.pop_back();
+
+				mark_children(worker_index, entry);
+
+				if (workers_count > 1 && worker.stack.size() >= share_threshold && worker.shared_size == 0)
+				{
+					// Share the bottom half of the stack: these are objects found earliest, and are likely
+					// to lead to larger parts of the graph
 					{
-						alloc.reset_flag(alloc_info::flag::IS_ROOT);
-						alloc.set_flag(alloc_info::flag::TMP_ALLOCATED);
-#ifdef DEBUG_ALLOCS
-						iter->second.parent = entry.info;
-#endif
-						m_stack.push_back({ alloc_key(iter), &alloc });
-						//m_stack.push_back(iter);
+						std::scoped_lock lock(worker.shared_mutex);
+						size_t count = worker.stack.size() / 2;
+						worker.shared.assign(worker.stack.begin(), worker.stack.begin() + count);
+						worker.stack.erase(worker.stack.begin(), worker.stack.begin() + count);
+						worker.shared_size = worker.shared.size();
 					}
+					// Wake up idle markers
+					m_mark_event.notify();
 				}
-				++p;
 			}
+
+			if (acquire_mark_work(worker_index))
+				continue;
+
+			// Out of work. Sleep until somebody shares more, or everyone is out of work, which means we're done.
+			// A marker never shares anything while it is idle, so when all markers are idle, there is no work left.
+			if (++context.idle_workers == workers_count)
+			{
+				m_mark_event.notify();
+				return;
+			}
+
+			bool has_work = false;
+			m_mark_event.wait([&]()
+				{
+					for (auto& other : m_mark_workers)
+					{
+						if (other->shared_size > 0)
+						{
+							has_work = true;
+							return true;
+						}
+					}
+					return context.idle_workers == workers_count;
+				}, std::chrono::milliseconds(1));
+			if (!has_work)
+				return;
+
+			--context.idle_workers;
+		}
+	}
+
+	worker_thread::gc_stats worker_thread::do_gc_internal(uint64_t frame, bool only_update_parents)
+	{
+		// Roots are split into chunks of this size, so that a single huge root doesn't end up on one thread
+		const uint64_t root_chunk_size = 128 * 1024;
+
+		std::scoped_lock gc_lock(m_gc_mutex);
+		std::scoped_lock roots_lock(m_roots_mutex);
+		const bool paused = m_paused;
+
+		gc_stats stats;
+		// Parents update needs to see all references, so it is always full
+		stats.full = only_update_parents || m_next_gc_full || m_gcs_since_full + 1 >= m_full_gc_interval;
+		m_full_pass = stats.full;
+
+		mark_context context;
+		if (stats.full)
+		{
+			// Clear all objects' marks
+			m_allocations.for_each([](uint64_t, alloc_info& alloc)
+				{
+					alloc.reset_flag(alloc_info::flag::TMP_ALLOCATED);
+					alloc.reset_flag(alloc_info::flag::IS_ROOT);
+					alloc.reset_flag(alloc_info::flag::TMP_VISITED);
+#ifdef DEBUG_ALLOCS
+					alloc.parent = nullptr;
+#endif
+				});
+
+			m_parents.clear(m_mark_workers.size());
+		}
+		else
+		{
+			// Old objects keep their marks. Young objects were never marked, because every pass except
+			// parents update (after which the next pass is full) promotes all marked young objects.
+			context.slot_chunks = (m_allocations.capacity() + gc_slot_chunk_size - 1) / gc_slot_chunk_size;
+		}
+
+		// Overlapping roots are merged, so no memory is scanned twice
+		m_roots.get_ranges(m_root_ranges);
+		for (auto& r : m_root_ranges)
+		{
+			for (uint64_t offset = 0; offset < r.size; offset += root_chunk_size)
+				context.root_chunks.push_back({ r.start + offset, std::min(root_chunk_size, r.size - offset) });
+		}
+
+		for (auto& worker : m_mark_workers)
+		{
+			worker->stack.clear();
+			worker->shared.clear();
+			worker->shared_size = 0;
+			worker->iterations = 0;
+			worker->checked = 0;
+			worker->modified = 0;
+			worker->conservative = 0;
+		}
+
+		// 1-2. Mark all reachable objects. The calling thread is always the first marker,
+		// so with one GC thread the order of marking is deterministic. Pool markers join it
+		context.workers_count = m_mark_threads.size() + 1;
+		if (context.workers_count > 1)
+		{
+			m_mark_context = &context;
+			++m_mark_pass;
+			m_mark_event.notify();
+		}
+		mark_objects(0, context);
+		// Context lives on this stack, so pool markers must be done with it
+		m_mark_event.wait([&]() { return context.finished_workers + 1 >= context.workers_count; }, std::chrono::milliseconds(1));
+		m_mark_context = nullptr;
+
+		for (auto& worker : m_mark_workers)
+		{
+			stats.scanned += worker->iterations;
+			stats.checked += worker->checked;
+			stats.modified += worker->modified;
+			stats.conservative += worker->conservative;
 		}
 
 		// If only parents update was requeste, do not remove unmarked objects
 		if (!only_update_parents)
 		{
-			// 3. Forget all unmarked objects
-			for (auto iter = m_allocations.begin(); iter != m_allocations.end(); )
-			{
-				if (!iter->second.flag(alloc_info::flag::TMP_ALLOCATED))
+			// 3. Forget all unmarked objects. Incremental pass doesn't know if unmarked old objects are
+			// alive, but they can only exist after parents update, which makes the next pass full.
+			const bool full = stats.full;
+			std::vector<freed_object> freed;
+			unsampled_totals unsampled;
+			m_allocations.erase_if([&](uint64_t addr, alloc_info& alloc)
 				{
-					work_item item;
-					item.type = work_item_type::free;
-					item.frame = frame;
-					item.klass = nullptr;
-					item.obj = (MonoObject*)iter->first;
-					item.size = iter->second.size;
-					m_work_items.enqueue(m_work_items_token, item);
-
-					//auto iter2 = iter;
-					//iter = ++iter;
-					//m_allocations.erase(iter2);
-					iter = m_allocations.erase(iter);
-				}
-				else
-					++iter;
+					bool young = alloc.flag(alloc_info::flag::YOUNG);
+					if (young)
+						++stats.young;
+
+					if (alloc.flag(alloc_info::flag::TMP_ALLOCATED) || (!full && !young))
+					{
+						alloc.reset_flag(alloc_info::flag::YOUNG);
+						return false;
+					}
+
+					// Client never saw unsampled objects, so they're only counted
+					if (alloc.flag(alloc_info::flag::UNSAMPLED))
+					{
+						++unsampled.frees;
+						unsampled.freed_bytes += alloc.size;
+					}
+					else
+						freed.push_back({ addr, alloc.size });
+					return true;
+				});
+
+			// All freed objects are reported with a single event, which keeps them in order with allocations
+			stats.freed = freed.size() + unsampled.frees;
+			if (!freed.empty() || !unsampled.empty())
+			{
+				std::sort(freed.begin(), freed.end(), [](const freed_object& a, const freed_object& b) { return a.addr < b.addr; });
+
+				work_item item;
+				item.type = work_item_type::free_batch;
+				item.frame = frame;
+				item.size = 0;
+				item.freed = std::move(freed);
+				item.unsampled = unsampled;
+				enqueue_work_item(item);
 			}
+
+			// Scanner still takes freed objects' pages for tracked ones. Pages can't be cleared object by object,
+			// so they're rebuilt from survivors, but only when something was actually freed
+			if (stats.freed != 0)
+			{
+				m_scanner.reset();
+				m_allocations.for_each([this](uint64_t addr, alloc_info&) { m_scanner.include((uintptr_t)addr); });
+			}
+
+			m_gcs_since_full = stats.full ? 0 : m_gcs_since_full + 1;
+			m_next_gc_full = false;
 		}
+		else
+		{
+			// Young objects are now marked, and incremental pass would take them for old ones
+			m_next_gc_full = true;
+		}
+
+		m_parents_complete = stats.full;
+		stats.live = m_allocations.size();
+		stats.callstacks = m_symbols.get_callstack_stats();
+		stats.roots = m_roots.get_stats();
 
-		return iterations;
+		// Only a full pass knows all references
+		if (stats.full && m_snapshot_wanted.exchange(false))
+			publish_snapshot(frame, paused);
+
+		return stats;
 	}
 
 	/*
@@ -376,151 +883,752 @@ namespace owlcat
 	void worker_thread::do_gc_unity(uint64_t frame)
 	{
 		// Clear all objects' marks
-		for (auto iter : m_allocations)
-		{
-			iter.second.reset_flag(alloc_info::flag::TMP_ALLOCATED);
-		}
+		m_allocations.for_each([](uint64_t, alloc_info& alloc)
+			{
+				alloc.reset_flag(alloc_info::flag::TMP_ALLOCATED);
+			});
 
 		auto state = begin_liveness_calculation(nullptr, 1024 * 1024, [](void* arr, int size, void* callback_userdata)
 			{
 				MonoObject** objs = (MonoObject**)arr;
-				std::unordered_map<uint64_t, alloc_info>& allocations = *(std::unordered_map<uint64_t, alloc_info>*)callback_userdata;
+				allocations_map& allocations = *(allocations_map*)callback_userdata;
 				for (int i = 0; i < size; ++i)
 				{
 					auto obj = objs[i];
-					auto iter = allocations.find((uint64_t)obj);
-					if (iter != allocations.end())
-						iter->second.set_flag(alloc_info::flag::TMP_ALLOCATED);
+					auto alloc = allocations.find((uint64_t)obj);
+					if (alloc != nullptr)
+						alloc->set_flag(alloc_info::flag::TMP_ALLOCATED);
 				}
 			}, & m_allocations, []() {}, []() {});
 		calculate_liveness_from_statics(state);
 		end_liveness_calculation(state);
 
-		for (auto iter = m_allocations.begin(); iter != m_allocations.end(); )
-		{
-			if (!iter->second.flag(alloc_info::flag::TMP_ALLOCATED))
+		m_allocations.erase_if([&](uint64_t addr, alloc_info& alloc)
 			{
-				m_events_sink->report_free(frame, iter->first, iter->second.size);				
-				auto iter2 = iter;
-				iter = ++iter;
-				m_allocations.erase(iter2);
-			}
-			else
-				++iter;
-		}
+				if (alloc.flag(alloc_info::flag::TMP_ALLOCATED))
+					return false;
+
+				m_events_sink->report_free(frame, addr, alloc.size);
+				return true;
+			});
+	}
+
+	void worker_thread::set_type_filter(const std::vector<protocol::filter_rule>& rules)
+	{
+		m_type_filter.set_rules(rules);
 	}
 
-	int worker_thread::do_gc_sync(uint64_t frame, bool only_update_parents)
+	void worker_thread::set_stopwords(const std::vector<std::string>& stopwords)
 	{
-		// Wait for all previous allocations to be processed to keep the order of events
-		while (!m_work_items_empty)
-			std::this_thread::yield();		
+		std::scoped_lock gc_lock(m_gc_mutex);
+		m_symbols.set_stopwords(stopwords);
+	}
+
+	worker_thread::gc_stats worker_thread::do_gc_sync(uint64_t frame, bool only_update_parents)
+	{
+		// Wait for all previous allocations to be processed to keep the order of events. If the worker
+		// went through a whole pass without finding anything to process, the missing items belong to threads
+		// which were suspended by GC before they could enqueue them, and we can't wait for them.
+		uint64_t target = s_next_sequence;
+		uint64_t idle_passes = m_idle_passes;
+		m_progress_event.wait([&]()
+			{
+				// Make sure the worker doesn't sleep through the missing items
+				s_work_items_event.notify();
+				return m_next_sequence_to_process >= target || m_idle_passes >= idle_passes + 2 || m_stop;
+			}, std::chrono::milliseconds(1));
 		
-		int r = do_gc_internal(frame, only_update_parents);
+		auto stats = do_gc_internal(frame, only_update_parents);
 
 		m_last_gc_frame = frame;
-		return r;
+		return stats;
 	}
 
-	void worker_thread::register_root(const char* start, uint64_t size)
+	void worker_thread::register_root(const char* start, uint64_t size, int source)
 	{
 		std::scoped_lock roots_lock(m_roots_mutex);
-		m_roots.push_back({ start, size });
+		m_roots.add(start, size, source);
 	}
 
 	void worker_thread::unregister_root(const char* start)
 	{
 		std::scoped_lock roots_lock(m_roots_mutex);
-		auto new_end = std::remove_if(m_roots.begin(), m_roots.end(), [&](auto& r) {return r.start == start; });
-		m_roots.erase(new_end, m_roots.end());
+		m_roots.remove(start);
+	}
+
+	void worker_thread::publish_snapshot(uint64_t frame, bool paused)
+	{
+		auto snapshot = std::make_shared<heap_snapshot>();
+		snapshot->frame = frame;
+		snapshot->paused = paused;
+		snapshot->version = ++m_snapshot_version;
+
+		// Edges are only sorted when they are needed
+		m_parents.build();
+
+		auto& addresses = snapshot->addresses;
+		addresses.reserve(m_allocations.size());
+		m_allocations.for_each([&](uint64_t addr, alloc_info&) { addresses.push_back(addr); });
+		std::sort(addresses.begin(), addresses.end());
+
+		const uint32_t count = snapshot->size();
+		snapshot->sizes.resize(count);
+		snapshot->flags.resize(count);
+		snapshot->classes.resize(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			auto alloc = m_allocations.find(addresses[i]);
+			snapshot->sizes[i] = alloc->size;
+
+			uint8_t flags = 0;
+			if (alloc->flag(alloc_info::flag::IS_ROOT))
+				flags |= heap_snapshot::ROOT;
+			if (!alloc->flag(alloc_info::flag::TMP_ALLOCATED))
+				flags |= heap_snapshot::DELETED;
+			snapshot->flags[i] = flags;
+
+			// Objects are still alive while GC holds its locks, later their memory can't be trusted
+			snapshot->classes[i] = get_class_safe(addresses[i]);
+		}
+
+		// Edges and addresses are both sorted, so children are matched with a single merge pass, and only parents need a search
+		snapshot->parents_offsets.assign(count + 1, 0);
+		snapshot->parents.reserve(m_parents.size());
+		uint32_t child_index = 0;
+		m_parents.for_each([&](uint64_t child, uint64_t parent)
+			{
+				while (child_index < count && addresses[child_index] < child)
+					snapshot->parents_offsets[++child_index] = (uint32_t)snapshot->parents.size();
+				if (child_index == count || addresses[child_index] != child)
+					return;
+
+				uint32_t parent_index = snapshot->find(parent);
+				if (parent_index != heap_snapshot::none)
+					snapshot->parents.push_back(parent_index);
+			});
+		while (child_index < count)
+			snapshot->parents_offsets[++child_index] = (uint32_t)snapshot->parents.size();
+
+		std::scoped_lock lock(m_snapshot_mutex);
+		m_snapshot = std::move(snapshot);
 	}
 
-	struct references_stack_entry_t
+	std::shared_ptr<const heap_snapshot> worker_thread::get_snapshot(uint64_t frame, const std::vector<uint64_t>& addresses)
 	{
-		uint64_t addr;
-		object_references_t* info;
-	};
+		std::shared_ptr<const heap_snapshot> snapshot;
+		{
+			std::scoped_lock lock(m_snapshot_mutex);
+			snapshot = m_snapshot;
+		}
+
+		if (snapshot != nullptr && (snapshot->paused || !m_paused) &&
+			std::all_of(addresses.begin(), addresses.end(), [&](uint64_t addr) { return snapshot->find(addr) != heap_snapshot::none; }))
+			return snapshot;
+
+		m_snapshot_wanted = true;
+		// Set the second argument to true to avoid actually removing any objects and reporting free events to client
+		do_gc_sync(frame, true);
 
-	void worker_thread::find_references_internal(uint64_t request_id, const std::vector<uint64_t>& addresses)
+		std::scoped_lock lock(m_snapshot_mutex);
+		return m_snapshot;
+	}
+
+	void worker_thread::process_queries()
+	{
+		while (true)
+		{
+			std::function<void()> query;
+			{
+				std::unique_lock lock(m_queries_mutex);
+				m_queries_cv.wait(lock, [this]() { return m_stop_queries || !m_queries.empty(); });
+				if (m_stop_queries)
+					return;
+
+				query = std::move(m_queries.front());
+				m_queries.pop_front();
+			}
+
+			query();
+		}
+	}
+
+	void worker_thread::post_query(std::function<void()> query)
+	{
+		{
+			std::scoped_lock lock(m_queries_mutex);
+			m_queries.push_back(std::move(query));
+		}
+		m_queries_cv.notify_one();
+	}
+
+	const std::string& worker_thread::get_class_name(MonoClass* klass)
+	{
+		auto iter = m_class_names.find(klass);
+		if (iter != m_class_names.end())
+			return iter->second;
+
+		char full_name[2048];
+		full_name[0] = 0;
+		if (klass != nullptr)
+			get_full_class_name(full_name, sizeof(full_name), klass);
+
+		return m_class_names.emplace(klass, full_name).first->second;
+	}
+
+	void worker_thread::find_references_internal(const heap_snapshot& snapshot, uint64_t request_id, const std::vector<uint64_t>& addresses)
 	{
 		std::vector<object_references_t> filtered_results;
 
-		// Stack of addresses to process
-		std::vector<uint64_t> interesting_addresses = addresses;
+		// Snapshot can't be marked, so visited objects are kept aside
+		std::vector<bool> visited(snapshot.size(), false);
+
+		// Stack of objects to process
+		std::vector<uint32_t> interesting_objects;
+		for (uint64_t addr : addresses)
+		{
+			uint32_t index = snapshot.find(addr);
+			if (index == heap_snapshot::none || visited[index])
+				continue;
+
+			visited[index] = true;
+			interesting_objects.push_back(index);
+		}
 
-		while (!interesting_addresses.empty())
+		while (!interesting_objects.empty())
 		{
-			auto addr = interesting_addresses.back();
-			interesting_addresses.pop_back();
+			auto index = interesting_objects.back();
+			interesting_objects.pop_back();
+
+			filtered_results.push_back({ snapshot.addresses[index], {} });
+			auto& result = filtered_results.back();
+			result.type = get_class_name(snapshot.classes[index]);
+			if (snapshot.flag(index, heap_snapshot::ROOT))
+				result.type += " (Root)";
+			if (snapshot.flag(index, heap_snapshot::DELETED))
+				result.type += " (Deleted)";
+
+			// Push all object's parents onto stack
+			for (auto parent = snapshot.parents_begin(index); parent != snapshot.parents_end(index); ++parent)
+			{
+				result.parents.push_back(snapshot.addresses[*parent]);
+				if (visited[*parent])
+					continue;
+
+				visited[*parent] = true;
+				interesting_objects.push_back(*parent);
+			}
+		}
+
+		m_events_sink->report_references(request_id, snapshot.frame, filtered_results);
+	}
+
+	void worker_thread::find_references(uint64_t request_id, const std::vector<uint64_t>& addresses, uint64_t frame)
+	{
+		post_query([=]()
+			{
+				auto snapshot = get_snapshot(frame, addresses);
+				find_references_internal(*snapshot, request_id, addresses);
+			});
+	}
+
+	worker_thread::references_query* worker_thread::find_references_query(uint64_t version, const std::vector<uint64_t>& addresses, bool parents)
+	{
+		auto iter = std::find_if(m_references_queries.begin(), m_references_queries.end(), [&](const references_query& query)
+			{
+				return query.version == version && query.parents == parents && query.addresses == addresses;
+			});
+		if (iter == m_references_queries.end())
+			return nullptr;
+
+		// Move it to the end of the list, as the most recently used one
+		std::rotate(iter, iter + 1, m_references_queries.end());
+		return &m_references_queries.back();
+	}
+
+	worker_thread::references_query& worker_thread::build_references_query(const heap_snapshot& snapshot, const std::vector<uint64_t>& addresses, bool parents)
+	{
+		if (m_references_queries.size() >= max_references_queries)
+			m_references_queries.erase(m_references_queries.begin());
+		m_references_queries.emplace_back();
+
+		auto& query = m_references_queries.back();
+		query.version = snapshot.version;
+		query.frame = snapshot.frame;
+		query.parents = parents;
+		query.addresses = addresses;
+
+		std::vector<uint32_t> objects;
+		for (uint64_t addr : addresses)
+		{
+			uint32_t index = snapshot.find(addr);
+			if (index == heap_snapshot::none)
+				continue;
+
+			if (parents)
+				objects.insert(objects.end(), snapshot.parents_begin(index), snapshot.parents_end(index));
+			else
+				objects.push_back(index);
+		}
+		// Indices are in the order of addresses
+		std::sort(objects.begin(), objects.end());
+		objects.erase(std::unique(objects.begin(), objects.end()), objects.end());
+
+		// Objects of the same class with the same marks share a label, so every class name is only resolved once.
+		// Different classes may have the same name (e.g. generic instances), and they still form a single group
+		std::unordered_map<uint64_t, uint32_t> class_labels;
+		std::unordered_map<std::string, uint32_t> label_indices;
+		for (uint32_t index : objects)
+		{
+			const bool is_root = snapshot.flag(index, heap_snapshot::ROOT);
+			const bool is_deleted = snapshot.flag(index, heap_snapshot::DELETED);
+			uint64_t key = (uint64_t)snapshot.classes[index] | (is_root ? 1 : 0) | (is_deleted ? 2 : 0);
+			auto iter = class_labels.find(key);
+			if (iter == class_labels.end())
+			{
+				std::string label = get_class_name(snapshot.classes[index]);
+				if (is_root)
+					label += " (Root)";
+				if (is_deleted)
+					label += " (Deleted)";
+
+				auto label_iter = label_indices.emplace(label, (uint32_t)query.labels.size()).first;
+				if (label_iter->second == query.labels.size())
+				{
+					query.labels.push_back(label);
+					query.label_counts.push_back(0);
+				}
+				iter = class_labels.emplace(key, label_iter->second).first;
+			}
+
+			++query.label_counts[iter->second];
+			query.entries.push_back({ iter->second, snapshot.get_parents_count(index), snapshot.addresses[index] });
+		}
+
+		// Groups are ordered by name, as the client shows them
+		std::vector<uint32_t> label_order(query.labels.size());
+		for (uint32_t i = 0; i < (uint32_t)label_order.size(); ++i)
+			label_order[i] = i;
+		std::sort(label_order.begin(), label_order.end(), [&](uint32_t a, uint32_t b) { return query.labels[a] < query.labels[b]; });
+
+		std::vector<uint32_t> label_rank(query.labels.size());
+		for (uint32_t i = 0; i < (uint32_t)label_order.size(); ++i)
+			label_rank[label_order[i]] = i;
+
+		std::sort(query.entries.begin(), query.entries.end(), [&](const references_query::entry& a, const references_query::entry& b)
+			{
+				return label_rank[a.label] < label_rank[b.label] || (a.label == b.label && a.addr < b.addr);
+			});
+
+		return query;
+	}
+
+	void worker_thread::report_references_page(uint64_t request_id, const references_query& query, uint32_t begin, uint32_t page_size)
+	{
+		references_page_t page;
+		page.frame = query.frame;
+		page.total_count = query.entries.size();
+
+		begin = std::min<uint32_t>(begin, (uint32_t)query.entries.size());
+		uint32_t end = (uint32_t)std::min<uint64_t>((uint64_t)begin + page_size, query.entries.size());
+		page.next_cursor = end < query.entries.size() ? make_references_cursor(query.version, end) : 0;
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			auto& e = query.entries[i];
+			if (page.groups.empty() || page.groups.back().type != query.labels[e.label])
+			{
+				page.groups.emplace_back();
+				page.groups.back().type = query.labels[e.label];
+				page.groups.back().count = query.label_counts[e.label];
+			}
+
+			auto& group = page.groups.back();
+			group.addresses.push_back(e.addr);
+			group.parents_count += e.parents_count;
+		}
 
-			auto iter = m_allocations.find(addr);
-			if (iter != m_allocations.end())
+		m_events_sink->report_references_page(request_id, page);
+	}
+
+	void worker_thread::find_references_page(uint64_t request_id, const std::vector<uint64_t>& addresses, bool parents, uint64_t cursor, uint32_t page_size, uint64_t frame)
+	{
+		post_query([=]()
 			{
-				static char full_name[2048];
-				get_full_class_name(full_name, sizeof(full_name), iter->first);
+				if (cursor != 0)
+				{
+					// Following pages come from the list the first page was cut from, even if newer snapshots were published since
+					const uint64_t version = get_cursor_version(cursor);
+					if (auto query = find_references_query(version, addresses, parents))
+					{
+						report_references_page(request_id, *query, get_cursor_begin(cursor), page_size);
+						return;
+					}
+
+					// The query was evicted, but if its snapshot is still the last one, the same list is built again
+					std::shared_ptr<const heap_snapshot> snapshot;
+					{
+						std::scoped_lock lock(m_snapshot_mutex);
+						snapshot = m_snapshot;
+					}
+					if (snapshot != nullptr && snapshot->version == version)
+					{
+						report_references_page(request_id, build_references_query(*snapshot, addresses, parents), get_cursor_begin(cursor), page_size);
+						return;
+					}
 
-				filtered_results.push_back({ iter->first, {} });
-				filtered_results.back().type = full_name;
-				if (iter->second.flag(alloc_info::flag::IS_ROOT))
-					filtered_results.back().type += " (Root)";
-				if (!iter->second.flag(alloc_info::flag::TMP_ALLOCATED))
-					filtered_results.back().type += " (Deleted)";
-				filtered_results.back().parents.resize(iter->second.parents.size());
-				memcpy(filtered_results.back().parents.data(), iter->second.parents.data(), sizeof(uint64_t) * iter->second.parents.size());
+					// Cursor would point into a different list in a newer snapshot, skipping or repeating objects
+					references_page_t page;
+					page.restart = true;
+					m_events_sink->report_references_page(request_id, page);
+					return;
+				}
+
+				auto snapshot = get_snapshot(frame, addresses);
+				auto query = find_references_query(snapshot->version, addresses, parents);
+				report_references_page(request_id, query != nullptr ? *query : build_references_query(*snapshot, addresses, parents), 0, page_size);
+			});
+	}
+
+	void worker_thread::find_root_paths_internal(const heap_snapshot& snapshot, uint64_t request_id, uint64_t addr, uint32_t max_paths, uint32_t max_nodes, uint32_t timeout_ms)
+	{
+		std::vector<root_path_t> paths;
+		uint32_t start = snapshot.find(addr);
+		if (start == heap_snapshot::none)
+		{
+			m_events_sink->report_root_paths(request_id, snapshot.frame, protocol::ROOT_PATHS_NOT_FOUND, paths);
+			return;
+		}
+
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+		auto status = protocol::ROOT_PATHS_COMPLETE;
+
+		// For every visited object, the child through which it was reached, i.e. the next hop towards the requested object
+		std::unordered_map<uint32_t, uint32_t> next_hop;
+		next_hop.emplace(start, heap_snapshot::none);
+		std::vector<uint32_t> roots;
+
+		// Breadth-first, so that the first roots found are the closest ones
+		std::vector<uint32_t> current{ start };
+		std::vector<uint32_t> next;
+		while (!current.empty() && roots.size() < max_paths && status == protocol::ROOT_PATHS_COMPLETE)
+		{
+			next.clear();
+			for (uint32_t child : current)
+			{
+				if (snapshot.flag(child, heap_snapshot::ROOT))
+				{
+					// Root alone explains why the object is alive, so paths don't go through it
+					roots.push_back(child);
+					if (roots.size() == max_paths)
+						break;
+					continue;
+				}
 
-				// Push all object's parents onto stack
-				for (auto& parent : iter->second.parents)
+				for (auto parent = snapshot.parents_begin(child); parent != snapshot.parents_end(child); ++parent)
 				{
-					// Check if we already have information about this object. It would be faster to mark the object somehow, but we don't want to spare the memory
-					auto check_iter = m_allocations.find(parent);
-					if (check_iter != m_allocations.end() && alloc_value(check_iter).flag(alloc_info::flag::TMP_VISITED))
+					if (next_hop.find(*parent) != next_hop.end())
 						continue;
 
-					alloc_value(check_iter).set_flag(alloc_info::flag::TMP_VISITED);
+					// Budget is only exhausted if there is one more object to visit
+					if (next_hop.size() >= max_nodes)
+					{
+						status = protocol::ROOT_PATHS_NODE_BUDGET;
+						break;
+					}
+					next_hop.emplace(*parent, child);
+					next.push_back(*parent);
+					// Clock is only checked once in a while, as it's much slower than visiting an object
+					if ((next_hop.size() & 1023) == 0 && std::chrono::steady_clock::now() > deadline)
+					{
+						status = protocol::ROOT_PATHS_TIMEOUT;
+						break;
+					}
+				}
+
+				if (status != protocol::ROOT_PATHS_COMPLETE)
+					break;
+			}
+			current.swap(next);
+		}
+
+		// A search cut short may still have found everything it was asked for
+		if (roots.size() == max_paths)
+			status = protocol::ROOT_PATHS_COMPLETE;
+
+		for (uint32_t root : roots)
+		{
+			paths.emplace_back();
+			for (uint32_t hop = root; hop != heap_snapshot::none; hop = next_hop[hop])
+				paths.back().hops.push_back({ snapshot.addresses[hop], get_class_name(snapshot.classes[hop]) });
+		}
+
+		// Root slots are found with a single scan of all root areas, which is about as fast as marking roots by GC.
+		// Roots are not part of the snapshot, and their memory is only safe to read under the lock. A slot that no longer
+		// holds the object by now is reported as unknown
+		if (!roots.empty())
+		{
+			std::unordered_map<uint64_t, size_t> unresolved;
+			for (size_t i = 0; i < roots.size(); ++i)
+				unresolved.emplace(snapshot.addresses[roots[i]], i);
+
+			std::scoped_lock roots_lock(m_roots_mutex);
+			std::vector<root_info> root_ranges;
+			m_roots.get_ranges(root_ranges);
+			for (auto& r : root_ranges)
+			{
+				const uintptr_t* p = (const uintptr_t*)(((uintptr_t)r.start + sizeof(uintptr_t) - 1) & ~(uintptr_t)(sizeof(uintptr_t) - 1));
+				const uintptr_t* e = (const uintptr_t*)(r.start + r.size);
+				for (; p + 1 <= e && !unresolved.empty(); ++p)
+				{
+					auto iter = unresolved.find((uint64_t)*p);
+					if (iter == unresolved.end())
+						continue;
 
-					interesting_addresses.push_back(parent);
+					auto& path = paths[iter->second];
+					path.root_slot = (uint64_t)p;
+					path.root_source = root_registry::get_source_name(m_roots.find_source((const char*)p));
+					unresolved.erase(iter);
 				}
 			}
+
+			for (auto& path : paths)
+			{
+				if (path.root_slot == 0)
+					path.root_source = "unknown";
+			}
 		}
 
-		m_events_sink->report_references(request_id, filtered_results);
+		m_events_sink->report_root_paths(request_id, snapshot.frame, status, paths);
 	}
 
-	void worker_thread::find_references(uint64_t request_id, const std::vector<uint64_t>& addresses, uint64_t frame)
+	void worker_thread::find_root_paths(uint64_t request_id, uint64_t addr, uint32_t max_paths, uint32_t max_nodes, uint32_t timeout_ms, uint64_t frame)
 	{
-		// List of references/parents is only updated during a call to GC. If the last time the GC was called
-		// is not in current frame, we need to update list of parents for all objects. But we set the second argument
-		// to true to avoid actually removing any objects and reporting free events to client
-		if (frame > m_last_gc_frame)
-			do_gc_sync(frame, true);
+		post_query([=]()
+			{
+				auto snapshot = get_snapshot(frame, { addr });
+				find_root_paths_internal(*snapshot, request_id, addr, max_paths, max_nodes, timeout_ms);
+			});
+	}
 
-		// When the app is paused, we don't need any locks
-		if (m_stop_lock.owns_lock())
+	void worker_thread::get_retained_sizes_internal(const heap_snapshot& snapshot, uint64_t request_id, uint32_t max_objects)
+	{
+		// Graph nodes are indices of objects in the snapshot, whose parents are already in the form dominator tree needs
+		const uint32_t count = snapshot.size();
+		std::vector<uint64_t> sizes(snapshot.sizes.begin(), snapshot.sizes.end());
+
+		dominator_tree tree;
+		tree.build(count, snapshot.parents_offsets.data(), snapshot.parents.data(), [&](uint32_t node) { return snapshot.flag(node, heap_snapshot::ROOT); });
+		auto retained = tree.get_retained_sizes(sizes);
+
+		// Types are only needed for reporting, so they're resolved after the tree is built
+		retained_sizes_t result;
+		result.frame = snapshot.frame;
+		std::unordered_map<MonoClass*, uint32_t> type_indices;
+		std::vector<uint32_t> types(count, dominator_tree::none);
+		for (uint32_t i = 0; i < count; ++i)
 		{
-			find_references_internal(request_id, addresses);
+			MonoClass* klass = snapshot.classes[i];
+			if (klass == nullptr)
+				continue;
+
+			auto iter = type_indices.find(klass);
+			if (iter == type_indices.end())
+			{
+				iter = type_indices.emplace(klass, (uint32_t)result.types.size()).first;
+				result.types.emplace_back();
+				result.types.back().name = get_class_name(klass);
+			}
+
+			types[i] = iter->second;
+			auto& type = result.types[iter->second];
+			++type.count;
+			type.size += sizes[i];
 		}
-		// When the app is not paused, we need to hold locks, or the list of allocations can change during find_references_internal call
-		else
+
+		auto types_retained = tree.get_group_retained_sizes(retained, types, (uint32_t)result.types.size());
+		for (size_t i = 0; i < result.types.size(); ++i)
+			result.types[i].retained = types_retained[i];
+
+		// Types are reported by index, so they're only sorted after objects were given their indices
+		std::vector<uint32_t> order(count);
+		for (uint32_t i = 0; i < count; ++i)
+			order[i] = i;
+		size_t objects_count = std::min<size_t>(max_objects, count);
+		std::partial_sort(order.begin(), order.begin() + objects_count, order.end(), [&](uint32_t a, uint32_t b) { return retained[a] > retained[b]; });
+		for (size_t i = 0; i < objects_count; ++i)
 		{
-			std::scoped_lock gc_lock(m_gc_mutex);
-			std::scoped_lock roots_lock(m_roots_mutex);
-			find_references_internal(request_id, addresses);
+			uint32_t node = order[i];
+			result.objects.push_back({ snapshot.addresses[node], types[node], sizes[node], retained[node] });
+		}
+
+		std::vector<uint32_t> types_order(result.types.size());
+		for (uint32_t i = 0; i < (uint32_t)types_order.size(); ++i)
+			types_order[i] = i;
+		std::sort(types_order.begin(), types_order.end(), [&](uint32_t a, uint32_t b) { return result.types[a].retained > result.types[b].retained; });
+
+		std::vector<uint32_t> new_index(result.types.size());
+		std::vector<retained_sizes_t::type_info> sorted_types;
+		sorted_types.reserve(result.types.size());
+		for (uint32_t type_index : types_order)
+		{
+			new_index[type_index] = (uint32_t)sorted_types.size();
+			sorted_types.push_back(std::move(result.types[type_index]));
+		}
+		result.types.swap(sorted_types);
+		for (auto& object : result.objects)
+		{
+			if (object.type_index != dominator_tree::none)
+				object.type_index = new_index[object.type_index];
 		}
+
+		m_events_sink->report_retained_sizes(request_id, result);
+	}
+
+	void worker_thread::get_retained_sizes(uint64_t request_id, uint32_t max_objects, uint64_t frame)
+	{
+		post_query([=]()
+			{
+				auto snapshot = get_snapshot(frame);
+				get_retained_sizes_internal(*snapshot, request_id, max_objects);
+			});
+	}
+
+	std::string worker_thread::dump_heap_internal(const std::string& path, uint64_t frame)
+	{
+		FILE* f = fopen(path.c_str(), "wb");
+		if (f == nullptr)
+			return "Failed to create file " + path;
+
+		static char buffer[1024 * 1024];
+		setvbuf(f, buffer, _IOFBF, sizeof(buffer));
+
+		m_parents.build();
+		m_roots.get_ranges(m_root_ranges);
+
+		// Objects are stored sorted by address, so that readers can find them with a binary search
+		std::vector<uint64_t> addresses;
+		addresses.reserve(m_allocations.size());
+		m_allocations.for_each([&](uint64_t addr, alloc_info&) { addresses.push_back(addr); });
+		std::sort(addresses.begin(), addresses.end());
+
+		// Header is written last, so that a partially written file is never taken for a valid one
+		heap_dump::header header = {};
+		fwrite(&header, sizeof(header), 1, f);
+
+		// 1. Objects. Types are collected along the way, since allocations don't remember their classes
+		std::unordered_map<MonoClass*, uint32_t> type_indices;
+		std::vector<heap_dump::type> types;
+		std::vector<char> strings;
+		uint64_t parents_count = 0;
+		header.objects = { sizeof(header), addresses.size() };
+		for (auto addr : addresses)
+		{
+			auto alloc = m_allocations.find(addr);
+
+			heap_dump::object object = {};
+			object.addr = addr;
+			object.size = alloc->size;
+			object.type_index = heap_dump::unknown_type;
+			object.first_parent = parents_count;
+			object.parents_count = (uint32_t)m_parents.get_parents(addr).size();
+			object.flags =
+				(alloc->flag(alloc_info::flag::IS_ROOT) ? (uint32_t)heap_dump::OBJECT_ROOT : 0u) |
+				(alloc->flag(alloc_info::flag::YOUNG) ? (uint32_t)heap_dump::OBJECT_YOUNG : 0u) |
+				(alloc->flag(alloc_info::flag::UNSAMPLED) ? (uint32_t)heap_dump::OBJECT_UNSAMPLED : 0u);
+			parents_count += object.parents_count;
+
+			if (MonoClass* klass = get_class_safe(addr))
+			{
+				auto iter = type_indices.find(klass);
+				if (iter == type_indices.end())
+				{
+					static char full_name[2048];
+					full_name[0] = 0;
+					get_full_class_name(full_name, sizeof(full_name), klass);
+
+					iter = type_indices.emplace(klass, (uint32_t)types.size()).first;
+					types.push_back({ strings.size() });
+					strings.insert(strings.end(), full_name, full_name + strlen(full_name) + 1);
+				}
+				object.type_index = iter->second;
+			}
+
+			fwrite(&object, sizeof(object), 1, f);
+		}
+
+		// 2. Parents, in the same order as objects
+		header.parents = { header.objects.offset + header.objects.count * sizeof(heap_dump::object), parents_count };
+		for (auto addr : addresses)
+		{
+			for (uint64_t parent : m_parents.get_parents(addr))
+				fwrite(&parent, sizeof(parent), 1, f);
+		}
+
+		// 3. Roots, types and their names
+		header.roots = { header.parents.offset + header.parents.count * sizeof(uint64_t), m_root_ranges.size() };
+		for (auto& r : m_root_ranges)
+		{
+			heap_dump::root root = { (uint64_t)r.start, r.size };
+			fwrite(&root, sizeof(root), 1, f);
+		}
+
+		header.types = { header.roots.offset + header.roots.count * sizeof(heap_dump::root), types.size() };
+		if (!types.empty())
+			fwrite(types.data(), sizeof(heap_dump::type), types.size(), f);
+
+		header.strings = { header.types.offset + header.types.count * sizeof(heap_dump::type), strings.size() };
+		if (!strings.empty())
+			fwrite(strings.data(), 1, strings.size(), f);
+
+		memcpy(header.magic, heap_dump::magic, sizeof(header.magic));
+		header.version = heap_dump::version;
+		header.header_size = sizeof(header);
+		header.frame = frame;
+		fseek(f, 0, SEEK_SET);
+		fwrite(&header, sizeof(header), 1, f);
+
+		bool failed = ferror(f) != 0;
+		failed = fclose(f) != 0 || failed;
+		return failed ? "Failed to write file " + path : std::string();
+	}
+
+	void worker_thread::dump_heap(uint64_t request_id, const std::string& path, uint64_t frame)
+	{
+		// Writing the file takes a while, so it is done on the query thread, and the network thread can still resume the app
+		post_query([=]()
+			{
+				std::string error;
+				for (;;)
+				{
+					// Parents are only complete after a full pass
+					if (frame > m_last_gc_frame || !m_parents_complete)
+						do_gc_sync(frame, true);
+
+					// Allocations and GC passes still go on unless the app is paused, so the state must not change under us
+					std::scoped_lock gc_lock(m_gc_mutex);
+					std::scoped_lock roots_lock(m_roots_mutex);
+					// An incremental pass may have run before we got the locks. Pass after parents update is always full,
+					// so this only happens once
+					if (!m_parents_complete)
+						continue;
+
+					error = dump_heap_internal(path, frame);
+					break;
+				}
+
+				m_events_sink->report_heap_dumped(request_id, error.empty(), error.empty() ? path : error);
+			});
 	}
 
 	/*
-		"Pauses" the profiled app. Actually, all it does is to hold a hard lock on m_stop_mutex.
-		The same mutex is locked by all allocations attempt, which means that all threads that
-		attempt a managed allocation will be blocked. However, purely native threads WILL CONTINUE TO RUN!
-		We have no sure way to stop all threads while avoiding stopping profiler threads, so this is the
-		best we can do. Seems good enough for most uses.
+		"Pauses" the profiled app. Actually, all it does is to set m_paused flag. All allocation attempts
+		check the flag, which means that all threads that attempt a managed allocation will be blocked
+		(allocations that were already in progress are allowed to finish). However, purely native threads
+		WILL CONTINUE TO RUN! We have no sure way to stop all threads while avoiding stopping profiler threads,
+		so this is the best we can do. Seems good enough for most uses.
 	*/
 	void worker_thread::pause_app(uint64_t request_id)
 	{
-		if (!m_stop_lock.owns_lock())
-		{
-			m_stop_lock = std::unique_lock<std::shared_mutex>(m_stop_mutex);
-		}
+		m_paused = true;
 
 		m_events_sink->report_paused(request_id, true);
 	}
@@ -530,17 +1638,17 @@ namespace owlcat
 	*/
 	void worker_thread::resume_app(uint64_t request_id)
 	{
-		if (m_stop_lock.owns_lock())
 		{
-			m_stop_lock.unlock();
-			m_stop_lock.release();
+			std::scoped_lock lock(m_pause_mutex);
+			m_paused = false;
 		}
+		m_pause_cv.notify_all();
 
 		m_events_sink->report_resumed(request_id, true);
 	}
 
 	bool worker_thread::is_paused() const
 	{
-		return m_stop_lock.owns_lock();
+		return m_paused;
 	}
 }
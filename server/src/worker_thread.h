@@ -1,86 +1,38 @@
 #pragma once
 
 #include "mono/metadata/profiler.h"
+#include "mono_profiler_server.h"
+#include "mono_profiler.h"
+#include "counting_allocator.h"
+#include "address_map.h"
+#include "parent_edges.h"
+#include "heap_snapshot.h"
+#include "symbol_table.h"
+#include "stack_backtrace.h"
+#include "heap_scanner.h"
+#include "class_layouts.h"
+#include "root_registry.h"
+#include "allocation_sampler.h"
+#include "type_filter.h"
 #include <vector>
+#include <string>
+#include <unordered_map>
 #include <thread>
 #include <mutex>
-#include <shared_mutex>
-#include <unordered_map>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <deque>
+#include <functional>
 #include <concurrentqueue.h>
-//#include "tsl/robin_map.h"
-
-//#define DEBUG_ALLOCS
-
-extern volatile size_t map_size;
-
-/*
-	Allocator used to examine the size of hash maps used by the profiler
-*/
-template<typename T>
-class counting_allocator
-{
-private:
-	using real_allocator = std::allocator<T>;
-	real_allocator m_real_allocator;
-
-public:
-	counting_allocator() {}
-	counting_allocator(const counting_allocator<T>& other) {}
-	template<typename TOther>
-	counting_allocator(const counting_allocator<TOther>& other) {}
-
-	template<typename X>
-	struct rebind
-	{
-		typedef counting_allocator<X> other;
-	};
-
-	using value_type = typename real_allocator::value_type;
-	using size_type = typename real_allocator::size_type;
-	using difference_type = typename real_allocator::difference_type;
-	using propagate_on_container_move_assignment = typename real_allocator::propagate_on_container_move_assignment;
-	using is_always_equal = typename real_allocator::is_always_equal;
-
-	value_type* allocate(std::size_t n)
-	{
-		map_size += n * sizeof(T);
-		return m_real_allocator.allocate(n);
-	}
-
-	void deallocate(value_type* p, std::size_t n)
-	{
-		map_size -= n * sizeof(T);
-		m_real_allocator.deallocate(p, n);
-	}
-};
-
-template<>
-class counting_allocator<void>
-{
-public:
-	template<typename X>
-	struct rebind
-	{
-		typedef counting_allocator<X> other;
-	};
-
-	using value_type = void;
-	using size_type = size_t;
-	using difference_type = ptrdiff_t;
-};
+#include <wait_event.h>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
-// return that all specializations of this allocator are interchangeable
-template <class T1, class T2>
-bool operator== (const counting_allocator<T1>&,
-	const counting_allocator<T2>&) throw() {
-	return true;
-}
-template <class T1, class T2>
-bool operator!= (const counting_allocator<T1>&,
-	const counting_allocator<T2>&) throw() {
-	return false;
-}
+//#define DEBUG_ALLOCS
 
 namespace owlcat
 {
@@ -92,11 +44,34 @@ namespace owlcat
 	*/
 	class worker_thread
 	{
-	private:
-		// Callstacks containing these words won't be collected
-		// TODO: Allow to specify stop-list from C# or client?
-		std::vector<const char *> m_stopwords;		
+	public:
+		/*
+			Statistics of a single pseudo-GC pass
+		*/
+		struct gc_stats
+		{
+			// True if all objects were traversed, false for incremental pass
+			bool full = false;
+			// Number of objects whose contents were scanned for references, and how many of them were scanned
+			// conservatively, because their layout is unknown
+			size_t scanned = 0;
+			size_t conservative = 0;
+			// Incremental pass only: number of old objects checked for modifications, and how many were modified
+			size_t checked = 0;
+			size_t modified = 0;
+			// Number of objects allocated since the previous pass
+			size_t young = 0;
+			// Number of objects reported as freed
+			size_t freed = 0;
+			// Number of objects alive after the pass
+			size_t live = 0;
+			// Interned callstacks and registered roots. Copied while the pass holds the locks, so that whoever logs
+			// the statistics doesn't have to take them
+			symbol_table::callstack_stats callstacks;
+			root_registry::stats roots;
+		};
 
+	private:
 		// For debugging
 		//FILE* m_alloc_loc;
 
@@ -104,56 +79,65 @@ namespace owlcat
 		uint64_t m_allocated = 0;
 		uint64_t m_freed = 0;
 
-		/*
-			Callstack storage
-		*/
-		struct stack_backtrace
-		{
-			stack_backtrace()
-			{
-				backtrace.reserve(32);
-			}
-
-			mono_bool add_trace(MonoMethod* method, int32_t native_offset, int32_t il_offset, mono_bool managed);
-
-			std::vector<MonoMethod*> backtrace;
-			bool stopword_met = false;
-		};
-
-		enum class work_item_type : uint8_t {alloc, free};
+		enum class work_item_type : uint8_t {alloc, free_batch};
 		/*
 			A work item to be processed by worker thread
 		*/
 		struct work_item
 		{
+			// Global sequence number of event. Events from different threads are processed in this order
+			uint64_t sequence;
 			// Frame when event happened
 			uint64_t frame;
 			// Class of allocated object (nullptr for other events)
 			MonoClass* klass = 0;
 			// Allocated object itself (nullptr for other events)
 			MonoObject* obj = 0;
-			// Size of allocated or freed object
+			// Size of allocated object
 			uint32_t size;
 			// Callstack at which object was allocated (empty for other events)
 			stack_backtrace backtrace;
+			// False for allocations that were not sampled or were filtered out. They have no callstack and are only counted
+			bool sampled = true;
+			// Layout of the class, if the allocating thread resolved it for this allocation (see class_layouts)
+			std::unique_ptr<class_layout> layout;
+			// Objects freed by GC, sorted by address (empty for other events)
+			std::vector<freed_object> freed;
+			// Number and size of unsampled objects freed by GC
+			unsampled_totals unsampled;
 			// Type of event
 			work_item_type type;
 		};
 
 		/*
-			Concurrent queue of items to be processed
+			Concurrent queue of items to be processed. Every producer thread uses its own thread-local
+			producer token (see "High-level design" section of https://github.com/cameron314/concurrentqueue),
+			so allocating threads never contend with each other. Tokens can't outlive the queue, and threads
+			outlive worker_thread objects, so the queue is created once and lives as long as the process does.
 		*/
-		moodycamel::ConcurrentQueue<work_item> m_work_items;
+		static moodycamel::ConcurrentQueue<work_item>& get_work_items();
 		/*
-			Token use to make events reported from different treads appear in correct sequence
-			(see "High-level design" section of https://github.com/cameron314/concurrentqueue)
+			Next sequence number to be given to an event. Also lives as long as the process does, so that
+			events enqueued while the profiler is restarted don't confuse the new worker.
 		*/
-		moodycamel::ProducerToken m_work_items_token;
+		static std::atomic<uint64_t> s_next_sequence;
 		/*
-			ConcurrentQueue doesn't support any way to check if it is empty, so here's a bool
-			that the worker thread sets when it failed to dequeue an item.
+			Items are dequeued from different producers in arbitrary order, so they're reordered by sequence
+			number using this heap before processing. It only holds items that arrived ahead of their turn.
 		*/
-		bool m_work_items_empty = true;
+		std::vector<work_item> m_reorder_heap;
+		// Notified whenever an item is enqueued, so that the worker thread can sleep when there is nothing to do
+		static wait_event s_work_items_event;
+		// Notified whenever the worker thread takes an item or runs out of them. Used by GC to wait for the worker
+		wait_event m_progress_event;
+		// Sequence number of the next item to process
+		std::atomic<uint64_t> m_next_sequence_to_process{ 0 };
+		// Incremented every time the worker thread finds no item that can be processed
+		std::atomic<uint64_t> m_idle_passes{ 0 };
+		// Time when the worker started waiting for a missing sequence number
+		std::chrono::steady_clock::time_point m_gap_start;
+		// Last frame of processed event. Frames of events are clamped to it, so that they never go back
+		uint64_t m_last_frame = 0;
 		/*
 			A pointer to a sink used to report events to client
 		*/
@@ -167,7 +151,24 @@ namespace owlcat
 			we check this variable and the current frame to see if list of parents needs to be
 			updated
 		*/
-		uint64_t m_last_gc_frame = 0;
+		std::atomic<uint64_t> m_last_gc_frame{ 0 };
+
+		/*
+			Current session of events sink, and methods, types and callstacks with their IDs. Resolved callstacks
+			are kept there, so that we don't need to get names of methods for every allocation
+		*/
+		uint64_t m_session = 0;
+		symbol_table m_symbols;
+		/*
+			Sampling interval, and numbers of unsampled objects allocated and freed in m_unsampled_frame, which are not
+			reported yet. Totals are reported before any event of the next frame, so that client sees frames in order
+		*/
+		uint64_t m_sampling_interval = 0;
+		// Decides which classes are profiled. Allocations of other classes are handled as unsampled
+		type_filter m_type_filter;
+		unsampled_totals m_unsampled;
+		uint64_t m_unsampled_frame = 0;
+		void report_unsampled_totals();
 
 		/*
 			Thread itself
@@ -183,10 +184,12 @@ namespace owlcat
 		*/
 		std::mutex m_roots_mutex;
 		/*
-			This mutex along with the associated lock is used to pause the app
+			When set, threads that try to allocate are blocked on m_pause_cv until the app is resumed.
+			Allocations only check the flag, so they don't take any locks unless the app is paused.
 		*/
-		std::shared_mutex m_stop_mutex;
-		std::unique_lock<std::shared_mutex> m_stop_lock;
+		std::atomic<bool> m_paused{ false };
+		std::mutex m_pause_mutex;
+		std::condition_variable m_pause_cv;
 
 		/*
 			Information about a single allocation
@@ -197,9 +200,11 @@ namespace owlcat
 			uint32_t size;
 			// A set of flags, temporary and permanent for this allocation
 			uint8_t flags;
-			// List of objects that refer to this allocation.
-			// TODO: Optimize this, it takes about 30 bytes even when empty, and a lot of objects only have 1 or 2 references
-			std::vector<uint64_t, counting_allocator<uint64_t>> parents;
+			// Hash of object's contents at the time it was last scanned, used by incremental GC to find modified objects.
+			// A collision would make incremental pass miss a modified object and free young objects it references,
+			// so the hash is wide enough for that to never happen in practice.
+			uint64_t content_hash;
+			// List of objects that refer to this allocation is stored separately in m_parents
 #ifdef DEBUG_ALLOCS			
 			std::string original_class;
 			struct alloc_info* parent = 0;
@@ -211,69 +216,272 @@ namespace owlcat
 				TMP_ALLOCATED = 1 << 0,
 				TMP_VISITED   = 1 << 1,
 				IS_ROOT		  = 1 << 2,
+				// Object was allocated since the last GC pass
+				YOUNG		  = 1 << 3,
+				// Object was not sampled, so client doesn't know about it and its free is only counted
+				UNSAMPLED	  = 1 << 4,
+				// Object's class can't reference other objects, so incremental passes never check it for modifications
+				NO_REFERENCES = 1 << 5,
 			};
 
 			void set_flag(flag f) { flags |= (uint8_t)f; }
 			void reset_flag(flag f) { flags &= ~(uint8_t)f; }
 			bool flag(flag f) { return (flags & (uint8_t)f) != 0; }
+
+			// Atomically sets the specified flags and returns flags that were set before the call.
+			// Used by parallel marking, where several threads may reach the same object at once.
+			uint8_t set_flags_atomic(uint8_t f)
+			{
+#ifdef _MSC_VER
+				return (uint8_t)_InterlockedOr8((volatile char*)&flags, (char)f);
+#else
+				return __atomic_fetch_or(&flags, f, __ATOMIC_RELAXED);
+#endif
+			}
 		};
 
-		//using allocations_map = tsl::sparse_map<uint64_t, alloc_info, std::hash<uint64_t>, std::equal_to<uint64_t>, counting_allocator<std::pair<uint64_t, alloc_info>>>;
-		//using allocations_map = tsl::robin_map<uint64_t, alloc_info>;
-		using allocations_map = std::unordered_map<uint64_t, alloc_info>;
+		/*
+			List of live allocations, keyed by object address. Values don't move while GC marks objects,
+			so GC stack can store pointers to them (see address_map for details)
+		*/
+		using allocations_map = address_map<alloc_info>;
 		allocations_map m_allocations;
-
-		inline uint64_t alloc_key(allocations_map::iterator& iter) { return iter->first; }
-		inline alloc_info& alloc_value(allocations_map::iterator& iter) { return iter->second; }
-		//inline uint64_t alloc_key(allocations_map::iterator& iter) { return iter.key(); }
-		//inline alloc_info& alloc_value(allocations_map::iterator& iter) { return iter.value(); }
+		/*
+			Finds words that may be references to objects in m_allocations. Knows bounds of their addresses and pages
+			that hold them, which are extended on every allocation and rebuilt by every GC pass that frees objects
+		*/
+		heap_scanner m_scanner;
+		/*
+			Layouts of classes of allocated objects, used to only scan fields that may hold references.
+			Filled by the worker thread, read by GC
+		*/
+		class_layouts m_layouts;
+		bool m_precise_scan = false;
 
 		struct stack_entry
 		{
 			uint64_t addr;
 			alloc_info* info;
 		};
-		// Storing iterators doesn't work with robin_map/sparse_map
-		//std::vector<allocations_map::iterator> m_stack;
 		/*
-			Working stack of GC
+			State of a single thread that marks objects during GC. Each marker processes objects from
+			its private stack, and moves part of it to the shared stack when it has a lot of work, so
+			that markers which ran out of work can steal it.
 		*/
-		std::vector<stack_entry> m_stack;
+		struct mark_worker
+		{
+			// Private stack, only accessed by the owner
+			std::vector<stack_entry> stack;
+			// Stack that can be stolen from by other markers
+			std::mutex shared_mutex;
+			std::vector<stack_entry> shared;
+			std::atomic<size_t> shared_size{ 0 };
+			// Number of objects processed by this marker
+			size_t iterations = 0;
+			// Number of old objects checked for modifications, and how many of them were modified
+			size_t checked = 0;
+			size_t modified = 0;
+			// Number of objects scanned conservatively
+			size_t conservative = 0;
+		};
+		/*
+			Markers for parallel GC. The first one always runs on the thread which called GC
+		*/
+		std::vector<std::unique_ptr<mark_worker>> m_mark_workers;
+		/*
+			Number of threads used to mark objects
+		*/
+		unsigned m_gc_threads = 1;
+		/*
+			References between live objects found by the last full GC pass
+		*/
+		parent_edges m_parents;
+		// False if some objects were allocated or modified after m_parents was built (i.e. after an incremental pass)
+		std::atomic<bool> m_parents_complete{ false };
+
+		/*
+			The last published snapshot of the reference graph, see heap_snapshot. It's made by a full GC pass, but only if
+			a query can't be answered from the previous one, so that GC doesn't pay for it when references are not looked at
+		*/
+		std::shared_ptr<const heap_snapshot> m_snapshot;
+		std::mutex m_snapshot_mutex;
+		std::atomic<bool> m_snapshot_wanted{ false };
+		uint64_t m_snapshot_version = 0;
+
+		/*
+			Thread that runs reference queries on the snapshot, one at a time, in the order they were received.
+			Queries no longer hold GC locks, so they don't stop allocations or GC passes while they run
+		*/
+		std::thread m_query_thread;
+		std::mutex m_queries_mutex;
+		std::condition_variable m_queries_cv;
+		std::deque<std::function<void()>> m_queries;
+		bool m_stop_queries = false;
+		// Full names of classes, only used on the query thread
+		std::unordered_map<MonoClass*, std::string> m_class_names;
 
 		/*
-			Information about a root GC area, i.e. an area of memory which stores objects
-			that should never be freed even if no references exist to them.
+			Objects of a references page query, sorted by type label and address. The first page computes them, and
+			the following pages are served from here, so they stay consistent with the first one even if a newer snapshot
+			was published in between. Cursor of a page holds version of the snapshot, so a page is never cut from a list
+			built from another one. Only used on the query thread
 		*/
-		struct root_info
+		struct references_query
 		{
-			const char* start;
-			uint64_t size;
+			struct entry
+			{
+				uint32_t label;
+				uint32_t parents_count;
+				uint64_t addr;
+			};
+
+			// Version and frame of the snapshot the query was built from
+			uint64_t version = 0;
+			uint64_t frame = 0;
+			bool parents = false;
+			std::vector<uint64_t> addresses;
+			// Unique type names with " (Root)" and " (Deleted)" marks, see find_references_internal
+			std::vector<std::string> labels;
+			std::vector<uint64_t> label_counts;
+			std::vector<entry> entries;
 		};
-		// A list of GC roots
-		std::vector<root_info> m_roots;
+		// Queries for the recently opened nodes, the most recently used one last. A client usually loads pages of several
+		// nodes at once, and they would evict each other if only the last query was kept
+		static constexpr size_t max_references_queries = 8;
+		std::vector<references_query> m_references_queries;
+
+		/*
+			Incremental GC state. Objects that survived a pass are old, and stay marked until the next full pass.
+			An incremental pass only looks for young objects (allocated since the previous pass): it scans roots,
+			old objects whose contents hash changed since they were last scanned, and young objects reached from them.
+			Unreached young objects are freed, while old objects are only freed by a full pass.
+		*/
+		unsigned m_full_gc_interval = 1;
+		// Number of incremental passes since the last full one
+		unsigned m_gcs_since_full = 0;
+		// Set when marks of young objects can't be trusted, which forces the next pass to be full
+		bool m_next_gc_full = true;
+		// Type of the pass in progress. Markers only record parent edges during full passes
+		bool m_full_pass = true;
+
+		using root_info = root_registry::range;
+		// GC roots registered by the runtime
+		root_registry m_roots;
+		// Merged root ranges of the current pass, kept to reuse memory
+		std::vector<root_info> m_root_ranges;
+
+		/*
+			Work shared by all markers during a single GC pass
+		*/
+		struct mark_context
+		{
+			// Root areas, split into chunks, and the index of the next chunk to be taken by a marker
+			std::vector<root_info> root_chunks;
+			std::atomic<size_t> next_root_chunk{ 0 };
+			// Incremental pass only: number of chunks of allocation table slots to be checked for modified objects
+			size_t slot_chunks = 0;
+			std::atomic<size_t> next_slot_chunk{ 0 };
+			// Number of markers taking part in the pass, and how many of them ran out of work
+			size_t workers_count = 1;
+			std::atomic<size_t> idle_workers{ 0 };
+			// Number of pool markers that returned from the pass, see m_mark_threads
+			std::atomic<size_t> finished_workers{ 0 };
+		};
+
+		/*
+			Threads of markers other than the first one. They're started with the worker and sleep on m_mark_event
+			between passes, so that GC doesn't create threads while the app is stopped. The same event wakes markers
+			that ran out of work when somebody shares more, or when the pass is over.
+		*/
+		std::vector<std::thread> m_mark_threads;
+		wait_event m_mark_event;
+		// Context of the pass in progress. Pool markers join a pass when m_mark_pass changes
+		mark_context* m_mark_context = nullptr;
+		std::atomic<uint64_t> m_mark_pass{ 0 };
+		std::atomic<bool> m_stop_markers{ false };
 
 	private:
 		// Main processing function
 		void do_work();
+		// Assigns the next sequence number to item and enqueues it. Item is moved into the queue
+		static void enqueue_work_item(work_item& item);
+		// Gets the next item to process in the order of sequence numbers. Returns false if there is none yet
+		bool get_next_work_item(work_item& item);
+		// Blocks the calling thread while the app is paused
+		void wait_while_paused();
 
 		/*
 			This function performs pseoud-GC on our list of allocations to mark all live objects
-			and report all dead ones
+			and report all dead ones. The pass is full or incremental, see m_full_gc_interval
 		*/
-		int do_gc_internal(uint64_t frame, bool only_update_parents);
+		gc_stats do_gc_internal(uint64_t frame, bool only_update_parents);
+		/*
+			Marking loop of a single GC thread: scans part of the roots (and of the old objects during an incremental pass),
+			then processes objects until all markers run out of work
+		*/
+		void mark_objects(size_t worker_index, mark_context& context);
+		// Scans a single object and pushes all unmarked objects it references onto marker's stack
+		void mark_children(size_t worker_index, const stack_entry& entry);
+		// Records references from the object to candidates that turn out to be tracked, and pushes those that are unmarked
+		void mark_candidates(size_t worker_index, const stack_entry& entry, const uintptr_t* candidates, size_t count);
+		// Main function of a pool marker thread, see m_mark_threads
+		void run_marker(size_t worker_index, uint64_t last_pass);
+		// Tries to get work from marker's own shared stack, or steal it from other markers
+		bool acquire_mark_work(size_t worker_index);
 		/*
 			An attempt to use Unity's built-in functions to calculate liveness of objects. Doesn't work, but
 			needs to be examined more closely.
 		*/
 		void do_gc_unity(uint64_t frame);
 
+		/*
+			Copies the reference graph found by a full GC pass into a new snapshot and publishes it.
+			Called at the end of the pass, while GC still holds its locks. paused is true if the app was paused when the pass began
+		*/
+		void publish_snapshot(uint64_t frame, bool paused);
+		/*
+			Returns a snapshot that contains all the addresses. The last published one is reused whenever it does, even if
+			it's a few frames old: the client is told its frame, and queries don't force a full pass every time. A pass
+			is only forced if some of the objects are missing, or if the app is paused and the snapshot was made before,
+			as the user then looks at a heap that doesn't change and expects an exact answer
+		*/
+		std::shared_ptr<const heap_snapshot> get_snapshot(uint64_t frame, const std::vector<uint64_t>& addresses = {});
+		// Main function of the query thread
+		void process_queries();
+		// Adds a query to be run on the query thread
+		void post_query(std::function<void()> query);
+		// Returns full name of the class, caching it. Only called on the query thread
+		const std::string& get_class_name(MonoClass* klass);
+
 		/*
 			Finds references to the specified list of objects and reports them via events sink
 		*/
-		void find_references_internal(uint64_t request_id, const std::vector<uint64_t>& addresses);
+		void find_references_internal(const heap_snapshot& snapshot, uint64_t request_id, const std::vector<uint64_t>& addresses);
+		// Returns a query from m_references_queries built from the specified snapshot version, or nullptr
+		references_query* find_references_query(uint64_t version, const std::vector<uint64_t>& addresses, bool parents);
+		/*
+			Adds a query with the specified objects, or with their parents, to m_references_queries, evicting the least recently used one
+		*/
+		references_query& build_references_query(const heap_snapshot& snapshot, const std::vector<uint64_t>& addresses, bool parents);
+		// Reports a page of the query starting at the specified entry via events sink
+		void report_references_page(uint64_t request_id, const references_query& query, uint32_t begin, uint32_t page_size);
+		/*
+			Searches breadth-first from the object through its parents, until it finds max_paths objects referenced by GC roots,
+			and reports paths to them via events sink
+		*/
+		void find_root_paths_internal(const heap_snapshot& snapshot, uint64_t request_id, uint64_t addr, uint32_t max_paths, uint32_t max_nodes, uint32_t timeout_ms);
+		/*
+			Builds dominator tree from parents of all objects and reports retained sizes via events sink
+		*/
+		void get_retained_sizes_internal(const heap_snapshot& snapshot, uint64_t request_id, uint32_t max_objects);
+		/*
+			Writes all allocations, their parents and GC roots to a file (see heap_dump_format.h).
+			Returns an error message, or an empty string on success
+		*/
+		std::string dump_heap_internal(const std::string& path, uint64_t frame);
 
 	public:
-		worker_thread(events_sink* sink);
+		worker_thread(events_sink* sink, const mono_profiler_options& options);
 		~worker_thread();		
 
 		// Starts the thread
@@ -284,18 +492,31 @@ namespace owlcat
 		// Adds allocation event to work queue
 		void add_allocation_async(uint64_t frame, MonoClass* klass, MonoObject* obj);
 		// Performs pseudo-GC operation, blocking the calling trhead. Reports free events.
-		int do_gc_sync(uint64_t frame, bool only_update_parents);
-		// Registers a GC root
-		void register_root(const char* start, uint64_t size);
+		gc_stats do_gc_sync(uint64_t frame, bool only_update_parents);
+		// Registers a GC root. source is a MonoGCRootSource value
+		void register_root(const char* start, uint64_t size, int source);
 		// Unregisters a GC root
 		void unregister_root(const char* start);
 		// Finds references to the specified list of objects and reports them via events sink
 		void find_references(uint64_t request_id, const std::vector<uint64_t>& addresses, uint64_t frame);
+		// Reports page_size objects starting at cursor, from the specified objects or from their parents, grouped by type
+		void find_references_page(uint64_t request_id, const std::vector<uint64_t>& addresses, bool parents, uint64_t cursor, uint32_t page_size, uint64_t frame);
+		// Finds the shortest paths from GC roots to the object and reports them via events sink. Timeout doesn't include
+		// GC pass that may be needed to make a snapshot
+		void find_root_paths(uint64_t request_id, uint64_t addr, uint32_t max_paths, uint32_t max_nodes, uint32_t timeout_ms, uint64_t frame);
+		// Computes retained sizes of types and the largest objects and reports them via events sink
+		void get_retained_sizes(uint64_t request_id, uint32_t max_objects, uint64_t frame);
+		// Writes the whole heap state to a local file on the query thread and reports the result via events sink
+		void dump_heap(uint64_t request_id, const std::string& path, uint64_t frame);
 		// Pauses the profiled app
 		void pause_app(uint64_t request_id);
 		// Unpauses the profiled app
 		void resume_app(uint64_t request_id);
 		// Checks if the app is paused
 		bool is_paused() const;
+		// Replaces rules of type filter
+		void set_type_filter(const std::vector<protocol::filter_rule>& rules);
+		// Replaces stop-list: allocations from callstacks with methods containing any of these words won't be reported
+		void set_stopwords(const std::vector<std::string>& stopwords);
 	};
 }
@@ -0,0 +1,140 @@
+#include "stack_backtrace.h"
+
+#include <concurrentqueue.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+using namespace owlcat;
+
+/*
+    Microbenchmark for the allocation hook path: filling a callstack for an allocation event and
+    enqueueing it for the worker thread. Compares the old way of doing it (std::vector with reserve,
+    copied into queue) with stack_backtrace (inline storage, moved into queue).
+
+    Prints the number of heap allocations per event and time per event for both.
+*/
+
+static std::atomic<uint64_t> g_allocations{ 0 };
+
+void* operator new(size_t size)
+{
+    ++g_allocations;
+    if (void* p = malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+// The way work items used to store callstacks
+struct vector_backtrace
+{
+    vector_backtrace()
+    {
+        backtrace.reserve(32);
+    }
+
+    std::vector<MonoMethod*> backtrace;
+    bool stopword_met = false;
+};
+
+struct old_work_item
+{
+    uint64_t frame;
+    void* obj;
+    uint32_t size;
+    vector_backtrace backtrace;
+};
+
+struct new_work_item
+{
+    uint64_t sequence;
+    uint64_t frame;
+    void* obj;
+    uint32_t size;
+    stack_backtrace backtrace;
+};
+
+const size_t events_count = 1000000;
+// Events are enqueued and dequeued in chunks, like a worker thread that keeps up with the game
+const size_t chunk_size = 1024;
+
+struct result
+{
+    double allocations_per_event;
+    double ns_per_event;
+};
+
+template<typename T, typename Fill, typename Enqueue>
+result run(size_t frames, Fill fill, Enqueue enqueue)
+{
+    moodycamel::ConcurrentQueue<T> queue;
+    moodycamel::ProducerToken token(queue);
+
+    // Warm up the queue, so that its blocks are already allocated
+    for (size_t i = 0; i < chunk_size; ++i)
+        queue.enqueue(token, T());
+    T item;
+    while (queue.try_dequeue(item))
+        ;
+
+    uint64_t allocations_before = g_allocations;
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    for (size_t i = 0; i < events_count; i += chunk_size)
+    {
+        for (size_t j = 0; j < chunk_size; ++j)
+        {
+            T event;
+            event.frame = i;
+            event.obj = &event;
+            event.size = (uint32_t)j;
+            for (size_t f = 0; f < frames; ++f)
+                fill(event, (MonoMethod*)(uintptr_t)((f + 1) * 16));
+
+            enqueue(queue, token, event);
+        }
+
+        T dequeued;
+        while (queue.try_dequeue(dequeued))
+            ;
+    }
+
+    auto t2 = std::chrono::high_resolution_clock::now();
+    uint64_t allocations_after = g_allocations;
+
+    std::chrono::duration<double, std::nano> diff = t2 - t1;
+    return { double(allocations_after - allocations_before) / events_count, diff.count() / events_count };
+}
+
+int main()
+{
+    for (size_t frames : { 8, 24, 64, 96 })
+    {
+        auto old_result = run<old_work_item>(frames,
+            [](old_work_item& item, MonoMethod* method) { item.backtrace.backtrace.push_back(method); },
+            [](auto& queue, auto& token, old_work_item& item) { queue.enqueue(token, item); });
+
+        auto new_result = run<new_work_item>(frames,
+            [](new_work_item& item, MonoMethod* method) { item.backtrace.push_back(method); },
+            [](auto& queue, auto& token, new_work_item& item) { queue.enqueue(token, std::move(item)); });
+
+        printf("%2zu frames: vector + copy: %.2f allocs/event, %.1f ns/event; inline + move: %.2f allocs/event, %.1f ns/event\n",
+            frames, old_result.allocations_per_event, old_result.ns_per_event, new_result.allocations_per_event, new_result.ns_per_event);
+    }
+
+    return 0;
+}
@@ -1,6 +1,8 @@
 #include "live_objects_data.h"
 #include "common_ui.h"
 
+#include <cmath>
+
 bool live_objects_data::export_to_csv(const std::string& file)
 {
     FILE* f = fopen(file.c_str(), "w");
@@ -340,17 +342,30 @@ void live_objects_data::update(uint64_t from_frame, uint64_t to_frame, owlcat::p
         }
 
         auto& type = types[type_index_iter->second];
-        ++type.count;
-        type.size += o.size;
+        type.estimated_count += o.weight;
+        type.estimated_size += o.size * o.weight;
 
         auto callstack_iter = std::find_if(type.callstacks.begin(), type.callstacks.end(), [&o](auto& callstack) {return callstack.callstack == o.callstack_id; });
         if (callstack_iter == type.callstacks.end())
-            type.callstacks.push_back({ o.callstack_id, 1, o.size, {o.addr} });
-        else
         {
-            ++callstack_iter->count;
-            callstack_iter->size += o.size;
-            callstack_iter->addresses.push_back(o.addr);
+            type.callstacks.push_back({ o.callstack_id, 0, 0, {} });
+            callstack_iter = type.callstacks.end() - 1;
+        }
+        callstack_iter->estimated_count += o.weight;
+        callstack_iter->estimated_size += o.size * o.weight;
+        callstack_iter->addresses.push_back(o.addr);
+    }
+
+    // Weights of sampled objects are fractional, so counts and sizes are only rounded once they're summed up.
+    // Without sampling, all weights are 1 and these are exact
+    for (auto& type : types)
+    {
+        type.count = (uint64_t)std::llround(type.estimated_count);
+        type.size = (uint64_t)std::llround(type.estimated_size);
+        for (auto& callstack : type.callstacks)
+        {
+            callstack.count = (uint64_t)std::llround(callstack.estimated_count);
+            callstack.size = (uint64_t)std::llround(callstack.estimated_size);
         }
     }
 }
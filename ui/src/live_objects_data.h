@@ -30,6 +30,10 @@ public:
         uint64_t size;
 
         std::vector<uint64_t> addresses;
+
+        // Sums of weights of sampled objects, which count and size are rounded from (see owlcat::live_object::weight)
+        double estimated_count = 0;
+        double estimated_size = 0;
     };
 
     struct type_data
@@ -39,6 +43,9 @@ public:
         uint64_t size;
 
         std::vector<callstack_data> callstacks;
+
+        double estimated_count = 0;
+        double estimated_size = 0;
     };
     std::vector<type_data> types;
 };
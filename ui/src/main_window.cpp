@@ -66,66 +66,6 @@ QString size_to_string(double value)
         return QString::number(value / 1024.0 / 1024.0, 'f', 2) + "Mb";
 }
 
-void test_references_tree(object_references_tree_model& model)
-{
-    FILE* f = fopen("test.fr", "r");
-    if (f == nullptr)
-        return;
-
-    uint64_t addr_count = 0;
-    fscanf(f, "%I64u", &addr_count);
-    if (addr_count <= 0)
-        return;
-
-    std::vector<uint64_t> test_addr;
-    for (auto i = 0; i < addr_count; ++i)
-    {
-        uint64_t addr;
-        fscanf(f, "\t%I64u", &addr);
-        test_addr.push_back(addr);
-    }
-
-    uint64_t ref_count = 0;
-    fscanf(f, "%I64u", &ref_count);
-    if (ref_count <= 0)
-        return;
-
-    std::vector<owlcat::object_references_t> test_refs;
-    for (auto i = 0; i < ref_count; ++i)
-    {
-        uint64_t addr = 0;
-        char type[1024];
-        uint64_t parent_count = 0;
-
-        fscanf(f, "\t%I64u \"%[^\"]\"", &addr, type);
-
-        owlcat::object_references_t ref{ addr, type };
-
-        fscanf(f, "\t\t\t%I64u", &parent_count);
-        for (auto p = 0; p < parent_count; ++p)
-        {
-            uint64_t parent_addr;
-            fscanf(f, "\t\t\t\t%I64u", &parent_addr);
-            ref.parents.push_back({ parent_addr });
-        }
-        test_refs.push_back(ref);
-    }
-
-    //std::vector<uint64_t> test_addr = { 1,2,3 };
-    //std::vector<owlcat::object_references_t> test_refs =
-    //{
-    //    {1, "Type1", {}},
-    //    {2, "Type1", {{4}, {5}}},
-    //    {3, "Type1", {{4}, {6}}},
-    //    {4, "Type4", {}},
-    //    {5, "Type5", {}},
-    //    {6, "Type6", {{7}}},
-    //    {7, "Type7", {{1}}},
-    //};
-    //
-    model.update("", test_addr, test_refs);
-}
-
 main_window::main_window(QWidget* parent) :
     QMainWindow(parent),
     m_ui(new Ui::MainWindow)
@@ -217,7 +157,7 @@ main_window::main_window(QWidget* parent) :
 
     // --------- Object references tab ---------
 
-    test_references_tree(m_object_references_tree_model);
+    m_object_references_tree_model.set_client(&m_client);
     m_ui->objectReferences->setModel(&m_object_references_tree_model);
 
     // --------- Search results tab ---------
@@ -251,8 +191,6 @@ main_window::main_window(QWidget* parent) :
     
     connect(m_callstacksMenu->actions()[0], SIGNAL(triggered(bool)), this, SLOT(onCallstackMenuAction(bool)));
     
-    connect(this, SIGNAL(onObjectReferencesFound(std::string, std::vector<uint64_t>, std::vector<owlcat::object_references_t>)), &m_object_references_tree_model, SLOT(update(std::string, std::vector<uint64_t>, std::vector<owlcat::object_references_t>)));
-
     m_ui->objectReferences->setContextMenuPolicy(Qt::CustomContextMenu);
     m_referencesMenu.reset(new QMenu(this));
     m_referencesMenu->addAction(new QAction("Go to callstack", this));
@@ -862,23 +800,7 @@ bool main_window::trySaveUnsavedData()
 void main_window::findObjectsReferences(const std::vector<uint64_t>& addresses)
 {
     m_ui->tabWidget->setCurrentIndex(1);
-    m_client.find_objects_references(addresses, [this](const std::vector<uint64_t>& addresses, std::string error, const std::vector<owlcat::object_references_t>& result) -> void
-        {
-/*FILE* f = fopen("test.fr", "w");
-fprintf(f, "%I64u\n", addresses.size());
-for(auto& a : addresses)
-    fprintf(f, "\t%I64u\n", a);
-fprintf(f, "%I64u\n", result.size());
-for (auto& r : result)
-{
-    fprintf(f, "\t%I64u \"%s\"\n", r.address, r.type.c_str());
-    fprintf(f, "\t\t%I64u\n", r.parents.size());
-    for(auto& p : r.parents)
-        fprintf(f, "\t\t\t%I64u\n", p.address);
-}
-fclose(f);*/
-            m_object_references_tree_model.update(error, addresses, result);
-        });
+    m_object_references_tree_model.find(addresses);
 }
 
 void main_window::export_types_to_csv()
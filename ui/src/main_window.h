@@ -70,7 +70,6 @@ signals:
     void onLiveObjectTypesProgressChanged(int value);
     void onLiveObjectCallstacksProgressInitiated(int min, int max);
     void onLiveObjectCallstacksProgressChanged(int value);
-    void onObjectReferencesFound(std::string error, std::vector<uint64_t> addresses, std::vector<owlcat::object_references_t> result);
 
 public slots:
     void onOpenData();
@@ -1,67 +1,120 @@
 #include "object_references_model.h"
 
-void object_references_tree_model::add_node(const std::unordered_map<uint64_t, owlcat::object_references_t>& references, const owlcat::object_references_t& ref, tree_node_t* parent, int depth)
+#include <algorithm>
+#include <iterator>
+
+object_references_tree_model::tree_node_t* object_references_tree_model::get_node(const QModelIndex& index) const
 {
-	auto& children = parent ? parent->children : m_roots;
+	if (!index.isValid())
+		return m_root.get();
 
-	tree_node_t* new_node = nullptr;
+	return (tree_node_t*)index.internalPointer();
+}
 
-	// Group by type
-	auto type_iter = std::find_if(children.begin(), children.end(), [&](auto node) {return node->type == ref.type; });
-	if (type_iter == children.end())
-	{
-		children.push_back(std::make_shared<tree_node_t>(ref.address, ref.type, parent));
-		new_node = children.back().get();
-	}
-	else
-	{
-		(*type_iter)->addresses.push_back(ref.address);
-		new_node = (*type_iter).get();
-	}
+QModelIndex object_references_tree_model::get_index(tree_node_t* node) const
+{
+	if (node == nullptr || node == m_root.get())
+		return QModelIndex();
 
-	if (depth == 0)
+	auto& siblings = node->parent->children;
+	for (int i = 0; i < (int)siblings.size(); ++i)
 	{
-		for (auto& ref_parent : ref.parents)
-		{
-			auto ref_iter = references.find(ref_parent.address);
-			if (ref_iter == references.end())
-			{
-				// This should not happen, but does. It means that some object in references was not reported correctly?
-				continue;
-			}
-			add_node(references, ref_iter->second, new_node, depth + 1);
-		}
+		if (siblings[i].get() == node)
+			return createIndex(i, 0, node);
 	}
+
+	return QModelIndex();
 }
 
-void object_references_tree_model::clear()
+object_references_tree_model::tree_node_t* object_references_tree_model::add_child(tree_node_t* parent, const std::string& type)
 {
-	beginRemoveRows(QModelIndex(), 0, (int)m_roots.size());
-	m_roots.clear();
-	endRemoveRows();
+	int row = (int)parent->children.size();
+	beginInsertRows(get_index(parent), row, row);
+	parent->children.push_back(std::make_shared<tree_node_t>(m_next_node_id++, type, parent));
+	auto node = parent->children.back().get();
+	m_nodes[node->id] = node;
+	endInsertRows();
+
+	return node;
 }
 
-void object_references_tree_model::update(std::string error, std::vector<uint64_t> addresses, std::vector<owlcat::object_references_t> references)
+void object_references_tree_model::set_client(owlcat::mono_profiler_client* client)
 {
-	for(auto& ref : references)
-	{
-		m_references.insert(std::make_pair(ref.address, ref));
-	}
+	m_client = client;
+}
 
+void object_references_tree_model::find(const std::vector<uint64_t>& addresses)
+{
 	beginResetModel();
+	m_nodes.clear();
+	m_root = std::make_shared<tree_node_t>(m_next_node_id++, "", nullptr);
+	m_root->addresses = addresses;
+	m_root->was_expanded = true;
+	m_nodes[m_root->id] = m_root.get();
+	endResetModel();
 
-	m_roots.clear();
+	// Children of the root are the objects themselves, grouped by type
+	request_page(m_root.get(), addresses, 0);
+}
 
-	for (auto& root : addresses)
-	{
-		auto ref_iter = m_references.find(root);//std::find_if(references.begin(), references.end(), [&](auto& r) {return r.address == root; });
-		if (ref_iter != m_references.end())
+void object_references_tree_model::request_page(tree_node_t* node, const std::vector<uint64_t>& addresses, uint64_t cursor)
+{
+	if (m_client == nullptr || addresses.empty())
+		return;
+
+	// Callback is called from client's network thread, and the page is added on the thread of the model
+	uint64_t node_id = node->id;
+	m_client->find_references_page(addresses, node != m_root.get(), cursor, page_size, [this, node_id, addresses](const owlcat::references_page_t& page)
 		{
-			add_node(m_references, ref_iter->second, nullptr, 0);
-		}
+			QMetaObject::invokeMethod(this, [this, node_id, addresses, page]() { add_page(node_id, addresses, page); }, Qt::QueuedConnection);
+		});
+}
+
+void object_references_tree_model::add_page(uint64_t node_id, std::vector<uint64_t> addresses, owlcat::references_page_t page)
+{
+	// The tree could have been replaced while the page was on its way
+	auto node_iter = m_nodes.find(node_id);
+	if (node_iter == m_nodes.end())
+		return;
+
+	auto node = node_iter->second;
+
+	// Objects already loaded are merged with the new list below, so nothing is lost or shown twice
+	if (page.restart)
+	{
+		request_page(node, addresses, 0);
+		return;
 	}
 
-	endResetModel();
+	if (page.next_cursor != 0)
+		node->pending_pages.push_back({ std::move(addresses), page.next_cursor });
+
+	for (auto& group : page.groups)
+	{
+		// Group by type
+		auto type_iter = std::find_if(node->children.begin(), node->children.end(), [&](auto& child) { return child->type == group.type; });
+		auto child = type_iter != node->children.end() ? type_iter->get() : add_child(node, group.type);
+
+		// Different pages may reference the same objects, e.g. when node's own objects arrived in several pages
+		std::vector<uint64_t> new_addresses;
+		std::set_difference(group.addresses.begin(), group.addresses.end(), child->addresses.begin(), child->addresses.end(), std::back_inserter(new_addresses));
+		if (new_addresses.empty())
+			continue;
+
+		std::vector<uint64_t> merged;
+		merged.reserve(child->addresses.size() + new_addresses.size());
+		std::merge(child->addresses.begin(), child->addresses.end(), new_addresses.begin(), new_addresses.end(), std::back_inserter(merged));
+		child->addresses.swap(merged);
+		child->total_count = std::max<uint64_t>(child->total_count, std::max<uint64_t>(group.count, child->addresses.size()));
+		child->parents_count += group.parents_count;
+
+		auto child_index = get_index(child);
+		emit dataChanged(child_index, child_index);
+
+		// Node is already open, so parents of new objects must be shown too
+		if (child->was_expanded)
+			request_page(child, new_addresses, 0);
+	}
 }
 
 void object_references_tree_model::expand(QModelIndex index)
@@ -72,68 +125,33 @@ void object_references_tree_model::expand(QModelIndex index)
 
 	if (this_node->was_expanded)
 		return;
-	
-	for(int row = 0; row < this_node->children.size(); ++row)
-	{
-		auto& child = this_node->children[row];		
-
-		if (child->was_expanded)
-			continue;
-
-		for (auto& child_addr : child->addresses)
-		{
-			auto ref_iter = m_references.find(child_addr);
-			if (ref_iter == m_references.end())
-				continue;
-
-			for (auto& ref_parent : ref_iter->second.parents)
-			{
-				auto ref_parent_iter = m_references.find(ref_parent.address);
-				if (ref_parent_iter != m_references.end())
-				{
-					add_node(m_references, ref_parent_iter->second, child.get(), 1);
-				}
-			}
-		}		
-		beginInsertRows(this->index(row, 0, index), 0, (int)child->children.size());
-		endInsertRows();
-	}
 
 	this_node->was_expanded = true;
+	request_page(this_node, this_node->addresses, 0);
 }
 
 QModelIndex object_references_tree_model::index(int row, int column, const QModelIndex& parent) const
 {
-	auto parent_node = (tree_node_t*)parent.internalPointer();
-	auto& children = parent_node ? parent_node->children : m_roots;
-	if (row < 0 || row >= children.size())
+	auto parent_node = get_node(parent);
+	if (parent_node == nullptr || row < 0 || row >= (int)parent_node->children.size())
 		return QModelIndex();
-	return createIndex(row, column, children[row].get());
+	return createIndex(row, column, parent_node->children[row].get());
 }
 
 QModelIndex object_references_tree_model::parent(const QModelIndex& index) const
 {
 	auto this_node = (tree_node_t*)index.internalPointer();
-	auto parent = this_node->parent;
-
-	if (parent == nullptr)
+	if (this_node == nullptr)
 		return QModelIndex();
 
-	auto& parent_parents = parent->parent ? parent->parent->children : m_roots;
-	for (int i = 0; i < parent_parents.size(); ++i)
-	{
-		if (parent_parents[i]->type == parent->type)
-			return createIndex(i , index.column(), parent_parents[i].get());
-	}
-
-	return QModelIndex();
+	return get_index(this_node->parent);
 }
 
 int object_references_tree_model::rowCount(const QModelIndex& index) const
-{	
-	auto this_node = (tree_node_t*)index.internalPointer();
+{
+	auto this_node = get_node(index);
 	if (this_node == nullptr)
-		return (int)m_roots.size();
+		return 0;
 
 	return (int)this_node->children.size();
 }
@@ -143,15 +161,45 @@ int object_references_tree_model::columnCount(const QModelIndex& index) const
 	return 1;
 }
 
+bool object_references_tree_model::hasChildren(const QModelIndex& parent) const
+{
+	auto this_node = get_node(parent);
+	if (this_node == nullptr)
+		return false;
+
+	// Children are not loaded until the node is expanded, but the view must know that it can be
+	return !this_node->children.empty() || this_node->parents_count != 0 || !this_node->pending_pages.empty();
+}
+
+bool object_references_tree_model::canFetchMore(const QModelIndex& parent) const
+{
+	auto this_node = get_node(parent);
+	return this_node != nullptr && !this_node->pending_pages.empty();
+}
+
+void object_references_tree_model::fetchMore(const QModelIndex& parent)
+{
+	auto this_node = get_node(parent);
+	if (this_node == nullptr || this_node->pending_pages.empty())
+		return;
+
+	auto page = std::move(this_node->pending_pages.front());
+	this_node->pending_pages.erase(this_node->pending_pages.begin());
+	request_page(this_node, page.addresses, page.cursor);
+}
+
 QVariant object_references_tree_model::data(const QModelIndex& index, int role) const
 {
 	auto this_node = (tree_node_t*)index.internalPointer();
-	
-	if (role != Qt::DisplayRole)
+
+	if (role != Qt::DisplayRole || this_node == nullptr)
 		return QVariant();
 
-	std::string node_text = this_node->type + std::string(" (") + std::to_string(this_node->addresses.size()) + std::string(")");
-	
+	std::string node_text = this_node->type + std::string(" (") + std::to_string(this_node->addresses.size());
+	if (this_node->total_count > this_node->addresses.size())
+		node_text += std::string(" of ") + std::to_string(this_node->total_count);
+	node_text += ")";
+
 	return node_text.c_str();
 }
 
@@ -159,7 +207,7 @@ std::vector<uint64_t> object_references_tree_model::get_addresses(const QModelIn
 {
 	auto this_node = (tree_node_t*)index.internalPointer();
 
-	if (this_node->addresses.empty())
+	if (this_node == nullptr || this_node->addresses.empty())
 		return std::vector<uint64_t>();
 	else
 		return this_node->addresses;
@@ -1,55 +1,92 @@
 #pragma once
 #include <qabstractitemmodel.h>
 #include <memory>
+#include <unordered_map>
 
 #include "mono_profiler_client.h"
 
 /*
     Model used by list of references for a list of objects
+
+    The tree is loaded lazily: children of a node (objects that reference objects of the node, grouped by type)
+    are only requested from server when the node is expanded, and only a page at a time. The view asks for the
+    next page with fetchMore when it's scrolled to the end of the loaded children.
 */
 class object_references_tree_model : public QAbstractItemModel
 {
+    // Number of objects requested in a single page
+    static const uint32_t page_size = 1000;
+
     struct tree_node_t
     {
-        tree_node_t(uint64_t _addr, std::string _type, tree_node_t* _parent)
-            : type(_type)
+        tree_node_t(uint64_t _id, std::string _type, tree_node_t* _parent)
+            : id(_id)
+            , type(_type)
             , parent(_parent)
         {
-            addresses.push_back(_addr);
         }
 
-        // If node already was expanded once and doesn't need to add its children
+        // A page of children that was not requested yet
+        struct pending_page_t
+        {
+            // Objects whose parents the page contains
+            std::vector<uint64_t> addresses;
+            uint64_t cursor;
+        };
+
+        // ID used to find the node when a page arrives, as the tree may be rebuilt before that
+        uint64_t id;
+        // If node already was expanded once and doesn't need to request its children
         bool was_expanded = false;
 
-        // All addresses that share this node
+        // All addresses that share this node, sorted
         std::vector<uint64_t> addresses;
+        // Number of objects in this node when all pages are loaded
+        uint64_t total_count = 0;
+        // Number of references to loaded objects of this node. The node can be expanded if it's not 0
+        uint64_t parents_count = 0;
         // Type of object
         std::string type;
         // Parent of object
         tree_node_t* parent;
 
         // Children of object
-        std::vector<std::shared_ptr<tree_node_t>> children;        
-    };    
+        std::vector<std::shared_ptr<tree_node_t>> children;
+        std::vector<pending_page_t> pending_pages;
+    };
+
+    owlcat::mono_profiler_client* m_client = nullptr;
 
-    // Saved list of references
-    std::unordered_map<uint64_t, owlcat::object_references_t> m_references;
+    // Invisible node, whose children are groups of objects for which we searched
+    std::shared_ptr<tree_node_t> m_root;
+    std::unordered_map<uint64_t, tree_node_t*> m_nodes;
+    uint64_t m_next_node_id = 0;
 
-    // Root objects (objects for which we searched)
-    std::vector< std::shared_ptr<tree_node_t>> m_roots;
+    tree_node_t* get_node(const QModelIndex& index) const;
+    QModelIndex get_index(tree_node_t* node) const;
+    tree_node_t* add_child(tree_node_t* parent, const std::string& type);
 
-    void add_node(const std::unordered_map<uint64_t, owlcat::object_references_t>& references, const owlcat::object_references_t& ref, tree_node_t* parent, int depth);
-    void clear();
+    // Requests a page of children of the node, i.e. parents of the specified objects
+    void request_page(tree_node_t* node, const std::vector<uint64_t>& addresses, uint64_t cursor);
+    void add_page(uint64_t node_id, std::vector<uint64_t> addresses, owlcat::references_page_t page);
 
     Q_OBJECT
+public:
+    void set_client(owlcat::mono_profiler_client* client);
+    // Starts a new tree for the specified objects
+    void find(const std::vector<uint64_t>& addresses);
+
 public slots:
-    void update(std::string error, std::vector<uint64_t> addresses, std::vector<owlcat::object_references_t> references);
     void expand(QModelIndex index);
 
+public:
     QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override;
     QModelIndex parent(const QModelIndex& index) const override;
     int rowCount(const QModelIndex& index) const override;
     int columnCount(const QModelIndex& index) const override;
+    bool hasChildren(const QModelIndex& parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
     QVariant data(const QModelIndex& index, int role) const override;
     std::vector<uint64_t> get_addresses(const QModelIndex& index) const;
 };